@@ -19,6 +19,7 @@ extern "C" {
 #define DEFAULT_MODEL_DIR "models"
 #define DEFAULT_CASCADE_FILE "models/haarcascade_frontalface_alt.xml"
 #define DEFAULT_MASK_MODEL_FILE "models/mask_detector.onnx"
+#define DEFAULT_INT8_MASK_MODEL_FILE "models/mask_detector_int8.onnx"
 #define DEFAULT_LOG_FILE "logs/face_mask_detector.log"
 
 // Logging levels
@@ -3,6 +3,7 @@
 
 #include "face_mask_detector.h"
 #include "image_processing.h"
+#include "thread_pool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,20 +40,10 @@ typedef struct {
     bool swap_rb;
     float confidence_threshold;
     float nms_threshold;
+    model_precision_t precision;
 } model_config_t;
 
-// Detection parameters
-typedef struct {
-    double scale_factor;
-    int min_neighbors;
-    int min_size_width;
-    int min_size_height;
-    int max_size_width;
-    int max_size_height;
-    bool do_canny_pruning;
-} detection_params_t;
-
-// Performance metrics
+// Performance metrics (times are for the most recent frame, counts are totals)
 typedef struct {
     double detection_time_ms;
     double preprocessing_time_ms;
@@ -62,11 +53,129 @@ typedef struct {
     int faces_with_mask;
     int faces_without_mask;
     double average_confidence;
+    uint64_t frames_processed;
+    // Mask classification cache: lookups for tracked faces, and how many
+    // reused the track's previous result
+    uint64_t cache_lookups;
+    uint64_t cache_hits;
+    // Classifier policy: faces decided by the primary classifier, and how
+    // many of them were passed on to the fallback
+    uint64_t classified_faces;
+    uint64_t escalated_faces;
 } detection_metrics_t;
 
-// Detection engine state
+// A pluggable mask classifier. Besides the status it reports a margin in
+// [0, 1]: 0 for a face on the decision boundary, 1 for a clear case.
+// The margin pointers are NULL when the caller has no use for a margin.
+// classify_batch is optional and classifies many faces at once.
+typedef struct {
+    const char* name;
+    bool needs_network;
+    int (*classify)(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* face,
+                    mask_status_t* status, float* confidence, float* margin);
+    int (*classify_batch)(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* faces, int count,
+                          mask_status_t* statuses, float* confidences, float* margins);
+} mask_classifier_t;
+
+// Indicator points against a heuristic decision at which its margin is 1
+#define HEURISTIC_MARGIN_POINTS 4
+// Skin ratio change that counts as one point in a heuristic margin
+#define HEURISTIC_RATIO_STEP 0.05
+
+// Buffers owned by an engine and reused from frame to frame. Per-face work
+// takes views into them, so they only grow until the largest face is seen.
 typedef struct {
-    cv::CascadeClassifier face_classifier;
+    cv::Mat gray;
+    cv::Mat detect_gray;
+    std::vector<cv::Rect> face_rects;
+    cv::Mat roi_gray;
+    cv::Mat roi_edges;
+    // Input tensor of the mask network: max_batch_size slots of 3 x H x W
+    // floats, written in place. tensor_views[n - 1] views its first n slots.
+    cv::Mat blob;
+    std::vector<cv::Mat> tensor_views;
+    cv::Mat output;
+    // Search-window restriction
+    cv::Mat motion_small;
+    cv::Mat motion_previous;
+    cv::Mat motion_diff;
+    std::vector<std::vector<cv::Point> > motion_contours;
+    std::vector<cv::Rect> search_regions;
+    std::vector<cv::Rect> region_faces;
+    cv::Mat signature_thumb;
+    // Integral images shared by all heuristic classifications of a frame
+    feature_plane_t plane;
+    uint64_t reallocations;
+} detection_scratch_t;
+
+// A frame's feature plane is built when at least FEATURE_PLANE_MIN_FACES
+// faces are classified and their bounding box holds no more than
+// FEATURE_PLANE_MAX_OVERHEAD times the pixels of their mouth regions
+#define FEATURE_PLANE_MIN_FACES 4
+#define FEATURE_PLANE_MAX_OVERHEAD 8.0
+
+// Search-window restriction
+#define MOTION_DOWNSCALE 8
+#define MOTION_THRESHOLD 20
+#define MAX_SEARCH_COVERAGE 0.6
+
+// Adaptive scale pyramid: face widths are binned on a log scale of step
+// FACE_SIZE_BIN_RATIO starting at FACE_SIZE_MIN_WIDTH
+#define FACE_SIZE_BINS 48
+#define FACE_SIZE_MIN_WIDTH 16
+#define FACE_SIZE_BIN_RATIO 1.1
+#define ADAPTIVE_MIN_SAMPLES 50
+#define ADAPTIVE_MAX_SAMPLES 2000
+#define ADAPTIVE_UPDATE_INTERVAL 30
+#define ADAPTIVE_EXPLORE_INTERVAL 20
+#define ADAPTIVE_TARGET_LEVELS 16
+
+// Distribution of detected face widths for one stream
+typedef struct {
+    uint64_t histogram[FACE_SIZE_BINS];
+    uint64_t samples;
+} face_size_stats_t;
+
+// Tracking limits
+#define MAX_FACE_TRACKS 32
+#define TRACK_IOU_THRESHOLD 0.3f
+#define TRACK_MAX_MISSED_KEYFRAMES 2
+#define TRACK_TEMPLATE_SIZE 24
+#define TRACK_MATCH_THRESHOLD 0.6
+
+// Mask classification cache: the lower face is reduced to a
+// MASK_SIGNATURE_SIZE square of luma, and a track's last result is reused
+// while the mean absolute difference stays within MASK_SIGNATURE_TOLERANCE
+#define MASK_SIGNATURE_SIZE 8
+#define MASK_SIGNATURE_PIXELS (MASK_SIGNATURE_SIZE * MASK_SIGNATURE_SIZE)
+#define MASK_SIGNATURE_TOLERANCE 6
+
+// A face followed across frames. Between keyframes the box is moved by
+// matching a small gray template inside a window around its last position.
+typedef struct {
+    int track_id;
+    face_detection_t last_detection;
+    mask_smoothing_t smoothing;
+    mask_status_t stable_mask_status;
+    int consecutive_detections;
+    double last_update_time;
+    bool active;
+    bool visible;
+    int missed_keyframes;
+    cv::Mat appearance;
+    cv::Mat search_buffer;
+    cv::Mat match_buffer;
+    // Last mask classification and the signature it was made on
+    uint8_t mask_signature[MASK_SIGNATURE_PIXELS];
+    bool mask_cached;
+    mask_status_t cached_status;
+    float cached_confidence;
+    int cache_age;
+} face_track_t;
+
+// Detection engine state
+struct detection_engine {
+    cascade_registry_t cascades;
     cv::dnn::Net mask_network;
     model_config_t face_model_config;
     model_config_t mask_model_config;
@@ -74,28 +183,117 @@ typedef struct {
     detection_backend_t current_backend;
     bool initialized;
     detection_metrics_t metrics;
-} detection_engine_t;
+    detection_scratch_t scratch;
+    int debug_frame_counter;
+    int last_face_count;
+    // Tracking-by-detection: the cascade runs every detection_interval frames
+    face_track_t tracks[MAX_FACE_TRACKS];
+    int detection_interval;
+    uint64_t frame_index;
+    uint64_t keyframes;
+    // Batched mask classification
+    int max_batch_size;
+    uint64_t batches;
+    uint64_t batched_faces;
+    // Mask network allocation counters: input tensor (re)allocations, and
+    // forward passes whose batch size differs from the previous one (the
+    // network re-plans its buffers for a new input shape)
+    uint64_t tensor_allocations;
+    uint64_t network_reshapes;
+    int last_forward_batch;
+    double warmup_time_ms;
+    // detect_faces_batch: one engine clone per pool thread, created on first use
+    int batch_threads;
+    thread_pool_t* batch_pool;
+    detection_engine_t* batch_engines[MAX_POOL_THREADS];
+    // Faces of one frame are classified on face_threads threads, each with
+    // an engine clone of its own (1 = on the calling thread)
+    int face_threads;
+    thread_pool_t* face_pool;
+    detection_engine_t* face_engines[MAX_POOL_THREADS];
+    // Search-window restriction: between full sweeps the cascade only scans
+    // around tracked faces and regions that changed since the last scan
+    bool roi_search;
+    int full_sweep_interval;
+    uint64_t cascade_scans;
+    uint64_t full_sweeps;
+    double scanned_fraction_sum;
+    // Adaptive scale pyramid: the primary cascade's scale step and size range
+    // follow the face sizes seen so far; every ADAPTIVE_EXPLORE_INTERVAL-th
+    // scan uses the configured parameters so new sizes can still be found
+    bool adaptive_scale;
+    bool adaptive_ready;
+    face_size_stats_t face_sizes;
+    detection_params_t adaptive_params;
+    // Coarse-to-fine: the cascade scans a copy whose long side is
+    // detection_size (0 = full resolution); candidates can be confirmed
+    // at full resolution. Cascade size limits are in frame pixels and are
+    // scaled to the scan.
+    int detection_size;
+    bool verify_detections;
+    bool scan_limits_logged;
+    uint64_t candidates_verified;
+    uint64_t candidates_rejected;
+    // Reuse a tracked face's mask result for up to this many frames while
+    // its signature holds (0 = classify every frame)
+    int mask_cache_age;
+    // Mask classification: the primary classifier decides every face; if a
+    // fallback is set, faces with a margin below escalation_margin get its
+    // result instead
+    mask_policy_t mask_policy;
+    const mask_classifier_t* primary_classifier;
+    const mask_classifier_t* fallback_classifier;
+    float escalation_margin;
+};
 
 // Core detection functions
 int init_detection_engine(detection_engine_t* engine, const model_config_t* face_config, const model_config_t* mask_config);
 void cleanup_detection_engine(detection_engine_t* engine);
+void reset_stream_state(detection_engine_t* engine);
 int detect_faces_in_frame(detection_engine_t* engine, const cv::Mat& frame, face_detection_t* faces, int max_faces, int* count);
 int classify_mask_status(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* face, 
                         mask_status_t* status, float* confidence);
 
+// Classifier policy
+const mask_classifier_t* find_mask_classifier(const char* name);
+int set_mask_classifiers(detection_engine_t* engine, const mask_classifier_t* primary,
+                         const mask_classifier_t* fallback, float escalation_margin);
+int set_mask_policy(detection_engine_t* engine, mask_policy_t policy, float escalation_margin);
+int classify_faces(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* faces, int count,
+                   mask_status_t* statuses, float* confidences);
+int set_face_threads(detection_engine_t* engine, int thread_count);
+void release_face_workers(detection_engine_t* engine);
+
 // Model loading and configuration
 int load_face_detection_model(detection_engine_t* engine, const model_config_t* config);
 int load_mask_classification_model(detection_engine_t* engine, const model_config_t* config);
 int set_detection_backend(detection_engine_t* engine, detection_backend_t backend);
+int set_face_detection_params(detection_engine_t* engine, const detection_params_t* params);
 int validate_model_config(const model_config_t* config);
 
+// Heuristic classification using the engine's scratch buffers
+mask_status_t classify_mask_simple_reliable_scratch(const cv::Mat& frame, const face_detection_t* face,
+                                                    detection_scratch_t* scratch, float* margin);
+mask_status_t classify_mask_heuristic_plane(const cv::Mat& frame, const face_detection_t* face, feature_plane_t* plane,
+                                            float* margin);
+
 // Haar Cascade specific functions
 int detect_faces_haar(detection_engine_t* engine, const cv::Mat& frame, face_detection_t* faces, int max_faces, int* count);
+bool build_search_regions(detection_engine_t* engine, const cv::Mat& gray, double track_scale,
+                          std::vector<cv::Rect>& regions);
+void merge_search_regions(std::vector<cv::Rect>& regions);
 int optimize_haar_parameters(detection_engine_t* engine, const cv::Mat& sample_frame);
+void reset_face_size_stats(face_size_stats_t* stats);
+void record_face_size(face_size_stats_t* stats, int width);
+int face_size_percentile(const face_size_stats_t* stats, double percentile);
 
 // DNN specific functions
 int detect_faces_dnn(detection_engine_t* engine, const cv::Mat& frame, face_detection_t* faces, int max_faces, int* count);
 int run_mask_classification_dnn(detection_engine_t* engine, const cv::Mat& face_roi, mask_status_t* status, float* confidence);
+int classify_mask_batch_dnn(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* faces, int count,
+                           mask_status_t* statuses, float* confidences);
+int set_mask_batch_size(detection_engine_t* engine, int batch_size);
+int warm_up_mask_network(detection_engine_t* engine);
 int preprocess_for_dnn(const cv::Mat& input, cv::Mat& blob, const model_config_t* config);
 int postprocess_detections(const cv::Mat& output, face_detection_t* faces, int max_faces, int* count, 
                           float confidence_threshold, float nms_threshold);
@@ -103,6 +301,9 @@ int postprocess_detections(const cv::Mat& output, face_detection_t* faces, int m
 // Batch processing functions
 int detect_faces_batch(detection_engine_t* engine, const cv::Mat* frames, int frame_count, 
                       face_detection_t** all_faces, int* face_counts, int max_faces_per_frame);
+int set_batch_threads(detection_engine_t* engine, int thread_count);
+int clone_detection_engine(detection_engine_t* clone, const detection_engine_t* source);
+void release_batch_workers(detection_engine_t* engine);
 int process_video_stream(detection_engine_t* engine, cv::VideoCapture& capture, 
                         void (*callback)(const cv::Mat&, const face_detection_t*, int, void*), void* user_data);
 
@@ -111,6 +312,7 @@ int optimize_detection_parameters(detection_engine_t* engine, const cv::Mat* sam
 void reset_performance_metrics(detection_engine_t* engine);
 void update_performance_metrics(detection_engine_t* engine, double detection_time, int faces_detected, 
                                int masked, int unmasked);
+void print_detection_engine_stats(const detection_engine_t* engine, const char* label);
 
 // Utility and helper functions
 void set_default_model_config(model_config_t* config, model_type_t type);
@@ -125,19 +327,16 @@ int apply_nms(face_detection_t* faces, int count, float threshold);
 float calculate_iou(const face_detection_t* face1, const face_detection_t* face2);
 
 // Tracking and temporal consistency
-typedef struct {
-    int track_id;
-    face_detection_t last_detection;
-    mask_status_t stable_mask_status;
-    int consecutive_detections;
-    double last_update_time;
-    bool active;
-} face_track_t;
-
 int init_face_tracking(face_track_t* tracks, int max_tracks);
-int update_face_tracks(face_track_t* tracks, int max_tracks, const face_detection_t* detections, 
+int update_face_tracks(face_track_t* tracks, int max_tracks, face_detection_t* detections, 
                       int detection_count, double current_time);
 int get_stable_mask_status(const face_track_t* track);
+face_track_t* find_face_track(face_track_t* tracks, int max_tracks, int track_id);
+bool follow_face_track(face_track_t* track, const cv::Mat& gray);
+void capture_track_appearance(face_track_t* track, const cv::Mat& gray);
+bool compute_mask_signature(const cv::Mat& frame, const face_detection_t* face, cv::Mat& thumbnail, uint8_t* signature);
+bool lookup_mask_cache(face_track_t* track, const uint8_t* signature, int max_age, mask_status_t* status, float* confidence);
+void store_mask_cache(face_track_t* track, const uint8_t* signature, mask_status_t status, float confidence);
 
 #ifdef __cplusplus
 }
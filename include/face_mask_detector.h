@@ -33,6 +33,20 @@
 #define DEFAULT_CONFIDENCE_THRESHOLD 0.5
 #define DEFAULT_NMS_THRESHOLD 0.4
 #define DEFAULT_INPUT_SIZE 416
+#define DEFAULT_DETECTION_WORKERS 1
+#define MAX_DETECTION_WORKERS 16
+#define DEFAULT_QUEUE_DEPTH 4
+#define DEFAULT_WRITER_QUEUE_DEPTH 8
+#define DEFAULT_DETECTION_INTERVAL 1
+#define DEFAULT_MASK_BATCH_SIZE 16
+#define DEFAULT_FULL_SWEEP_INTERVAL 15
+#define DEFAULT_LATENCY_BUDGET_MS 250
+#define DEFAULT_ESCALATION_MARGIN 0.3f
+#define MAX_CASCADES 4
+#define MAX_FALLBACK_CASCADES (MAX_CASCADES - 1)
+#define DEFAULT_CASCADE_PARAMS "1.05 2 24 300"
+#define DEFAULT_FALLBACK_CASCADE_1 "models/haarcascade_frontalface_default.xml 1.1 3 30 0"
+#define DEFAULT_FALLBACK_CASCADE_2 "models/lbpcascade_frontalface_improved.xml 1.1 2 20 0"
 
 // Error codes
 typedef enum {
@@ -54,20 +68,55 @@ typedef enum {
     MASK_STATUS_INCORRECT_MASK = 3
 } mask_status_t;
 
+// What real-time capture does when detection falls behind
+typedef enum {
+    DROP_POLICY_BLOCK = 0,   // Wait for space, never drop
+    DROP_POLICY_OLDEST = 1,  // Evict the oldest queued frame, keep the freshest
+    DROP_POLICY_NEWEST = 2   // Discard the incoming frame, keep what is queued
+} drop_policy_t;
+
+// How faces are classified when a mask network may be loaded
+typedef enum {
+    MASK_POLICY_AUTO = 0,       // Network when loaded, otherwise the heuristic
+    MASK_POLICY_HEURISTIC = 1,  // Heuristic only
+    MASK_POLICY_NETWORK = 2,    // Network for every face
+    MASK_POLICY_CASCADE = 3     // Heuristic first, network for uncertain faces
+} mask_policy_t;
+
+// Numeric precision of the mask network
+typedef enum {
+    MODEL_PRECISION_FP32 = 0,  // Float model
+    MODEL_PRECISION_INT8 = 1   // Statically quantized model, CPU only
+} model_precision_t;
+
+// Encoding of the per-frame detection result stream
+typedef enum {
+    RESULT_FORMAT_BINARY = 0,  // Length-prefixed binary records (see result_stream.h)
+    RESULT_FORMAT_JSONL = 1,   // One JSON object per line, for debugging
+    RESULT_FORMAT_NONE = 2
+} result_format_t;
+
 // Face detection structure
 typedef struct {
     int x, y, width, height;
     float confidence;
     mask_status_t mask_status;
     float mask_confidence;
-    // Enhanced temporal smoothing for stable detection
-    int mask_history[10];  // Last 10 detections (larger window)
-    int history_index;
-    int history_count;
-    mask_status_t stable_status;  // Current stable status
-    int stable_count;            // How long we've been stable
+    int track_id;                // Track this face belongs to, -1 if untracked
 } face_detection_t;
 
+// Temporal smoothing state of one face, kept with its track. Each face owns
+// its state, so faces never disturb each other's lock and smoothing needs no
+// shared lock.
+typedef struct {
+    uint8_t initialized;
+    uint8_t locked_status;          // Status held by the active lock, UNKNOWN if none
+    uint8_t previous_result;        // Last raw classification
+    uint8_t stable_status;          // First status seen, used while no lock is active
+    int16_t lock_frames_remaining;
+    int16_t same_result_count;      // Consecutive identical raw results, saturating
+} mask_smoothing_t;
+
 // Application configuration
 typedef struct {
     char model_path[MAX_PATH_LENGTH];
@@ -85,14 +134,112 @@ typedef struct {
     bool show_preview;
     bool verbose;
     bool real_time;
+    // Pipeline settings
+    int detection_workers;
+    int queue_depth;
+    // Threads classifying the faces of one frame, per detection worker
+    // (0 = one per core, 1 = serial)
+    int face_threads;
+    // Cascade chain: primary parameters "scale neighbors min_size max_size",
+    // fallbacks as "path [scale neighbors min_size max_size]"
+    char cascade_params[MAX_STRING_LENGTH];
+    char fallback_cascades[MAX_FALLBACK_CASCADES][MAX_PATH_LENGTH];
+    int fallback_cascade_count;
+    // Run the full cascade every N frames, track faces in between
+    int detection_interval;
+    // Most face crops classified in one network forward pass
+    int mask_batch_size;
+    // Scan only around known faces and motion, with a full sweep every N scans
+    bool roi_search;
+    int full_sweep_interval;
+    // Learn the cascade's scale step and size range from observed faces
+    bool adaptive_scale;
+    // Long side of the image the cascade scans (0 = full resolution), and
+    // whether candidates are confirmed at full resolution
+    int detection_size;
+    bool verify_detections;
+    // Real-time scheduling: frames older than the budget are shed
+    drop_policy_t drop_policy;
+    int latency_budget_ms;
+    // Output video is encoded on its own thread behind a queue of this
+    // depth; writer_policy decides what happens when encoding falls behind
+    int writer_queue_depth;
+    drop_policy_t writer_policy;
+    // Frames a tracked face's mask classification is reused while its
+    // appearance is unchanged (0 = classify every frame)
+    int mask_cache_age;
+    // Classifier policy; in cascade mode heuristic results with a margin
+    // below escalation_margin (0-1) are passed to the network
+    mask_policy_t mask_policy;
+    float escalation_margin;
+    // int8 loads int8_model_path (built from model_path with
+    // tools/quantize_mask_model.py) instead of the float model
+    model_precision_t model_precision;
+    char int8_model_path[MAX_PATH_LENGTH];
+    // Headless batch mode for video files: segments of the input are
+    // processed in parallel on segment_workers workers (0 = one per core)
+    // and per-frame results are written to results_path (empty = input
+    // path with ".csv" appended). Image directories and globs always run
+    // this way, on the same workers, with one results row per image.
+    bool batch_mode;
+    int segment_workers;
+    char results_path[MAX_PATH_LENGTH];
+    // Geometry of headerless .raw/.bgr/.gray inputs, "WIDTHxHEIGHT:bgr|gray[@FPS]";
+    // .y4m files describe themselves
+    char raw_format[MAX_STRING_LENGTH];
+    // Per-frame detections are streamed to result_stream_path (empty = off)
+    // as binary records or JSONL
+    char result_stream_path[MAX_PATH_LENGTH];
+    result_format_t result_format;
+    // Captured frames and their timestamps are written to record_path
+    // (empty = off); the .fmdv file can be replayed as input later
+    char record_path[MAX_PATH_LENGTH];
 } app_config_t;
 
+// Haar/LBP cascade parameters
+typedef struct {
+    double scale_factor;
+    int min_neighbors;
+    int min_size_width;
+    int min_size_height;
+    int max_size_width;
+    int max_size_height;
+    bool do_canny_pruning;
+} detection_params_t;
+
+// Cascade loaded once at startup, with usage statistics
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    cv::CascadeClassifier classifier;
+    detection_params_t params;
+    int flags;
+    uint64_t invocations;
+    uint64_t hits;
+    double total_time;
+} cascade_entry_t;
+
+// Ordered chain of cascades: the primary first, then fallbacks tried
+// only while nothing has been found
+typedef struct {
+    cascade_entry_t entries[MAX_CASCADES];
+    int count;
+    uint64_t frames;
+} cascade_registry_t;
+
+// Detection engine (see detection_engine.h)
+typedef struct detection_engine detection_engine_t;
+
+// Frame reader over a capture or a mapped file (see frame_source.h)
+typedef struct frame_source frame_source_t;
+
 // Application state
 typedef struct {
     app_config_t config;
-    cv::CascadeClassifier face_cascade;
-    cv::dnn::Net mask_net;
+    detection_engine_t* engine;
     cv::VideoCapture cap;
+    // Frames are read through the source: cap for cameras and encoded
+    // video, a memory mapping for raw and Y4M files
+    frame_source_t* source;
     cv::VideoWriter writer;
     bool running;
     pthread_mutex_t frame_mutex;
@@ -117,11 +264,27 @@ int load_config(app_config_t* config, const char* config_file);
 void set_default_config(app_config_t* config);
 void print_config(const app_config_t* config);
 
+// Cascade registry functions
+void init_cascade_registry(cascade_registry_t* registry);
+int cascade_registry_add(cascade_registry_t* registry, const char* path, const detection_params_t* params, int flags);
+void cascade_scan_limits(const cascade_entry_t* entry, double scan_scale, cv::Size* min_size, cv::Size* max_size);
+int cascade_registry_detect(cascade_registry_t* registry, const cv::Mat& gray, double scan_scale,
+                            std::vector<cv::Rect>& faces);
+int cascade_registry_detect_regions(cascade_registry_t* registry, const cv::Mat& gray, double scan_scale,
+                                    const std::vector<cv::Rect>& regions, std::vector<cv::Rect>& faces,
+                                    std::vector<cv::Rect>& region_faces);
+void print_cascade_registry_stats(const cascade_registry_t* registry, const char* label);
+int parse_detection_params(const char* text, detection_params_t* params);
+int parse_cascade_spec(const char* spec, char* path, size_t path_size, detection_params_t* params);
+
 // Detection functions
+int load_detection_models(app_state_t* state, const app_config_t* config);
+void unload_detection_models(app_state_t* state);
 int detect_faces(app_state_t* state, const cv::Mat& frame, face_detection_t* faces, int max_faces);
 int classify_mask(app_state_t* state, const cv::Mat& frame, const face_detection_t* face, mask_status_t* status, float* confidence);
 mask_status_t classify_mask_simple_reliable(const cv::Mat& frame, const face_detection_t* face);
-mask_status_t apply_temporal_smoothing(face_detection_t* face, mask_status_t current_status);
+void reset_mask_smoothing(mask_smoothing_t* state);
+mask_status_t apply_temporal_smoothing(mask_smoothing_t* state, mask_status_t current_status);
 
 // Image processing functions
 int preprocess_frame(const cv::Mat& input, cv::Mat& output, int target_width, int target_height);
@@ -139,6 +302,14 @@ double get_current_time(void);
 void print_usage(const char* program_name);
 void print_version(void);
 const char* error_to_string(fmd_error_t error);
+const char* drop_policy_to_string(drop_policy_t policy);
+int parse_drop_policy(const char* text, drop_policy_t* policy);
+const char* mask_policy_to_string(mask_policy_t policy);
+int parse_mask_policy(const char* text, mask_policy_t* policy);
+const char* model_precision_to_string(model_precision_t precision);
+int parse_model_precision(const char* text, model_precision_t* precision);
+const char* result_format_to_string(result_format_t format);
+int parse_result_format(const char* text, result_format_t* format);
 
 // Logging functions
 void log_info(const char* format, ...);
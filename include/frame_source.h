@@ -0,0 +1,104 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include "face_mask_detector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Recording container (.fmdv), little-endian: a 32 byte header ("FMDV",
+// uint32 version, int32 width, height, channels, uint32 reserved, float64 fps)
+// then per frame a float64 capture timestamp in seconds and the packed BGR
+// pixels. Every frame has the same size, so frame i is at a fixed offset.
+#define RECORDING_MAGIC "FMDV"
+#define RECORDING_VERSION 1
+#define RECORDING_HEADER_BYTES 32
+#define RECORDING_FRAME_HEADER_BYTES 8
+
+// Where frames come from
+typedef enum {
+    FRAME_SOURCE_NONE = 0,
+    FRAME_SOURCE_CAPTURE = 1,  // cv::VideoCapture: camera or encoded video
+    FRAME_SOURCE_MAPPED = 2    // Memory-mapped raw, Y4M or recording file, no decoding
+} frame_source_type_t;
+
+// Pixel layout of a mapped frame
+typedef enum {
+    FRAME_PIXELS_BGR = 0,   // Packed 8-bit BGR, handed out as a view
+    FRAME_PIXELS_GRAY = 1,  // 8-bit luma, expanded to BGR
+    FRAME_PIXELS_I420 = 2   // Planar 4:2:0 YUV (Y4M), converted to BGR
+} frame_pixels_t;
+
+// Geometry of a headerless raw file, "WIDTHxHEIGHT:bgr|gray[@FPS]"
+typedef struct {
+    int width;
+    int height;
+    frame_pixels_t pixels;
+    double fps;
+} raw_frame_format_t;
+
+// Uniform frame reader over a capture or a memory-mapped file. Mapped BGR
+// frames are views into the mapping: they stay valid until the source is
+// closed, and pages written through them stay resident as private copies
+// until then, so frames are copied before being drawn on.
+struct frame_source {
+    frame_source_type_t type;
+    cv::VideoCapture* capture;
+    bool owns_capture;
+    // Mapped file and the offset of each frame's pixels in it
+    uint8_t* data;
+    size_t size;
+    int width;
+    int height;
+    frame_pixels_t pixels;
+    size_t frame_bytes;
+    std::vector<size_t> frame_offsets;
+    // Capture timestamps of a recording, in seconds; empty for other files
+    std::vector<double> frame_times;
+    int64_t next_frame;
+    double fps;
+};
+
+// Writes captured frames and their timestamps to a recording container
+typedef struct {
+    FILE* file;
+    double fps;
+    int width;
+    int height;
+    bool failed;
+    uint64_t frames;
+    uint64_t rejected;
+    uint64_t bytes;
+    double write_time;
+} frame_recorder_t;
+
+// Frame source functions
+void init_frame_source(frame_source_t* source);
+bool is_mapped_frame_file(const char* path);
+int parse_raw_frame_format(const char* text, raw_frame_format_t* format);
+int open_mapped_frame_source(frame_source_t* source, const char* path, const char* raw_format);
+int attach_capture_frame_source(frame_source_t* source, cv::VideoCapture* capture);
+int open_frame_source(frame_source_t* source, const char* path, const char* raw_format);
+bool frame_source_is_open(const frame_source_t* source);
+bool read_frame_source(frame_source_t* source, cv::Mat& frame);
+bool frame_source_shares_frames(const frame_source_t* source);
+bool grab_frame_source(frame_source_t* source);
+int seek_frame_source(frame_source_t* source, int64_t frame);
+int64_t frame_source_position(const frame_source_t* source);
+int64_t frame_source_frame_count(const frame_source_t* source);
+double frame_source_fps(const frame_source_t* source);
+cv::Size frame_source_size(const frame_source_t* source);
+double frame_source_next_time(const frame_source_t* source);
+void close_frame_source(frame_source_t* source);
+
+// Recording functions
+int open_frame_recorder(frame_recorder_t* recorder, const char* path, double fps);
+int record_frame(frame_recorder_t* recorder, const cv::Mat& frame, double timestamp);
+void close_frame_recorder(frame_recorder_t* recorder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_SOURCE_H
@@ -41,6 +41,50 @@ typedef struct {
     int histogram[256];
 } image_stats_t;
 
+// Statistics of a face sub-region used by the heuristic mask classifier
+typedef struct {
+    double hue_mean;
+    double saturation_mean;
+    double value_mean;
+    double gray_mean;
+    double gray_std;
+    double skin_ratio;  // share of pixels in the skin HSV range; -1 if not computed
+} roi_features_t;
+
+// Implementations of the fused ROI feature kernel
+typedef enum {
+    ROI_KERNEL_AUTO = 0,
+    ROI_KERNEL_SCALAR = 1,
+    ROI_KERNEL_SSE41 = 2,
+    ROI_KERNEL_AVX2 = 3
+} roi_kernel_t;
+
+// Edge maps a feature plane can hold, one per heuristic's Canny thresholds
+typedef enum {
+    PLANE_EDGES_STRONG = 0,  // Canny 50/150, simple reliable heuristic
+    PLANE_EDGES_SOFT = 1,    // Canny 30/100, skin-ratio heuristic
+    PLANE_EDGE_MAPS = 2
+} plane_edges_t;
+
+// Integral images over one region of a frame, built once per frame so the
+// statistics of any rectangle inside it are O(1) lookups. Edge maps are
+// built over the whole area the first time one is asked for.
+typedef struct {
+    cv::Rect area;
+    bool valid;
+    uint64_t builds;
+    cv::Mat hsv;
+    cv::Mat gray;
+    cv::Mat skin;
+    cv::Mat hsv_sum;
+    cv::Mat gray_sum;
+    cv::Mat gray_sqsum;
+    cv::Mat skin_sum;
+    bool edges_ready[PLANE_EDGE_MAPS];
+    cv::Mat edges;
+    cv::Mat edge_sum[PLANE_EDGE_MAPS];
+} feature_plane_t;
+
 // Core image processing functions
 int load_image(const char* path, cv::Mat& image);
 int save_image(const char* path, const cv::Mat& image);
@@ -58,11 +102,37 @@ int apply_histogram_equalization(const cv::Mat& input, cv::Mat& output);
 int preprocess_for_detection(const cv::Mat& input, cv::Mat& output, int target_size, bool normalize);
 int create_blob_from_image(const cv::Mat& image, cv::Mat& blob, double scale_factor, 
                           const cv::Size& size, const cv::Scalar& mean, bool swap_rb);
+int write_tensor_slot(const cv::Mat& image, cv::Mat& tensor, int slot, double scale,
+                      const cv::Scalar& mean, bool swap_rb);
+int crop_face_into_tensor(const cv::Mat& frame, const face_detection_t* face, int padding,
+                          cv::Mat& tensor, int slot, double scale, const cv::Scalar& mean, bool swap_rb);
 
 // ROI and cropping functions
 int extract_roi(const cv::Mat& input, cv::Mat& output, const roi_t* roi);
 int crop_face_region(const cv::Mat& input, cv::Mat& output, const face_detection_t* face, 
                      int padding, int target_size);
+int crop_face_region_into(const cv::Mat& input, cv::Mat& output, const face_detection_t* face,
+                          int padding, int target_size);
+int crop_face_region_sized(const cv::Mat& input, cv::Mat& output, const face_detection_t* face,
+                           int padding, const cv::Size& target_size);
+
+// Scratch buffer helpers
+cv::Mat scratch_view(cv::Mat& backing, int rows, int cols, int type, uint64_t* reallocations);
+
+// Fused single-pass ROI statistics (HSV means, gray mean and deviation)
+int compute_roi_features(const cv::Mat& bgr, cv::Mat& gray, roi_features_t* features);
+int compute_bgr_roi_features(const uint8_t* bgr, size_t bgr_step, int width, int height,
+                             uint8_t* gray, size_t gray_step, roi_features_t* features, roi_kernel_t kernel);
+const char* roi_kernel_name(void);
+
+// Per-frame feature plane
+int build_feature_plane(const cv::Mat& frame, const cv::Rect& area, feature_plane_t* plane);
+void release_feature_plane(feature_plane_t* plane);
+bool feature_plane_covers(const feature_plane_t* plane, const cv::Rect& rect);
+int feature_plane_stats(const feature_plane_t* plane, const cv::Rect& rect, roi_features_t* features);
+cv::Mat feature_plane_gray(const feature_plane_t* plane, const cv::Rect& rect);
+double feature_plane_edge_density(feature_plane_t* plane, const cv::Rect& rect, plane_edges_t which);
+cv::Rect get_mouth_region(const cv::Rect& face_rect);
 
 // Image analysis functions
 int calculate_image_stats(const cv::Mat& image, image_stats_t* stats);
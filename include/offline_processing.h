@@ -0,0 +1,49 @@
+#ifndef OFFLINE_PROCESSING_H
+#define OFFLINE_PROCESSING_H
+
+#include "face_mask_detector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Batch mode splits a video file into segments of at least
+// MIN_SEGMENT_FRAMES frames, about SEGMENTS_PER_WORKER per worker so that
+// workers finishing early pick up the remaining ones
+#define MIN_SEGMENT_FRAMES 300
+#define SEGMENTS_PER_WORKER 4
+#define MAX_VIDEO_SEGMENTS 1024
+
+// Columns of the batch results file, one row per frame
+#define DETECTION_RESULTS_HEADER "frame,timestamp_ms,faces,with_mask,without_mask,detections"
+
+// Still-image mode manifest, one row per input image
+#define IMAGE_RESULTS_HEADER "image,status,width,height,faces,with_mask,without_mask,detections"
+#define DEFAULT_IMAGE_RESULTS_FILE "image_results.csv"
+
+// One time range of the input video. Its results go to a part file that
+// is appended to the results in segment order once all segments are done.
+typedef struct {
+    int index;
+    int64_t start_frame;
+    int64_t end_frame;  // Exclusive; INT64_MAX reads to the end of the file
+    char part_path[MAX_PATH_LENGTH];
+    uint64_t frames_processed;
+    uint64_t faces_detected;
+    double busy_time;
+    int result;
+} video_segment_t;
+
+// Offline processing functions
+int plan_video_segments(int64_t frame_count, int worker_count, video_segment_t* segments, int max_segments);
+int write_detection_row(FILE* file, int64_t frame, double timestamp_ms, const face_detection_t* faces, int count);
+int run_offline_processing(app_state_t* app);
+bool is_image_input(const char* path);
+int collect_image_paths(const char* input, std::vector<cv::String>& paths);
+int run_image_processing(app_state_t* app);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OFFLINE_PROCESSING_H
@@ -0,0 +1,119 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "face_mask_detector.h"
+#include "result_stream.h"
+#include "frame_source.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Unit of work handed between pipeline stages
+typedef struct {
+    cv::Mat frame;
+    uint64_t sequence;
+    uint64_t ticket;  // Dequeue order, used to hand results on in order
+    double capture_time;
+    // Seconds from the start of the stream: the recorded capture time when
+    // replaying a recording, so replays report the original timeline
+    double source_time;
+    face_detection_t detections[MAX_FACES];
+    int detection_count;
+} frame_packet_t;
+
+// Bounded blocking FIFO of frame packets
+typedef struct {
+    frame_packet_t* slots;
+    int capacity;
+    int head;
+    int count;
+    bool closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    int max_depth;
+    drop_policy_t policy;
+    uint64_t dropped;
+    uint64_t tickets;
+    // Depth right after each push, for the average depth
+    uint64_t pushes;
+    uint64_t depth_sum;
+} frame_queue_t;
+
+typedef struct detection_pipeline detection_pipeline_t;
+
+// Detection worker with its own copy of the models
+typedef struct {
+    int index;
+    app_state_t* state;
+    bool owns_state;
+    detection_pipeline_t* pipeline;
+    pthread_t thread;
+    bool started;
+    uint64_t frames_processed;
+    double busy_time;
+} detection_worker_t;
+
+// Capture -> detect -> render pipeline
+struct detection_pipeline {
+    app_state_t* app;
+    frame_queue_t capture_queue;
+    frame_queue_t render_queue;
+    // Output encoding runs on its own thread, fed by the render stage
+    frame_queue_t writer_queue;
+    pthread_t writer_thread;
+    bool writer_started;
+    uint64_t frames_written;
+    double write_time;
+    // Per-frame detection records, written by the render stage in order
+    result_stream_t results;
+    bool results_open;
+    double stream_start;
+    // Captured frames are also written to a recording for later replay
+    frame_recorder_t recorder;
+    bool recording;
+    detection_worker_t workers[MAX_DETECTION_WORKERS];
+    int worker_count;
+    int active_workers;
+    pthread_t capture_thread;
+    bool capture_started;
+    volatile bool stop_requested;
+    // Results are handed to the render stage in capture order
+    pthread_mutex_t order_mutex;
+    pthread_cond_t order_cond;
+    uint64_t next_render_sequence;
+    // Real-time scheduling
+    double latency_budget;
+    bool pace_to_source;
+    // Stage statistics
+    uint64_t frames_captured;
+    uint64_t frames_skipped;
+    uint64_t frames_stale;
+    uint64_t frames_rendered;
+    double capture_time;
+    double render_time;
+    double latency_sum;
+    double latency_max;
+};
+
+// Frame queue functions
+int init_frame_queue(frame_queue_t* queue, int capacity);
+void cleanup_frame_queue(frame_queue_t* queue);
+int frame_queue_push(frame_queue_t* queue, frame_packet_t* packet);
+int frame_queue_pop(frame_queue_t* queue, frame_packet_t* packet);
+void frame_queue_close(frame_queue_t* queue);
+int frame_queue_size(frame_queue_t* queue);
+
+// Pipeline functions
+int validate_pipeline_workers(const app_config_t* config);
+int init_detection_pipeline(detection_pipeline_t* pipeline, app_state_t* app);
+int run_detection_pipeline(detection_pipeline_t* pipeline);
+void cleanup_detection_pipeline(detection_pipeline_t* pipeline);
+void print_pipeline_stats(const detection_pipeline_t* pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PIPELINE_H
@@ -0,0 +1,56 @@
+#ifndef RESULT_STREAM_H
+#define RESULT_STREAM_H
+
+#include "face_mask_detector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary stream layout, little-endian:
+//   header  "FMDR" magic, uint32 version
+//   record  uint32 length of the rest of the record,
+//           uint64 frame, float64 timestamp_ms, uint32 face count,
+//           then per face int32 x, y, width, height, track_id,
+//           float32 confidence, mask_confidence, uint8 mask_status
+// The JSONL format writes one object per frame with the same fields.
+#define RESULT_STREAM_MAGIC "FMDR"
+#define RESULT_STREAM_VERSION 1
+#define RESULT_STREAM_HEADER_BYTES 8
+#define RESULT_RECORD_FIXED_BYTES 20
+#define RESULT_FACE_BYTES 29
+#define RESULT_STREAM_BUFFER_SIZE (1 << 20)
+// Buffered records reach the file at least this often, so readers of a
+// live stream are never more than this far behind
+#define RESULT_STREAM_FLUSH_INTERVAL 1.0
+
+// Buffered per-frame detection record writer
+typedef struct {
+    FILE* file;
+    result_format_t format;
+    uint8_t* buffer;
+    size_t capacity;
+    size_t used;
+    double last_flush;
+    bool failed;
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t flushes;
+    double write_time;
+} result_stream_t;
+
+// Result stream functions
+int open_result_stream(result_stream_t* stream, const char* path, result_format_t format, size_t buffer_size);
+int write_result_record(result_stream_t* stream, uint64_t frame, double timestamp_ms,
+                        const face_detection_t* faces, int count);
+int flush_result_stream(result_stream_t* stream);
+void close_result_stream(result_stream_t* stream);
+int decode_result_record(const uint8_t* data, size_t size, uint64_t* frame, double* timestamp_ms,
+                         face_detection_t* faces, int max_faces, int* count);
+const char* mask_status_code(mask_status_t status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RESULT_STREAM_H
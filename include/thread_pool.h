@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "face_mask_detector.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAX_POOL_THREADS 64
+
+// Task callback: task_index is in [0, task_count), worker_index identifies
+// the pool thread so tasks can use per-thread resources
+typedef void (*thread_pool_task_t)(void* context, int task_index, int worker_index);
+
+typedef struct thread_pool thread_pool_t;
+
+typedef struct {
+    thread_pool_t* pool;
+    int index;
+    pthread_t thread;
+    bool started;
+} thread_pool_worker_t;
+
+// Fixed set of threads that run parallel-for style jobs
+struct thread_pool {
+    thread_pool_worker_t workers[MAX_POOL_THREADS];
+    int thread_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    // Current job, valid while pending_tasks > 0
+    thread_pool_task_t task;
+    void* context;
+    int task_count;
+    int next_task;
+    int pending_tasks;
+    bool shutdown;
+};
+
+// Thread pool functions
+int init_thread_pool(thread_pool_t* pool, int thread_count);
+int thread_pool_run(thread_pool_t* pool, thread_pool_task_t task, void* context, int task_count);
+void cleanup_thread_pool(thread_pool_t* pool);
+int get_default_thread_count(int max_threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,98 @@
+#include "detection_engine.h"
+#include "face_mask_detector.h"
+
+void reset_face_size_stats(face_size_stats_t* stats) {
+    if (!stats) return;
+    
+    memset(stats, 0, sizeof(face_size_stats_t));
+}
+
+// Add one face width to the distribution. Old samples are halved once the
+// total passes ADAPTIVE_MAX_SAMPLES so the distribution follows the stream.
+void record_face_size(face_size_stats_t* stats, int width) {
+    if (!stats || width <= 0) return;
+    
+    int bin = 0;
+    if (width > FACE_SIZE_MIN_WIDTH) {
+        bin = (int)floor(log((double)width / FACE_SIZE_MIN_WIDTH) / log(FACE_SIZE_BIN_RATIO));
+    }
+    bin = std::min(bin, FACE_SIZE_BINS - 1);
+    
+    stats->histogram[bin]++;
+    stats->samples++;
+    
+    if (stats->samples >= ADAPTIVE_MAX_SAMPLES) {
+        stats->samples = 0;
+        for (int i = 0; i < FACE_SIZE_BINS; i++) {
+            stats->histogram[i] /= 2;
+            stats->samples += stats->histogram[i];
+        }
+    }
+}
+
+// Lower edge, in pixels, of the bin holding the given percentile (0..1)
+int face_size_percentile(const face_size_stats_t* stats, double percentile) {
+    if (!stats || stats->samples == 0) return 0;
+    
+    uint64_t target = (uint64_t)(percentile * stats->samples);
+    uint64_t seen = 0;
+    int bin = FACE_SIZE_BINS - 1;
+    for (int i = 0; i < FACE_SIZE_BINS; i++) {
+        seen += stats->histogram[i];
+        if (seen > target) {
+            bin = i;
+            break;
+        }
+    }
+    
+    return (int)floor(FACE_SIZE_MIN_WIDTH * pow(FACE_SIZE_BIN_RATIO, bin));
+}
+
+// Derive the primary cascade's size range and scale step from the observed
+// face sizes. The range spans the 2nd to 98th percentile with a margin; the
+// step is chosen so the range takes about ADAPTIVE_TARGET_LEVELS pyramid
+// levels, but never finer than the configured step.
+int optimize_haar_parameters(detection_engine_t* engine, const cv::Mat& sample_frame) {
+    if (!engine) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    const face_size_stats_t* stats = &engine->face_sizes;
+    if (stats->samples < ADAPTIVE_MIN_SAMPLES) {
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    const detection_params_t* base = &engine->face_detection_params;
+    int low = face_size_percentile(stats, 0.02);
+    int high = (int)ceil(face_size_percentile(stats, 0.98) * FACE_SIZE_BIN_RATIO);
+    
+    int min_size = std::max(base->min_size_width, (int)(low * 0.8));
+    int max_size = (int)(high * 1.25);
+    if (base->max_size_width > 0) {
+        max_size = std::min(max_size, base->max_size_width);
+    }
+    if (!sample_frame.empty()) {
+        max_size = std::min(max_size, std::min(sample_frame.cols, sample_frame.rows));
+    }
+    if (max_size <= min_size) {
+        max_size = min_size * 2;
+    }
+    
+    double scale = pow((double)max_size / min_size, 1.0 / ADAPTIVE_TARGET_LEVELS);
+    scale = std::max(base->scale_factor, std::min(scale, 1.2));
+    
+    detection_params_t* params = &engine->adaptive_params;
+    *params = *base;
+    params->scale_factor = scale;
+    params->min_size_width = min_size;
+    params->min_size_height = min_size;
+    params->max_size_width = max_size;
+    params->max_size_height = max_size;
+    
+    if (!engine->adaptive_ready) {
+        log_info("Adaptive pyramid: scale %.3f, faces %d-%d px (%llu samples)",
+                 scale, min_size, max_size, (unsigned long long)stats->samples);
+    }
+    engine->adaptive_ready = true;
+    return FMD_SUCCESS;
+}
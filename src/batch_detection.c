@@ -0,0 +1,248 @@
+#include "detection_engine.h"
+#include "face_mask_detector.h"
+#include "thread_pool.h"
+
+// Work shared by the pool threads for one detect_faces_batch call
+typedef struct {
+    detection_engine_t* engine;
+    const cv::Mat* frames;
+    face_detection_t** all_faces;
+    int* face_counts;
+    int* results;
+    int max_faces_per_frame;
+} batch_job_t;
+
+// Build an independent engine with the same models and parameters.
+// Cascades and networks are not safe to share between threads.
+int clone_detection_engine(detection_engine_t* clone, const detection_engine_t* source) {
+    if (!clone || !source || !source->initialized) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    // Only reload the mask model if the source actually has one
+    model_config_t mask_config = source->mask_model_config;
+    if (source->mask_network.empty()) {
+        mask_config.model_path[0] = '\0';
+    }
+    
+    int result = init_detection_engine(clone, &source->face_model_config, &mask_config);
+    if (result != FMD_SUCCESS) {
+        return result;
+    }
+    
+    set_face_detection_params(clone, &source->face_detection_params);
+    for (int i = 1; i < source->cascades.count; i++) {
+        const cascade_entry_t* entry = &source->cascades.entries[i];
+        cascade_registry_add(&clone->cascades, entry->path, &entry->params, entry->flags);
+    }
+    
+    set_mask_batch_size(clone, source->max_batch_size);
+    // Classifiers are stateless tables, so clones share the source's
+    set_mask_classifiers(clone, source->primary_classifier, source->fallback_classifier, source->escalation_margin);
+    clone->mask_policy = source->mask_policy;
+    // Motion regions need consecutive frames too, so clones always sweep
+    clone->roi_search = false;
+    // Each clone would learn its pyramid from whichever frames it happened to
+    // get; clones scan with what the source has learned so far instead
+    clone->adaptive_scale = false;
+    if (source->adaptive_scale && source->adaptive_ready && clone->cascades.count > 0) {
+        clone->cascades.entries[0].params = source->adaptive_params;
+    }
+    clone->detection_size = source->detection_size;
+    clone->verify_detections = source->verify_detections;
+    // Frames of a batch are spread over threads, so no clone sees a
+    // contiguous sequence to track through
+    clone->detection_interval = 1;
+    warm_up_mask_network(clone);
+    return FMD_SUCCESS;
+}
+
+// Threads used by detect_faces_batch; 0 means one per core
+int set_batch_threads(detection_engine_t* engine, int thread_count) {
+    if (!engine || thread_count < 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (thread_count != engine->batch_threads) {
+        release_batch_workers(engine);
+        engine->batch_threads = std::min(thread_count, MAX_POOL_THREADS);
+    }
+    return FMD_SUCCESS;
+}
+
+// Stop the batch pool and free the per-thread engines
+void release_batch_workers(detection_engine_t* engine) {
+    if (!engine) return;
+    
+    if (engine->batch_pool) {
+        cleanup_thread_pool(engine->batch_pool);
+        delete engine->batch_pool;
+        engine->batch_pool = NULL;
+    }
+    
+    for (int i = 0; i < MAX_POOL_THREADS; i++) {
+        if (engine->batch_engines[i]) {
+            cleanup_detection_engine(engine->batch_engines[i]);
+            delete engine->batch_engines[i];
+            engine->batch_engines[i] = NULL;
+        }
+    }
+}
+
+// Load one engine per thread and start the pool
+static int ensure_batch_workers(detection_engine_t* engine) {
+    if (engine->batch_pool) {
+        return FMD_SUCCESS;
+    }
+    
+    int thread_count = engine->batch_threads > 0 ? engine->batch_threads : get_default_thread_count(MAX_POOL_THREADS);
+    
+    for (int i = 0; i < thread_count; i++) {
+        detection_engine_t* clone = new detection_engine_t();
+        int result = clone_detection_engine(clone, engine);
+        if (result != FMD_SUCCESS) {
+            log_error("Failed to load models for batch worker %d", i);
+            cleanup_detection_engine(clone);
+            delete clone;
+            release_batch_workers(engine);
+            return result;
+        }
+        engine->batch_engines[i] = clone;
+    }
+    
+    engine->batch_pool = new thread_pool_t();
+    int result = init_thread_pool(engine->batch_pool, thread_count);
+    if (result != FMD_SUCCESS) {
+        delete engine->batch_pool;
+        engine->batch_pool = NULL;
+        release_batch_workers(engine);
+        return result;
+    }
+    
+    log_info("Batch detection using %d threads", thread_count);
+    return FMD_SUCCESS;
+}
+
+// Pool task: detect one frame with the calling thread's engine. Which thread
+// gets which frame depends on scheduling, so every frame is detected from a
+// clean stream state and its faces carry no track.
+static void batch_detect_task(void* context, int task_index, int worker_index) {
+    batch_job_t* job = (batch_job_t*)context;
+    detection_engine_t* worker_engine = job->engine->batch_engines[worker_index];
+    face_detection_t* faces = job->all_faces[task_index];
+    
+    reset_stream_state(worker_engine);
+    job->face_counts[task_index] = 0;
+    job->results[task_index] = detect_faces_in_frame(worker_engine, job->frames[task_index], faces,
+                                                     job->max_faces_per_frame, &job->face_counts[task_index]);
+    for (int i = 0; i < job->face_counts[task_index]; i++) {
+        faces[i].track_id = -1;
+    }
+}
+
+// Detect faces in many frames in parallel. Results are written to
+// all_faces[i] / face_counts[i] for frames[i], so they keep input order.
+int detect_faces_batch(detection_engine_t* engine, const cv::Mat* frames, int frame_count,
+                      face_detection_t** all_faces, int* face_counts, int max_faces_per_frame) {
+    if (!engine || !engine->initialized || !frames || frame_count < 0 || !all_faces || !face_counts ||
+        max_faces_per_frame <= 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (frame_count == 0) {
+        return FMD_SUCCESS;
+    }
+    
+    int result = ensure_batch_workers(engine);
+    if (result != FMD_SUCCESS) {
+        return result;
+    }
+    
+    std::vector<int> results(frame_count, FMD_SUCCESS);
+    batch_job_t job;
+    job.engine = engine;
+    job.frames = frames;
+    job.all_faces = all_faces;
+    job.face_counts = face_counts;
+    job.results = results.data();
+    job.max_faces_per_frame = std::min(max_faces_per_frame, MAX_FACES);
+    
+    double start_time = get_current_time();
+    result = thread_pool_run(engine->batch_pool, batch_detect_task, &job, frame_count);
+    if (result != FMD_SUCCESS) {
+        return result;
+    }
+    double per_frame_ms = (get_current_time() - start_time) * 1000.0 / frame_count;
+    
+    // Fold the batch into the caller's engine metrics
+    int first_error = FMD_SUCCESS;
+    for (int i = 0; i < frame_count; i++) {
+        if (results[i] != FMD_SUCCESS && first_error == FMD_SUCCESS) {
+            first_error = results[i];
+        }
+        
+        int masked = 0;
+        int unmasked = 0;
+        for (int j = 0; j < face_counts[i]; j++) {
+            if (all_faces[i][j].mask_status == MASK_STATUS_WITH_MASK) {
+                masked++;
+            } else if (all_faces[i][j].mask_status == MASK_STATUS_WITHOUT_MASK) {
+                unmasked++;
+            }
+        }
+        update_performance_metrics(engine, per_frame_ms, face_counts[i], masked, unmasked);
+    }
+    
+    return first_error;
+}
+
+// Decode a whole stream, detecting in parallel batches and handing results
+// to the callback in frame order
+int process_video_stream(detection_engine_t* engine, cv::VideoCapture& capture,
+                        void (*callback)(const cv::Mat&, const face_detection_t*, int, void*), void* user_data) {
+    if (!engine || !engine->initialized || !capture.isOpened()) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    int result = ensure_batch_workers(engine);
+    if (result != FMD_SUCCESS) {
+        return result;
+    }
+    
+    // Two frames per thread keeps every thread busy while the batch drains
+    int batch_size = engine->batch_pool->thread_count * 2;
+    std::vector<cv::Mat> frames(batch_size);
+    std::vector<face_detection_t> faces((size_t)batch_size * MAX_FACES);
+    std::vector<face_detection_t*> all_faces(batch_size);
+    std::vector<int> face_counts(batch_size, 0);
+    for (int i = 0; i < batch_size; i++) {
+        all_faces[i] = &faces[(size_t)i * MAX_FACES];
+    }
+    
+    bool end_of_stream = false;
+    while (!end_of_stream) {
+        int frame_count = 0;
+        while (frame_count < batch_size) {
+            if (!capture.read(frames[frame_count]) || frames[frame_count].empty()) {
+                end_of_stream = true;
+                break;
+            }
+            frame_count++;
+        }
+        
+        if (frame_count == 0) break;
+        
+        result = detect_faces_batch(engine, frames.data(), frame_count, all_faces.data(), face_counts.data(), MAX_FACES);
+        if (result != FMD_SUCCESS) {
+            log_warning("Batch detection reported errors (code %d)", result);
+        }
+        
+        if (callback) {
+            for (int i = 0; i < frame_count; i++) {
+                callback(frames[i], all_faces[i], face_counts[i], user_data);
+            }
+        }
+    }
+    
+    return FMD_SUCCESS;
+}
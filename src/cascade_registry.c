@@ -0,0 +1,247 @@
+#include "face_mask_detector.h"
+#include "detection_engine.h"
+
+// Reset a registry to an empty chain
+void init_cascade_registry(cascade_registry_t* registry) {
+    if (!registry) return;
+    
+    for (int i = 0; i < MAX_CASCADES; i++) {
+        cascade_entry_t* entry = &registry->entries[i];
+        entry->path[0] = '\0';
+        entry->classifier = cv::CascadeClassifier();
+        entry->flags = 0;
+        entry->invocations = 0;
+        entry->hits = 0;
+        entry->total_time = 0.0;
+    }
+    registry->count = 0;
+    registry->frames = 0;
+}
+
+// Load a cascade from disk and append it to the chain
+int cascade_registry_add(cascade_registry_t* registry, const char* path, const detection_params_t* params, int flags) {
+    if (!registry || !path || !params || strlen(path) == 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (registry->count >= MAX_CASCADES) {
+        log_warning("Cascade registry is full, ignoring: %s", path);
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    cascade_entry_t* entry = &registry->entries[registry->count];
+    
+    try {
+        if (!entry->classifier.load(path)) {
+            log_warning("Failed to load cascade: %s", path);
+            return FMD_ERROR_MODEL_LOAD;
+        }
+    } catch (const cv::Exception& e) {
+        log_warning("OpenCV exception while loading cascade %s: %s", path, e.what());
+        return FMD_ERROR_MODEL_LOAD;
+    }
+    
+    strncpy(entry->path, path, MAX_PATH_LENGTH - 1);
+    entry->path[MAX_PATH_LENGTH - 1] = '\0';
+    entry->params = *params;
+    entry->flags = flags;
+    entry->invocations = 0;
+    entry->hits = 0;
+    entry->total_time = 0.0;
+    registry->count++;
+    
+    log_info("Registered cascade %d: %s (scale=%.2f neighbors=%d min=%d max=%d)",
+             registry->count - 1, path, params->scale_factor, params->min_neighbors,
+             params->min_size_width, params->max_size_width);
+    return FMD_SUCCESS;
+}
+
+// Face size limits for a scan at scan_scale. Cascade sizes are configured in
+// frame pixels, so a scan of a downscaled frame scales them too, but never
+// below the cascade's own window. A maximum of 0 stays unlimited.
+void cascade_scan_limits(const cascade_entry_t* entry, double scan_scale, cv::Size* min_size, cv::Size* max_size) {
+    const detection_params_t* params = &entry->params;
+    cv::Size window = entry->classifier.getOriginalWindowSize();
+    
+    *min_size = cv::Size(std::max(window.width, cvRound(params->min_size_width * scan_scale)),
+                         std::max(window.height, cvRound(params->min_size_height * scan_scale)));
+    *max_size = cv::Size();
+    if (params->max_size_width > 0 && params->max_size_height > 0) {
+        *max_size = cv::Size(std::max(min_size->width, cvRound(params->max_size_width * scan_scale)),
+                             std::max(min_size->height, cvRound(params->max_size_height * scan_scale)));
+    }
+}
+
+// Run the chain until a cascade finds something. gray is the frame scaled
+// by scan_scale.
+int cascade_registry_detect(cascade_registry_t* registry, const cv::Mat& gray, double scan_scale,
+                            std::vector<cv::Rect>& faces) {
+    faces.clear();
+    if (!registry || gray.empty()) {
+        return -1;
+    }
+    
+    registry->frames++;
+    
+    for (int i = 0; i < registry->count; i++) {
+        cascade_entry_t* entry = &registry->entries[i];
+        const detection_params_t* params = &entry->params;
+        cv::Size min_size, max_size;
+        cascade_scan_limits(entry, scan_scale, &min_size, &max_size);
+        
+        double start_time = get_current_time();
+        entry->classifier.detectMultiScale(
+            gray,
+            faces,
+            params->scale_factor,
+            params->min_neighbors,
+            entry->flags | (params->do_canny_pruning ? cv::CASCADE_DO_CANNY_PRUNING : 0),
+            min_size,
+            max_size
+        );
+        entry->total_time += get_current_time() - start_time;
+        entry->invocations++;
+        
+        if (!faces.empty()) {
+            entry->hits++;
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+// Same chain, but each cascade only scans the given regions of the frame.
+// Regions must not overlap, so a face is never reported twice.
+int cascade_registry_detect_regions(cascade_registry_t* registry, const cv::Mat& gray, double scan_scale,
+                                    const std::vector<cv::Rect>& regions, std::vector<cv::Rect>& faces,
+                                    std::vector<cv::Rect>& region_faces) {
+    faces.clear();
+    if (!registry || gray.empty()) {
+        return -1;
+    }
+    
+    registry->frames++;
+    
+    for (int i = 0; i < registry->count; i++) {
+        cascade_entry_t* entry = &registry->entries[i];
+        const detection_params_t* params = &entry->params;
+        cv::Size min_size, max_size;
+        cascade_scan_limits(entry, scan_scale, &min_size, &max_size);
+        
+        double start_time = get_current_time();
+        for (size_t r = 0; r < regions.size(); r++) {
+            const cv::Rect& region = regions[r];
+            if (region.width < min_size.width || region.height < min_size.height) {
+                continue;
+            }
+            
+            entry->classifier.detectMultiScale(
+                gray(region),
+                region_faces,
+                params->scale_factor,
+                params->min_neighbors,
+                entry->flags | (params->do_canny_pruning ? cv::CASCADE_DO_CANNY_PRUNING : 0),
+                min_size,
+                max_size
+            );
+            
+            for (size_t f = 0; f < region_faces.size(); f++) {
+                cv::Rect face = region_faces[f];
+                face.x += region.x;
+                face.y += region.y;
+                faces.push_back(face);
+            }
+        }
+        entry->total_time += get_current_time() - start_time;
+        entry->invocations++;
+        
+        if (!faces.empty()) {
+            entry->hits++;
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+// Report how often each cascade in the chain runs and how often it pays off
+void print_cascade_registry_stats(const cascade_registry_t* registry, const char* label) {
+    if (!registry || registry->frames == 0) return;
+    
+    log_info("=== Cascade Statistics (%s) ===", label ? label : "detector");
+    for (int i = 0; i < registry->count; i++) {
+        const cascade_entry_t* entry = &registry->entries[i];
+        log_info("%s %d: %s", i == 0 ? "Primary " : "Fallback", i, entry->path);
+        log_info("  fired on %.1f%% of frames (%llu), found faces in %llu (%.1f%%), %.2f ms/run",
+                 100.0 * entry->invocations / registry->frames,
+                 (unsigned long long)entry->invocations,
+                 (unsigned long long)entry->hits,
+                 entry->invocations > 0 ? 100.0 * entry->hits / entry->invocations : 0.0,
+                 entry->invocations > 0 ? entry->total_time * 1000.0 / entry->invocations : 0.0);
+    }
+    log_info("================================");
+}
+
+// Default cascade parameters (OpenCV's detectMultiScale defaults)
+void set_default_detection_params(detection_params_t* params) {
+    if (!params) return;
+    
+    params->scale_factor = 1.1;
+    params->min_neighbors = 3;
+    params->min_size_width = 30;
+    params->min_size_height = 30;
+    params->max_size_width = 0;
+    params->max_size_height = 0;
+    params->do_canny_pruning = false;
+}
+
+// Parse "scale neighbors min_size max_size"; missing fields keep their values.
+// A max_size of 0 means no upper limit.
+int parse_detection_params(const char* text, detection_params_t* params) {
+    if (!text || !params) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    double scale = params->scale_factor;
+    int neighbors = params->min_neighbors;
+    int min_size = params->min_size_width;
+    int max_size = params->max_size_width;
+    
+    int fields = sscanf(text, "%lf %d %d %d", &scale, &neighbors, &min_size, &max_size);
+    if (fields == EOF) {
+        return FMD_SUCCESS;
+    }
+    
+    if (scale <= 1.0 || neighbors < 0 || min_size < 0 || max_size < 0) {
+        log_error("Invalid cascade parameters: %s", text);
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    params->scale_factor = scale;
+    params->min_neighbors = neighbors;
+    params->min_size_width = min_size;
+    params->min_size_height = min_size;
+    params->max_size_width = max_size;
+    params->max_size_height = max_size;
+    return FMD_SUCCESS;
+}
+
+// Parse "path [scale neighbors min_size max_size]"
+int parse_cascade_spec(const char* spec, char* path, size_t path_size, detection_params_t* params) {
+    if (!spec || !path || path_size == 0 || !params) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    while (*spec == ' ' || *spec == '\t') spec++;
+    
+    size_t length = strcspn(spec, " \t");
+    if (length == 0 || length >= path_size) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    memcpy(path, spec, length);
+    path[length] = '\0';
+    
+    return parse_detection_params(spec + length, params);
+}
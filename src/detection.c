@@ -1,211 +1,202 @@
 #include "face_mask_detector.h"
 #include "image_processing.h"
+#include "detection_engine.h"
 
-// Apply temporal smoothing to reduce detection noise
-mask_status_t apply_temporal_smoothing(face_detection_t* face, mask_status_t current_status) {
-    if (!face) return current_status;
-    
-    // Initialize history buffer on first call
-    if (face->history_count == 0) {
-        for (int i = 0; i < 10; i++) {
-            face->mask_history[i] = current_status;
-        }
-        face->history_index = 0;
-        face->history_count = 1;
-        face->stable_status = current_status;
-        face->stable_count = 1;
+// Longest run of identical results that is counted; the thresholds below
+// never look further
+#define SMOOTHING_MAX_RUN 1000
+
+// Shared only to space out the debug log lines
+static int g_smoothing_debug_count = 0;
+
+// Start a face with no history
+void reset_mask_smoothing(mask_smoothing_t* state) {
+    if (!state) return;
+    
+    memset(state, 0, sizeof(mask_smoothing_t));
+    state->locked_status = MASK_STATUS_UNKNOWN;
+    state->previous_result = MASK_STATUS_UNKNOWN;
+    state->stable_status = MASK_STATUS_UNKNOWN;
+}
+
+// Apply temporal smoothing to reduce detection noise. Only the given state
+// is touched, so faces can be smoothed from any thread as long as each
+// state has one owner at a time.
+mask_status_t apply_temporal_smoothing(mask_smoothing_t* state, mask_status_t current_status) {
+    if (!state) return current_status;
+    
+    // Initialize on first call
+    if (!state->initialized) {
+        state->initialized = 1;
+        state->stable_status = (uint8_t)current_status;
+        state->previous_result = (uint8_t)current_status;
+        state->same_result_count = 1;
         return current_status;
     }
     
-    // Status locking to prevent flickering
-    static mask_status_t current_locked_status = MASK_STATUS_UNKNOWN;
-    static int lock_frames_remaining = 0;
-    static int same_result_count = 0;
-    static mask_status_t previous_result = MASK_STATUS_UNKNOWN;
-    
     // Count consecutive identical results
-    if (current_status == previous_result) {
-        same_result_count++;
+    if (current_status == state->previous_result) {
+        if (state->same_result_count < SMOOTHING_MAX_RUN) {
+            state->same_result_count++;
+        }
     } else {
-        same_result_count = 1;
-        previous_result = current_status;
+        state->same_result_count = 1;
+        state->previous_result = (uint8_t)current_status;
     }
     
+    mask_status_t locked_status = (mask_status_t)state->locked_status;
+    
     // Handle status locking logic
-    if (current_locked_status != MASK_STATUS_UNKNOWN) {
-        lock_frames_remaining--;
+    if (locked_status != MASK_STATUS_UNKNOWN) {
+        state->lock_frames_remaining--;
         
-        if (lock_frames_remaining > 0) {
+        if (state->lock_frames_remaining > 0) {
             // Check for special case: faster mask removal
-            if (current_locked_status == MASK_STATUS_WITH_MASK && 
+            if (locked_status == MASK_STATUS_WITH_MASK && 
                 current_status == MASK_STATUS_WITHOUT_MASK && 
-                same_result_count >= 8) {
+                state->same_result_count >= 8) {
                 // Quick transition when removing mask
-                current_locked_status = current_status;
-                lock_frames_remaining = 60;
-                return current_locked_status;
+                state->locked_status = (uint8_t)current_status;
+                state->lock_frames_remaining = 60;
+                return current_status;
             }
-            return current_locked_status;
+            return locked_status;
         } else {
             // Lock has expired, check if we should change
-            if (same_result_count >= 12 && current_status != current_locked_status) {
-                int lock_duration = (current_status == MASK_STATUS_WITH_MASK) ? 90 : 60;
-                current_locked_status = current_status;
-                lock_frames_remaining = lock_duration;
-                return current_locked_status;
-            } else if (same_result_count < 12) {
+            if (state->same_result_count >= 12 && current_status != locked_status) {
+                state->locked_status = (uint8_t)current_status;
+                state->lock_frames_remaining = (current_status == MASK_STATUS_WITH_MASK) ? 90 : 60;
+                return current_status;
+            } else if (state->same_result_count < 12) {
                 // Extend the lock a bit more
-                lock_frames_remaining = 20;
-                return current_locked_status;
+                state->lock_frames_remaining = 20;
+                return locked_status;
             }
         }
     } else {
         // No active lock, establish one if we have consistent results
-        if (same_result_count >= 5) {
-            int lock_duration = (current_status == MASK_STATUS_WITH_MASK) ? 90 : 60;
-            current_locked_status = current_status;
-            lock_frames_remaining = lock_duration;
-            return current_locked_status;
+        if (state->same_result_count >= 5) {
+            state->locked_status = (uint8_t)current_status;
+            state->lock_frames_remaining = (current_status == MASK_STATUS_WITH_MASK) ? 90 : 60;
+            return current_status;
         }
     }
     
     // Debug output every second or so
-    static int debug_frame_count = 0;
-    if (++debug_frame_count % 30 == 0) {
+    if (__sync_add_and_fetch(&g_smoothing_debug_count, 1) % 30 == 0) {
         log_info("Detection status: %s (count: %d)", 
                 current_status == MASK_STATUS_WITH_MASK ? "MASK" : 
                 current_status == MASK_STATUS_WITHOUT_MASK ? "NO-MASK" : "UNKNOWN", 
-                same_result_count);
-        if (current_locked_status != MASK_STATUS_UNKNOWN) {
+                state->same_result_count);
+        if (state->locked_status != MASK_STATUS_UNKNOWN) {
             log_info("Locked to: %s, frames left: %d", 
-                    current_locked_status == MASK_STATUS_WITH_MASK ? "MASK" : "NO-MASK", 
-                    lock_frames_remaining);
+                    state->locked_status == MASK_STATUS_WITH_MASK ? "MASK" : "NO-MASK", 
+                    state->lock_frames_remaining);
         }
     }
     
     // Fallback: if no lock is active and not enough consistency, use previous stable status
     // or default to current input if we don't have a better option
-    if (face->stable_status != MASK_STATUS_UNKNOWN) {
-        return face->stable_status;
+    if (state->stable_status != MASK_STATUS_UNKNOWN) {
+        return (mask_status_t)state->stable_status;
     }
     
     return current_status;
 }
 
-// Detect faces using Haar cascade
+// Create the detection engine for a state: cascade chain plus optional mask network
+int load_detection_models(app_state_t* state, const app_config_t* config) {
+    if (!state || !config) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    model_config_t face_config;
+    set_default_model_config(&face_config, MODEL_TYPE_HAAR_CASCADE);
+    strncpy(face_config.model_path, config->cascade_path, MAX_PATH_LENGTH - 1);
+    
+    model_config_t mask_config;
+    set_default_model_config(&mask_config, MODEL_TYPE_DNN_ONNX);
+    strncpy(mask_config.model_path, config->model_path, MAX_PATH_LENGTH - 1);
+    mask_config.backend = config->use_gpu ? DETECTION_BACKEND_CUDA : DETECTION_BACKEND_CPU;
+    
+    // The quantized model is used when present, the float one otherwise
+    if (config->model_precision == MODEL_PRECISION_INT8) {
+        if (is_model_file_valid(config->int8_model_path)) {
+            strncpy(mask_config.model_path, config->int8_model_path, MAX_PATH_LENGTH - 1);
+            mask_config.precision = MODEL_PRECISION_INT8;
+        } else {
+            log_warning("INT8 mask model not found: %s. Using %s", config->int8_model_path, config->model_path);
+        }
+    }
+    
+    detection_engine_t* engine = new detection_engine_t();
+    int result = init_detection_engine(engine, &face_config, &mask_config);
+    if (result != FMD_SUCCESS) {
+        cleanup_detection_engine(engine);
+        delete engine;
+        return result;
+    }
+    
+    // Primary cascade parameters
+    detection_params_t params = engine->face_detection_params;
+    if (parse_detection_params(config->cascade_params, &params) == FMD_SUCCESS) {
+        set_face_detection_params(engine, &params);
+    }
+    
+    // Fallback chain, loaded once; detection never touches the disk
+    for (int i = 0; i < config->fallback_cascade_count; i++) {
+        char path[MAX_PATH_LENGTH];
+        set_default_detection_params(&params);
+        if (parse_cascade_spec(config->fallback_cascades[i], path, sizeof(path), &params) != FMD_SUCCESS) {
+            log_warning("Ignoring invalid fallback cascade: %s", config->fallback_cascades[i]);
+            continue;
+        }
+        cascade_registry_add(&engine->cascades, path, &params, 0);
+    }
+    
+    engine->detection_interval = config->detection_interval;
+    if (config->mask_batch_size > 0) {
+        set_mask_batch_size(engine, config->mask_batch_size);
+    }
+    engine->roi_search = config->roi_search;
+    engine->full_sweep_interval = config->full_sweep_interval;
+    engine->adaptive_scale = config->adaptive_scale;
+    engine->detection_size = config->detection_size;
+    engine->verify_detections = config->verify_detections;
+    engine->mask_cache_age = config->mask_cache_age;
+    set_mask_policy(engine, config->mask_policy, config->escalation_margin);
+    
+    // First forward passes are slow; take them before the stream starts
+    warm_up_mask_network(engine);
+    if (set_face_threads(engine, config->face_threads) != FMD_SUCCESS) {
+        log_warning("Classifying faces on one thread");
+    }
+    
+    state->engine = engine;
+    return FMD_SUCCESS;
+}
+
+// Release a state's detection engine
+void unload_detection_models(app_state_t* state) {
+    if (!state || !state->engine) return;
+    
+    cleanup_detection_engine(state->engine);
+    delete state->engine;
+    state->engine = NULL;
+}
+
+// Detect faces and classify masks through the state's detection engine
 int detect_faces(app_state_t* state, const cv::Mat& frame, face_detection_t* faces, int max_faces) {
-    if (!state || frame.empty() || !faces || max_faces <= 0) {
+    if (!state || !state->engine || frame.empty() || !faces || max_faces <= 0) {
         return 0;
     }
     
-    try {
-        cv::Mat gray;
-        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-        
-        // Apply histogram equalization for better detection
-        cv::equalizeHist(gray, gray);
-        
-        std::vector<cv::Rect> face_rects;
-        
-        // Primary detection - optimized for glasses
-        state->face_cascade.detectMultiScale(
-            gray,
-            face_rects,
-            1.05,   // fine-grained scaling
-            2,      // less strict neighbor requirement
-            cv::CASCADE_SCALE_IMAGE,
-            cv::Size(24, 24), 
-            cv::Size(300, 300)
-        );
-        
-        // Try backup cascade if nothing found
-        if (face_rects.empty()) {
-            cv::CascadeClassifier backup_cascade;
-            if (backup_cascade.load("models/haarcascade_frontalface_default.xml")) {
-                backup_cascade.detectMultiScale(
-                    gray,
-                    face_rects,
-                    1.1,
-                    3,
-                    0,
-                    cv::Size(30, 30)
-                );
-            }
-        }
-        
-        // Last resort - try LBP based detection
-        if (face_rects.empty()) {
-            cv::CascadeClassifier lbp_detector;
-            if (lbp_detector.load("models/lbpcascade_frontalface_improved.xml")) {
-                lbp_detector.detectMultiScale(
-                    gray,
-                    face_rects,
-                    1.1,
-                    2,
-                    0,
-                    cv::Size(20, 20)
-                );
-            }
-        }
-        
-        int count = std::min((int)face_rects.size(), max_faces);
-        
-        // Debug face detection with cascade info
-        static int face_debug_counter = 0;
-        static int last_face_count = -1;
-        
-        if (++face_debug_counter % 30 == 0 || (int)face_rects.size() != last_face_count) {
-            log_info("*** FACE DETECTION DEBUG ***");
-            log_info("Detected %d faces (max=%d)", (int)face_rects.size(), max_faces);
-            
-            if (face_rects.size() == 0) {
-                log_info("NO FACES DETECTED - Tried multiple cascades");
-                log_info("TROUBLESHOOTING:");
-                log_info("- Remove glasses temporarily to test");
-                log_info("- Ensure good lighting");
-                log_info("- Face camera directly");
-                log_info("- Move closer/farther from camera");
-            } else {
-                log_info("SUCCESS: Face detection working");
-                for (size_t i = 0; i < face_rects.size() && i < 3; i++) {
-                    log_info("Face %zu: x=%d y=%d w=%d h=%d", i, face_rects[i].x, face_rects[i].y, face_rects[i].width, face_rects[i].height);
-                }
-            }
-            log_info("**************************");
-            last_face_count = (int)face_rects.size();
-        }
-        
-        for (int i = 0; i < count; i++) {
-            faces[i].x = face_rects[i].x;
-            faces[i].y = face_rects[i].y;
-            faces[i].width = face_rects[i].width;
-            faces[i].height = face_rects[i].height;
-            faces[i].confidence = 1.0f; // Haar cascade doesn't provide confidence
-            
-            // Classify mask status for each face
-            mask_status_t raw_mask_status = MASK_STATUS_UNKNOWN;
-            float mask_confidence = 0.0f;
-            
-            if (!state->mask_net.empty()) {
-                classify_mask(state, frame, &faces[i], &raw_mask_status, &mask_confidence);
-            } else {
-                // Simple reliable classification when no ML model is available
-                raw_mask_status = classify_mask_simple_reliable(frame, &faces[i]);
-                mask_confidence = 0.80f; // Good confidence for simple reliable method
-            }
-            
-            // Apply temporal smoothing to prevent flickering
-            mask_status_t smooth_status = apply_temporal_smoothing(&faces[i], raw_mask_status);
-            
-            faces[i].mask_status = smooth_status;
-            faces[i].mask_confidence = mask_confidence;
-        }
-        
-        return count;
-    } catch (const cv::Exception& e) {
-        log_error("OpenCV exception in face detection: %s", e.what());
+    int count = 0;
+    if (detect_faces_in_frame(state->engine, frame, faces, max_faces, &count) != FMD_SUCCESS) {
         return 0;
     }
+    
+    return count;
 }
 
 // Classify mask status using ML model
@@ -218,58 +209,91 @@ int classify_mask(app_state_t* state, const cv::Mat& frame, const face_detection
     *status = MASK_STATUS_UNKNOWN;
     *confidence = 0.0f;
     
-    if (state->mask_net.empty()) {
+    if (!state->engine || state->engine->mask_network.empty()) {
         log_warning("Mask classification model not loaded");
         return FMD_ERROR_MODEL_LOAD;
     }
     
-    try {
-        // Extract face region
-        cv::Mat face_roi;
-        int result = crop_face_region(frame, face_roi, face, 10, 224);
-        if (result != FMD_SUCCESS) {
-            return result;
-        }
-        
-        // Create blob for DNN
-        cv::Mat blob;
-        cv::dnn::blobFromImage(face_roi, blob, 1.0/255.0, cv::Size(224, 224), 
-                              cv::Scalar(0.485, 0.456, 0.406), true, false, CV_32F);
-        
-        // Set input to the network
-        state->mask_net.setInput(blob);
-        
-        // Run inference
-        cv::Mat output = state->mask_net.forward();
-        
-        // Parse output (assuming binary classification: mask/no-mask)
-        if (output.total() >= 2) {
-            float* data = (float*)output.data;
-            float no_mask_conf = data[0];
-            float mask_conf = data[1];
-            
-            if (mask_conf > no_mask_conf) {
-                *status = MASK_STATUS_WITH_MASK;
-                *confidence = mask_conf;
-            } else {
-                *status = MASK_STATUS_WITHOUT_MASK;
-                *confidence = no_mask_conf;
-            }
-        } else {
-            log_error("Unexpected output format from mask classification model");
-            return FMD_ERROR_PROCESSING;
-        }
-        
-        return FMD_SUCCESS;
-    } catch (const cv::Exception& e) {
-        log_error("OpenCV exception in mask classification: %s", e.what());
-        return FMD_ERROR_PROCESSING;
-    }
+    return classify_mask_status(state->engine, frame, face, status, confidence);
 }
 
 // Improved heuristic-based mask classification (fallback when no ML model)
 mask_status_t classify_mask_heuristic(const cv::Mat& frame, const face_detection_t* face) {
-    if (frame.empty() || !face) {
+    feature_plane_t plane;
+    plane.valid = false;
+    plane.builds = 0;
+    return classify_mask_heuristic_plane(frame, face, &plane, NULL);
+}
+
+// Balanced decision making for proper mask detection
+static mask_status_t decide_heuristic_status(int mask_score, int no_mask_score, double skin_ratio) {
+    double non_skin_ratio = 1.0 - skin_ratio;
+    
+    // Strong no-mask indicators first (prevent false positives)
+    if (skin_ratio > 0.8 && no_mask_score >= 6) {
+        return MASK_STATUS_WITHOUT_MASK;
+    }
+    
+    // Strong mask indicators
+    if (non_skin_ratio > 0.5) {
+        return MASK_STATUS_WITH_MASK;
+    }
+    
+    // Good mask evidence
+    if (mask_score >= 5 && non_skin_ratio > 0.3) {
+        return MASK_STATUS_WITH_MASK;
+    }
+    
+    // Clear no-mask detection
+    if (no_mask_score >= 5 && skin_ratio > 0.75) {
+        return MASK_STATUS_WITHOUT_MASK;
+    }
+    
+    // Moderate mask evidence
+    if (mask_score >= 4) {
+        return MASK_STATUS_WITH_MASK;
+    }
+    
+    // Compare scores
+    if (mask_score > no_mask_score + 1) {
+        return MASK_STATUS_WITH_MASK;
+    } else if (no_mask_score > mask_score + 2) {
+        return MASK_STATUS_WITHOUT_MASK;
+    } else {
+        // Close call - use skin ratio as tie-breaker
+        return skin_ratio > 0.7 ? MASK_STATUS_WITHOUT_MASK : MASK_STATUS_WITH_MASK;
+    }
+}
+
+// How sure a decision is: the smallest change to one score (in points) or to
+// the skin ratio (in HEURISTIC_RATIO_STEP steps) that flips it, with one step
+// giving 0 and HEURISTIC_MARGIN_POINTS + 1 or more giving 1
+static float heuristic_decision_margin(int mask_score, int no_mask_score, double skin_ratio) {
+    mask_status_t decision = decide_heuristic_status(mask_score, no_mask_score, skin_ratio);
+    for (int points = 1; points <= HEURISTIC_MARGIN_POINTS; points++) {
+        double shift = points * HEURISTIC_RATIO_STEP;
+        bool flips = decide_heuristic_status(mask_score + points, no_mask_score, skin_ratio) != decision ||
+                     decide_heuristic_status(mask_score - points, no_mask_score, skin_ratio) != decision ||
+                     decide_heuristic_status(mask_score, no_mask_score + points, skin_ratio) != decision ||
+                     decide_heuristic_status(mask_score, no_mask_score - points, skin_ratio) != decision ||
+                     decide_heuristic_status(mask_score, no_mask_score, skin_ratio + shift) != decision ||
+                     decide_heuristic_status(mask_score, no_mask_score, skin_ratio - shift) != decision;
+        if (flips) {
+            return (float)(points - 1) / HEURISTIC_MARGIN_POINTS;
+        }
+    }
+    return 1.0f;
+}
+
+// Same classification with the region statistics read from a feature plane.
+// The plane is rebuilt over this face alone when it does not cover it. The
+// margin is the distance to the rule that decided, see heuristic_decision_margin.
+mask_status_t classify_mask_heuristic_plane(const cv::Mat& frame, const face_detection_t* face, feature_plane_t* plane,
+                                            float* margin) {
+    if (margin) {
+        *margin = 0.0f;
+    }
+    if (frame.empty() || !face || !plane) {
         return MASK_STATUS_UNKNOWN;
     }
     
@@ -283,52 +307,30 @@ mask_status_t classify_mask_heuristic(const cv::Mat& frame, const face_detection
             return MASK_STATUS_UNKNOWN;
         }
         
-        cv::Mat face_roi = frame(face_rect);
-        
-        // Convert to different color spaces for analysis
-        cv::Mat hsv, gray;
-        cv::cvtColor(face_roi, hsv, cv::COLOR_BGR2HSV);
-        cv::cvtColor(face_roi, gray, cv::COLOR_BGR2GRAY);
-        
-        // Define regions for analysis - focus more on mouth area for proper mask detection
-        int mouth_y = face_roi.rows * 0.65;  // Lower part of face (mainly mouth area)
-        int mouth_height = face_roi.rows * 0.25;  // Smaller region focused on mouth
-        
-        cv::Rect mouth_nose_rect(face_roi.cols * 0.2, mouth_y, 
-                                face_roi.cols * 0.6, mouth_height);
-        mouth_nose_rect &= cv::Rect(0, 0, face_roi.cols, face_roi.rows);
-        
-        cv::Mat mouth_nose_hsv = hsv(mouth_nose_rect);
-        cv::Mat mouth_nose_gray = gray(mouth_nose_rect);
-        
-        // Calculate various features
-        cv::Scalar mean_hsv = cv::mean(mouth_nose_hsv);
-        cv::Scalar mean_gray = cv::mean(mouth_nose_gray);
+        // Focus on the mouth area for proper mask detection
+        cv::Rect mouth_nose_rect = get_mouth_region(face_rect);
+        if (!feature_plane_covers(plane, mouth_nose_rect) &&
+            build_feature_plane(frame, mouth_nose_rect, plane) != FMD_SUCCESS) {
+            return MASK_STATUS_UNKNOWN;
+        }
         
-        // Calculate standard deviation for texture analysis
-        cv::Scalar stddev_gray;
-        cv::meanStdDev(mouth_nose_gray, cv::Scalar(), stddev_gray);
+        // Calculate various features from the plane's integral images
+        roi_features_t features;
+        if (feature_plane_stats(plane, mouth_nose_rect, &features) != FMD_SUCCESS) {
+            return MASK_STATUS_UNKNOWN;
+        }
         
         // Feature extraction
-        double hue = mean_hsv[0];
-        double saturation = mean_hsv[1];
-        double value = mean_hsv[2];
-        double brightness = mean_gray[0];
-        double texture = stddev_gray[0];
+        double hue = features.hue_mean;
+        double saturation = features.saturation_mean;
+        double value = features.value_mean;
+        double brightness = features.gray_mean;
+        double texture = features.gray_std;
         
         // Additional analysis for proper mask detection
         // Check for mixed regions (skin + mask) which indicates proper mask wearing
-        cv::Mat skin_mask, non_skin_mask;
-        // More accurate skin detection range - wider hue range, better saturation/value
-        cv::inRange(mouth_nose_hsv, cv::Scalar(0, 30, 50), cv::Scalar(30, 150, 255), skin_mask);
-        cv::bitwise_not(skin_mask, non_skin_mask);
-        
-        int skin_pixels = cv::countNonZero(skin_mask);
-        int non_skin_pixels = cv::countNonZero(non_skin_mask);
-        int total_pixels = mouth_nose_rect.width * mouth_nose_rect.height;
-        
-        double skin_ratio = (double)skin_pixels / total_pixels;
-        double non_skin_ratio = (double)non_skin_pixels / total_pixels;
+        double skin_ratio = features.skin_ratio;
+        double non_skin_ratio = 1.0 - skin_ratio;
         
         // Enhanced mask detection with proper mask analysis
         int mask_score = 0;
@@ -434,10 +436,7 @@ mask_status_t classify_mask_heuristic(const cv::Mat& frame, const face_detection
         }
         
         // Edge analysis - masks often have visible edges
-        cv::Mat edges;
-        cv::Canny(mouth_nose_gray, edges, 30, 100);
-        int edge_pixels = cv::countNonZero(edges);
-        double edge_density = (double)edge_pixels / (mouth_nose_rect.width * mouth_nose_rect.height);
+        double edge_density = feature_plane_edge_density(plane, mouth_nose_rect, PLANE_EDGES_SOFT);
         
         if (edge_density > 0.08) {  // Strong horizontal edges suggest mask boundary
             mask_score += 1;
@@ -445,9 +444,10 @@ mask_status_t classify_mask_heuristic(const cv::Mat& frame, const face_detection
         
         // Decision based on comparative scoring - more accurate than single score
         
-        // Enhanced debug logging for mask detection troubleshooting
+        // Enhanced debug logging for mask detection troubleshooting. Face-pool
+        // threads share the counter, so it is updated atomically.
         static int debug_counter = 0;
-        if (++debug_counter % 15 == 0) {  // Log every 15 frames (twice per second)
+        if (__sync_add_and_fetch(&debug_counter, 1) % 15 == 0) {  // Log every 15 frames (twice per second)
             log_info("=== MASK DETECTION DEBUG ===");
             log_info("H=%.1f S=%.1f V=%.1f B=%.1f T=%.1f", hue, saturation, value, brightness, texture);
             log_info("SkinRatio=%.2f NonSkinRatio=%.2f", skin_ratio, non_skin_ratio);
@@ -461,7 +461,7 @@ mask_status_t classify_mask_heuristic(const cv::Mat& frame, const face_detection
                     saturation < 30 ? "YES" : "NO",
                     texture < 15 ? "YES" : "NO",
                     non_skin_ratio > 0.3 ? "YES" : "NO");
-                    
+            
             // Show the final decision logic
             if (skin_ratio > 0.8 && no_mask_score >= 6) {
                 log_info("DECISION: NO-MASK - High skin ratio (%.2f) + score (%d)", skin_ratio, no_mask_score);
@@ -483,42 +483,10 @@ mask_status_t classify_mask_heuristic(const cv::Mat& frame, const face_detection
             log_info("============================");
         }
         
-        // Balanced decision making for proper mask detection
-        
-        // Strong no-mask indicators first (prevent false positives)
-        if (skin_ratio > 0.8 && no_mask_score >= 6) {
-            return MASK_STATUS_WITHOUT_MASK;
-        }
-        
-        // Strong mask indicators
-        if (non_skin_ratio > 0.5) {
-            return MASK_STATUS_WITH_MASK;
-        }
-        
-        // Good mask evidence
-        if (mask_score >= 5 && non_skin_ratio > 0.3) {
-            return MASK_STATUS_WITH_MASK;
-        }
-        
-        // Clear no-mask detection
-        if (no_mask_score >= 5 && skin_ratio > 0.75) {
-            return MASK_STATUS_WITHOUT_MASK;
-        }
-        
-        // Moderate mask evidence
-        if (mask_score >= 4) {
-            return MASK_STATUS_WITH_MASK;
-        }
-        
-        // Compare scores
-        if (mask_score > no_mask_score + 1) {
-            return MASK_STATUS_WITH_MASK;
-        } else if (no_mask_score > mask_score + 2) {
-            return MASK_STATUS_WITHOUT_MASK;
-        } else {
-            // Close call - use skin ratio as tie-breaker
-            return skin_ratio > 0.7 ? MASK_STATUS_WITHOUT_MASK : MASK_STATUS_WITH_MASK;
+        if (margin) {
+            *margin = heuristic_decision_margin(mask_score, no_mask_score, skin_ratio);
         }
+        return decide_heuristic_status(mask_score, no_mask_score, skin_ratio);
         
     } catch (const cv::Exception& e) {
         log_error("OpenCV exception in heuristic mask classification: %s", e.what());
@@ -614,34 +582,34 @@ int handle_key_input(app_state_t* state, int key) {
         case 27: // ESC
             state->running = false;
             return FMD_SUCCESS;
-            
+        
         case 's':
         case 'S':
             // Toggle save output
             state->config.save_output = !state->config.save_output;
             log_info("Output saving %s", state->config.save_output ? "enabled" : "disabled");
             return FMD_SUCCESS;
-            
+        
         case 'v':
         case 'V':
             // Toggle verbose mode
             state->config.verbose = !state->config.verbose;
             log_info("Verbose mode %s", state->config.verbose ? "enabled" : "disabled");
             return FMD_SUCCESS;
-            
+        
         case 'p':
         case 'P':
             // Pause/unpause
             // Implementation would depend on threading model
             log_info("Pause/unpause requested");
             return FMD_SUCCESS;
-            
+        
         case 'r':
         case 'R':
             // Reset detection parameters
             log_info("Reset detection parameters requested");
             return FMD_SUCCESS;
-            
+        
         default:
             // Unknown key
             return FMD_SUCCESS;
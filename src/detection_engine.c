@@ -0,0 +1,1036 @@
+#include "detection_engine.h"
+#include "face_mask_detector.h"
+#include "image_processing.h"
+
+// Set default model configuration for a model type
+void set_default_model_config(model_config_t* config, model_type_t type) {
+    if (!config) return;
+    
+    memset(config->model_path, 0, sizeof(config->model_path));
+    memset(config->config_path, 0, sizeof(config->config_path));
+    memset(config->classes_path, 0, sizeof(config->classes_path));
+    
+    config->type = type;
+    config->backend = DETECTION_BACKEND_CPU;
+    config->confidence_threshold = DEFAULT_CONFIDENCE_THRESHOLD;
+    config->nms_threshold = DEFAULT_NMS_THRESHOLD;
+    config->precision = MODEL_PRECISION_FP32;
+    
+    if (type == MODEL_TYPE_HAAR_CASCADE) {
+        strncpy(config->model_path, "models/haarcascade_frontalface_alt.xml", MAX_PATH_LENGTH - 1);
+        config->input_width = 0;
+        config->input_height = 0;
+        config->scale_factor = 1.0f;
+        config->mean = cv::Scalar();
+        config->swap_rb = false;
+    } else {
+        // Mask classifier input: 224x224 RGB scaled to [0, 1]
+        strncpy(config->model_path, "models/mask_detector.onnx", MAX_PATH_LENGTH - 1);
+        config->input_width = 224;
+        config->input_height = 224;
+        config->scale_factor = 1.0f / 255.0f;
+        config->mean = cv::Scalar(0.485, 0.456, 0.406);
+        config->swap_rb = true;
+    }
+}
+
+const char* model_type_to_string(model_type_t type) {
+    switch (type) {
+        case MODEL_TYPE_HAAR_CASCADE: return "Haar Cascade";
+        case MODEL_TYPE_DNN_CAFFE: return "Caffe";
+        case MODEL_TYPE_DNN_TENSORFLOW: return "TensorFlow";
+        case MODEL_TYPE_DNN_DARKNET: return "Darknet";
+        case MODEL_TYPE_DNN_ONNX: return "ONNX";
+        default: return "Unknown";
+    }
+}
+
+const char* backend_to_string(detection_backend_t backend) {
+    switch (backend) {
+        case DETECTION_BACKEND_OPENCV: return "OpenCV";
+        case DETECTION_BACKEND_CUDA: return "CUDA";
+        case DETECTION_BACKEND_OPENCL: return "OpenCL";
+        case DETECTION_BACKEND_CPU: return "CPU";
+        default: return "Unknown";
+    }
+}
+
+bool is_model_file_valid(const char* path) {
+    return path && strlen(path) > 0 && access(path, R_OK) == 0;
+}
+
+// Long side, in pixels, to run detection at: the image's own long side
+// capped at max_size (0 or less means full resolution)
+int get_optimal_input_size(int image_width, int image_height, int max_size) {
+    int long_side = std::max(image_width, image_height);
+    if (long_side <= 0) return 0;
+    if (max_size <= 0) return long_side;
+    
+    return std::min(long_side, max_size);
+}
+
+// Validate a model configuration before loading it
+int validate_model_config(const model_config_t* config) {
+    if (!config || strlen(config->model_path) == 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (config->type != MODEL_TYPE_HAAR_CASCADE &&
+        (config->input_width <= 0 || config->input_height <= 0)) {
+        log_error("Invalid model input size: %dx%d", config->input_width, config->input_height);
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    return FMD_SUCCESS;
+}
+
+// Select the DNN backend and target for the mask network
+int set_detection_backend(detection_engine_t* engine, detection_backend_t backend) {
+    if (!engine) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    engine->current_backend = backend;
+    if (engine->mask_network.empty()) {
+        return FMD_SUCCESS;
+    }
+    
+    try {
+        switch (backend) {
+            case DETECTION_BACKEND_CUDA:
+                engine->mask_network.setPreferableBackend(cv::dnn::DNN_BACKEND_CUDA);
+                engine->mask_network.setPreferableTarget(cv::dnn::DNN_TARGET_CUDA);
+                log_info("Using GPU acceleration for mask detection");
+                break;
+            case DETECTION_BACKEND_OPENCL:
+                engine->mask_network.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+                engine->mask_network.setPreferableTarget(cv::dnn::DNN_TARGET_OPENCL);
+                log_info("Using OpenCL for mask detection");
+                break;
+            default:
+                engine->mask_network.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+                engine->mask_network.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+                log_info("Using CPU for mask detection");
+                break;
+        }
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception while setting backend %s: %s", backend_to_string(backend), e.what());
+        return FMD_ERROR_OPENCV_INIT;
+    }
+    
+    return FMD_SUCCESS;
+}
+
+// Update cascade parameters; the primary cascade picks them up immediately
+int set_face_detection_params(detection_engine_t* engine, const detection_params_t* params) {
+    if (!engine || !params) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    engine->face_detection_params = *params;
+    if (engine->cascades.count > 0) {
+        engine->cascades.entries[0].params = *params;
+    }
+    
+    return FMD_SUCCESS;
+}
+
+// Load the primary face cascade
+int load_face_detection_model(detection_engine_t* engine, const model_config_t* config) {
+    if (!engine || validate_model_config(config) != FMD_SUCCESS) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    init_cascade_registry(&engine->cascades);
+    
+    if (cascade_registry_add(&engine->cascades, config->model_path, &engine->face_detection_params,
+                             cv::CASCADE_SCALE_IMAGE) != FMD_SUCCESS) {
+        log_error("Failed to load face cascade from: %s", config->model_path);
+        return FMD_ERROR_MODEL_LOAD;
+    }
+    
+    engine->face_model_config = *config;
+    log_info("Loaded face detection cascade: %s", config->model_path);
+    return FMD_SUCCESS;
+}
+
+// Load the mask classification network; a missing model is not an error
+int load_mask_classification_model(detection_engine_t* engine, const model_config_t* config) {
+    if (!engine || !config) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    engine->mask_model_config = *config;
+    engine->mask_network = cv::dnn::Net();
+    
+    if (strlen(config->model_path) == 0) {
+        log_info("No mask detection model specified. Using heuristic-based detection.");
+        return FMD_SUCCESS;
+    }
+    
+    if (validate_model_config(config) != FMD_SUCCESS) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    try {
+        engine->mask_network = cv::dnn::readNet(config->model_path);
+        if (engine->mask_network.empty()) {
+            log_warning("Failed to load mask detection model: %s. Using heuristic-based detection.", config->model_path);
+            return FMD_ERROR_MODEL_LOAD;
+        }
+    } catch (const cv::Exception& e) {
+        log_warning("OpenCV exception while loading model: %s. Using heuristic-based detection.", e.what());
+        // Clear the network so it will fall back to heuristic detection
+        engine->mask_network = cv::dnn::Net();
+        return FMD_ERROR_MODEL_LOAD;
+    }
+    
+    // OpenCV runs quantized graphs on its own CPU backend only
+    detection_backend_t backend = config->backend;
+    if (config->precision == MODEL_PRECISION_INT8 && backend != DETECTION_BACKEND_CPU) {
+        log_warning("INT8 mask model runs on the CPU; ignoring the %s backend", backend_to_string(backend));
+        backend = DETECTION_BACKEND_CPU;
+    }
+    
+    set_detection_backend(engine, backend);
+    log_info("Loaded mask detection model: %s (%s)", config->model_path, model_precision_to_string(config->precision));
+    return FMD_SUCCESS;
+}
+
+// Size the mask network's input tensor for max_batch_size faces and build
+// the views forward passes use. Only a different batch size or input size
+// allocates; the tensor is not allocated without a network.
+static int prepare_input_tensor(detection_engine_t* engine) {
+    detection_scratch_t* scratch = &engine->scratch;
+    const model_config_t* config = &engine->mask_model_config;
+    if (engine->mask_network.empty() || config->input_width <= 0 || config->input_height <= 0) {
+        return FMD_SUCCESS;
+    }
+    
+    int slots = std::max(1, engine->max_batch_size);
+    if (scratch->blob.dims == 4 && scratch->blob.size[0] == slots &&
+        scratch->blob.size[2] == config->input_height && scratch->blob.size[3] == config->input_width) {
+        return FMD_SUCCESS;
+    }
+    
+    try {
+        int shape[] = {slots, 3, config->input_height, config->input_width};
+        scratch->blob.create(4, shape, CV_32F);
+        scratch->tensor_views.resize(slots);
+        for (int n = 1; n <= slots; n++) {
+            int view_shape[] = {n, 3, config->input_height, config->input_width};
+            scratch->tensor_views[n - 1] = cv::Mat(4, view_shape, CV_32F, scratch->blob.data);
+        }
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception while allocating mask input tensor: %s", e.what());
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    engine->tensor_allocations++;
+    return FMD_SUCCESS;
+}
+
+// Initialize a detection engine and preallocate its scratch buffers
+int init_detection_engine(detection_engine_t* engine, const model_config_t* face_config, const model_config_t* mask_config) {
+    if (!engine || !face_config) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    engine->initialized = false;
+    engine->current_backend = DETECTION_BACKEND_CPU;
+    engine->debug_frame_counter = 0;
+    engine->last_face_count = -1;
+    engine->detection_interval = DEFAULT_DETECTION_INTERVAL;
+    engine->frame_index = 0;
+    engine->keyframes = 0;
+    engine->max_batch_size = DEFAULT_MASK_BATCH_SIZE;
+    engine->batches = 0;
+    engine->batched_faces = 0;
+    engine->tensor_allocations = 0;
+    engine->network_reshapes = 0;
+    engine->last_forward_batch = 0;
+    engine->warmup_time_ms = 0.0;
+    engine->batch_threads = 0;
+    engine->roi_search = false;
+    engine->full_sweep_interval = DEFAULT_FULL_SWEEP_INTERVAL;
+    engine->cascade_scans = 0;
+    engine->full_sweeps = 0;
+    engine->scanned_fraction_sum = 0.0;
+    engine->adaptive_scale = false;
+    engine->adaptive_ready = false;
+    reset_face_size_stats(&engine->face_sizes);
+    engine->detection_size = 0;
+    engine->verify_detections = false;
+    engine->scan_limits_logged = false;
+    engine->mask_cache_age = 0;
+    engine->mask_policy = MASK_POLICY_AUTO;
+    engine->primary_classifier = NULL;
+    engine->fallback_classifier = NULL;
+    engine->escalation_margin = DEFAULT_ESCALATION_MARGIN;
+    engine->candidates_verified = 0;
+    engine->candidates_rejected = 0;
+    set_default_detection_params(&engine->adaptive_params);
+    engine->batch_pool = NULL;
+    engine->face_threads = 1;
+    engine->face_pool = NULL;
+    for (int i = 0; i < MAX_POOL_THREADS; i++) {
+        engine->batch_engines[i] = NULL;
+        engine->face_engines[i] = NULL;
+    }
+    init_face_tracking(engine->tracks, MAX_FACE_TRACKS);
+    set_default_detection_params(&engine->face_detection_params);
+    reset_performance_metrics(engine);
+    
+    int result = load_face_detection_model(engine, face_config);
+    if (result != FMD_SUCCESS) {
+        return result;
+    }
+    
+    model_config_t default_mask_config;
+    if (!mask_config) {
+        set_default_model_config(&default_mask_config, MODEL_TYPE_DNN_ONNX);
+        default_mask_config.model_path[0] = '\0';
+        mask_config = &default_mask_config;
+    }
+    
+    // A mask model that fails to load falls back to the heuristic
+    load_mask_classification_model(engine, mask_config);
+    
+    // Preallocate the fixed-size buffers; the frame-sized gray buffer is
+    // sized by the first frame and reused afterwards
+    detection_scratch_t* scratch = &engine->scratch;
+    scratch->reallocations = 0;
+    scratch->plane.valid = false;
+    scratch->plane.builds = 0;
+    scratch->face_rects.clear();
+    scratch->face_rects.reserve(MAX_FACES * 4);
+    prepare_input_tensor(engine);
+    
+    set_mask_policy(engine, MASK_POLICY_AUTO, DEFAULT_ESCALATION_MARGIN);
+    engine->initialized = true;
+    return FMD_SUCCESS;
+}
+
+// Release engine resources
+void cleanup_detection_engine(detection_engine_t* engine) {
+    if (!engine) return;
+    
+    release_batch_workers(engine);
+    release_face_workers(engine);
+    
+    init_cascade_registry(&engine->cascades);
+    engine->mask_network = cv::dnn::Net();
+    init_face_tracking(engine->tracks, MAX_FACE_TRACKS);
+    
+    detection_scratch_t* scratch = &engine->scratch;
+    scratch->gray.release();
+    scratch->detect_gray.release();
+    std::vector<cv::Rect>().swap(scratch->face_rects);
+    scratch->roi_gray.release();
+    scratch->roi_edges.release();
+    std::vector<cv::Mat>().swap(scratch->tensor_views);
+    scratch->blob.release();
+    scratch->output.release();
+    scratch->motion_small.release();
+    scratch->motion_previous.release();
+    scratch->motion_diff.release();
+    std::vector<std::vector<cv::Point> >().swap(scratch->motion_contours);
+    std::vector<cv::Rect>().swap(scratch->search_regions);
+    std::vector<cv::Rect>().swap(scratch->region_faces);
+    scratch->signature_thumb.release();
+    release_feature_plane(&scratch->plane);
+    
+    engine->initialized = false;
+}
+
+// Forget everything carried from frame to frame (tracks, cadence, motion
+// history) before processing frames that do not follow the previous ones
+void reset_stream_state(detection_engine_t* engine) {
+    if (!engine) return;
+    
+    init_face_tracking(engine->tracks, MAX_FACE_TRACKS);
+    engine->frame_index = 0;
+    engine->scratch.motion_previous.release();
+}
+
+// Equalized gray copy of the frame, shared by the cascade and the tracker
+static void prepare_gray_frame(detection_engine_t* engine, const cv::Mat& frame) {
+    detection_scratch_t* scratch = &engine->scratch;
+    
+    const uchar* gray_data = scratch->gray.data;
+    cv::cvtColor(frame, scratch->gray, cv::COLOR_BGR2GRAY);
+    if (scratch->gray.data != gray_data) {
+        scratch->reallocations++;
+    }
+    
+    // Apply histogram equalization for better detection
+    cv::equalizeHist(scratch->gray, scratch->gray);
+}
+
+// Re-run the primary cascade in a small full-resolution window around each
+// candidate found at reduced resolution. Confirmed candidates take the refined
+// box; unconfirmed ones are dropped.
+static void verify_face_candidates(detection_engine_t* engine, std::vector<cv::Rect>& candidates) {
+    if (engine->cascades.count == 0) return;
+    
+    detection_scratch_t* scratch = &engine->scratch;
+    cascade_entry_t* primary = &engine->cascades.entries[0];
+    const cv::Rect frame_rect(0, 0, scratch->gray.cols, scratch->gray.rows);
+    
+    size_t kept = 0;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const cv::Rect& candidate = candidates[i];
+        int margin_x = candidate.width / 4;
+        int margin_y = candidate.height / 4;
+        cv::Rect window = cv::Rect(candidate.x - margin_x, candidate.y - margin_y,
+                                   candidate.width + 2 * margin_x, candidate.height + 2 * margin_y) & frame_rect;
+        if (window.area() == 0) continue;
+        
+        primary->classifier.detectMultiScale(
+            scratch->gray(window),
+            scratch->region_faces,
+            1.05,
+            primary->params.min_neighbors,
+            primary->flags,
+            cv::Size(candidate.width * 4 / 5, candidate.height * 4 / 5),
+            cv::Size(std::min(window.width, candidate.width * 5 / 4), std::min(window.height, candidate.height * 5 / 4))
+        );
+        
+        // Keep the refined box that overlaps the candidate most
+        int best_overlap = 0;
+        cv::Rect best;
+        for (size_t f = 0; f < scratch->region_faces.size(); f++) {
+            cv::Rect refined = scratch->region_faces[f];
+            refined.x += window.x;
+            refined.y += window.y;
+            int overlap = (refined & candidate).area();
+            if (overlap > best_overlap) {
+                best_overlap = overlap;
+                best = refined;
+            }
+        }
+        
+        if (best_overlap > 0) {
+            candidates[kept++] = best;
+            engine->candidates_verified++;
+        } else {
+            engine->candidates_rejected++;
+        }
+    }
+    candidates.resize(kept);
+}
+
+// Run the cascade chain on the equalized gray frame
+int detect_faces_haar(detection_engine_t* engine, const cv::Mat& frame, face_detection_t* faces, int max_faces, int* count) {
+    if (!engine || !engine->initialized || frame.empty() || !faces || max_faces <= 0 || !count) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    *count = 0;
+    detection_scratch_t* scratch = &engine->scratch;
+    std::vector<cv::Rect>& face_rects = scratch->face_rects;
+    
+    double start_time = get_current_time();
+    prepare_gray_frame(engine, frame);
+    
+    // Coarse-to-fine: scan a downscaled copy when a detection size is set
+    const cv::Mat* scan_gray = &scratch->gray;
+    double scan_scale = 1.0;
+    int scan_size = get_optimal_input_size(frame.cols, frame.rows, engine->detection_size);
+    int long_side = std::max(frame.cols, frame.rows);
+    if (scan_size > 0 && scan_size < long_side) {
+        scan_scale = (double)scan_size / long_side;
+        cv::Size target(std::max(1, cvRound(frame.cols * scan_scale)), std::max(1, cvRound(frame.rows * scan_scale)));
+        const uchar* scan_data = scratch->detect_gray.data;
+        cv::resize(scratch->gray, scratch->detect_gray, target, 0, 0, cv::INTER_AREA);
+        if (scratch->detect_gray.data != scan_data) {
+            scratch->reallocations++;
+        }
+        scan_gray = &scratch->detect_gray;
+        
+        // The cascade window bounds the smallest face a reduced scan can find
+        if (!engine->scan_limits_logged && engine->cascades.count > 0) {
+            const detection_params_t* params = &engine->face_detection_params;
+            cv::Size min_size, max_size;
+            cascade_scan_limits(&engine->cascades.entries[0], scan_scale, &min_size, &max_size);
+            int smallest = cvRound(min_size.width / scan_scale);
+            if (smallest > params->min_size_width) {
+                log_warning("Scanning at %dx%d: faces below %d px are missed (configured minimum %d px)",
+                            scan_gray->cols, scan_gray->rows, smallest, params->min_size_width);
+            } else {
+                log_info("Scanning at %dx%d: faces from %d px", scan_gray->cols, scan_gray->rows, smallest);
+            }
+            engine->scan_limits_logged = true;
+        }
+    }
+    double preprocess_end = get_current_time();
+    
+    // Adaptive pyramid on most scans, the configured one on exploration scans
+    if (engine->adaptive_scale && engine->cascades.count > 0) {
+        if (engine->cascade_scans % ADAPTIVE_UPDATE_INTERVAL == 0) {
+            optimize_haar_parameters(engine, scratch->gray);
+        }
+        bool explore = !engine->adaptive_ready || engine->cascade_scans % ADAPTIVE_EXPLORE_INTERVAL == 0;
+        engine->cascades.entries[0].params = explore ? engine->face_detection_params : engine->adaptive_params;
+    }
+    
+    // Primary cascade first, fallbacks only while nothing has been found.
+    // In search-window mode most scans only cover the regions worth scanning.
+    if (engine->roi_search && build_search_regions(engine, *scan_gray, scan_scale, scratch->search_regions)) {
+        cascade_registry_detect_regions(&engine->cascades, *scan_gray, scan_scale, scratch->search_regions,
+                                        face_rects, scratch->region_faces);
+    } else {
+        cascade_registry_detect(&engine->cascades, *scan_gray, scan_scale, face_rects);
+        engine->full_sweeps++;
+        engine->scanned_fraction_sum += 1.0;
+    }
+    engine->cascade_scans++;
+    
+    // Face sizes are learned in frame coordinates, like the configured limits
+    if (engine->adaptive_scale) {
+        for (size_t i = 0; i < face_rects.size(); i++) {
+            record_face_size(&engine->face_sizes, cvRound(face_rects[i].width / scan_scale));
+        }
+    }
+    
+    if (scan_scale < 1.0) {
+        for (size_t i = 0; i < face_rects.size(); i++) {
+            cv::Rect& rect = face_rects[i];
+            rect = cv::Rect(cvRound(rect.x / scan_scale), cvRound(rect.y / scan_scale),
+                            cvRound(rect.width / scan_scale), cvRound(rect.height / scan_scale)) &
+                   cv::Rect(0, 0, frame.cols, frame.rows);
+        }
+        if (engine->verify_detections) {
+            verify_face_candidates(engine, face_rects);
+        }
+    }
+    double detect_end = get_current_time();
+    
+    engine->metrics.preprocessing_time_ms = (preprocess_end - start_time) * 1000.0;
+    engine->metrics.detection_time_ms = (detect_end - preprocess_end) * 1000.0;
+    
+    // Debug face detection with cascade info
+    if (++engine->debug_frame_counter % 30 == 0 || (int)face_rects.size() != engine->last_face_count) {
+        log_info("*** FACE DETECTION DEBUG ***");
+        log_info("Detected %d faces (max=%d)", (int)face_rects.size(), max_faces);
+        
+        if (face_rects.size() == 0) {
+            log_info("NO FACES DETECTED - Tried multiple cascades");
+            log_info("TROUBLESHOOTING:");
+            log_info("- Remove glasses temporarily to test");
+            log_info("- Ensure good lighting");
+            log_info("- Face camera directly");
+            log_info("- Move closer/farther from camera");
+        } else {
+            log_info("SUCCESS: Face detection working");
+            for (size_t i = 0; i < face_rects.size() && i < 3; i++) {
+                log_info("Face %zu: x=%d y=%d w=%d h=%d", i, face_rects[i].x, face_rects[i].y, face_rects[i].width, face_rects[i].height);
+            }
+        }
+        log_info("**************************");
+        engine->last_face_count = (int)face_rects.size();
+    }
+    
+    int detected = std::min((int)face_rects.size(), max_faces);
+    for (int i = 0; i < detected; i++) {
+        faces[i].x = face_rects[i].x;
+        faces[i].y = face_rects[i].y;
+        faces[i].width = face_rects[i].width;
+        faces[i].height = face_rects[i].height;
+        faces[i].confidence = 1.0f; // Haar cascade doesn't provide confidence
+    }
+    
+    *count = detected;
+    return FMD_SUCCESS;
+}
+
+// Convert a face crop into a network input blob
+int preprocess_for_dnn(const cv::Mat& input, cv::Mat& blob, const model_config_t* config) {
+    if (input.empty() || !config) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    try {
+        cv::dnn::blobFromImage(input, blob, config->scale_factor,
+                               cv::Size(config->input_width, config->input_height),
+                               config->mean, config->swap_rb, false, CV_32F);
+        return FMD_SUCCESS;
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception while preparing DNN input: %s", e.what());
+        return FMD_ERROR_PROCESSING;
+    }
+}
+
+// Decode one row of classifier scores: [no_mask, mask]
+static void decode_mask_scores(const float* scores, mask_status_t* status, float* confidence) {
+    float no_mask_conf = scores[0];
+    float mask_conf = scores[1];
+    
+    if (mask_conf > no_mask_conf) {
+        *status = MASK_STATUS_WITH_MASK;
+        *confidence = mask_conf;
+    } else {
+        *status = MASK_STATUS_WITHOUT_MASK;
+        *confidence = no_mask_conf;
+    }
+}
+
+// Run the mask network on the first batch_count slots of the input tensor
+static void forward_mask_network(detection_engine_t* engine, int batch_count) {
+    if (batch_count != engine->last_forward_batch) {
+        engine->network_reshapes++;
+        engine->last_forward_batch = batch_count;
+    }
+    engine->mask_network.setInput(engine->scratch.tensor_views[batch_count - 1]);
+    engine->mask_network.forward(engine->scratch.output);
+}
+
+// Run the mask network once at every batch size classification can use,
+// so that graph setup, weight packing and backend initialization happen
+// here instead of stalling the first frames of the stream
+int warm_up_mask_network(detection_engine_t* engine) {
+    if (!engine) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (engine->mask_network.empty()) {
+        return FMD_SUCCESS;
+    }
+    
+    int result = prepare_input_tensor(engine);
+    if (result != FMD_SUCCESS || engine->scratch.blob.empty()) {
+        return result != FMD_SUCCESS ? result : FMD_ERROR_INVALID_ARGS;
+    }
+    
+    double start = get_current_time();
+    int slots = engine->scratch.blob.size[0];
+    try {
+        engine->scratch.blob.setTo(cv::Scalar(0));
+        for (int n = 1; n <= slots; n++) {
+            forward_mask_network(engine, n);
+        }
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception while warming up mask network: %s", e.what());
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    // Reshapes are counted from the steady state on
+    engine->network_reshapes = 0;
+    engine->warmup_time_ms = (get_current_time() - start) * 1000.0;
+    log_info("Mask network warmed up at batch sizes 1-%d in %.1f ms", slots, engine->warmup_time_ms);
+    return FMD_SUCCESS;
+}
+
+// Classify a prepared face crop with the mask network
+int run_mask_classification_dnn(detection_engine_t* engine, const cv::Mat& face_roi, mask_status_t* status, float* confidence) {
+    if (!engine || !status || !confidence) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    *status = MASK_STATUS_UNKNOWN;
+    *confidence = 0.0f;
+    
+    if (engine->mask_network.empty()) {
+        log_warning("Mask classification model not loaded");
+        return FMD_ERROR_MODEL_LOAD;
+    }
+    
+    int result = prepare_input_tensor(engine);
+    if (result != FMD_SUCCESS) {
+        return result;
+    }
+    
+    try {
+        detection_scratch_t* scratch = &engine->scratch;
+        const model_config_t* config = &engine->mask_model_config;
+        
+        // Crops from crop_face_region_sized already have the input size;
+        // anything else is converted first
+        cv::Mat input = face_roi;
+        if (input.type() != CV_8UC3) {
+            cv::Mat converted;
+            cv::cvtColor(input, converted, input.channels() == 4 ? cv::COLOR_BGRA2BGR : cv::COLOR_GRAY2BGR);
+            input = converted;
+        }
+        if (input.cols != config->input_width || input.rows != config->input_height) {
+            cv::Mat resized;
+            cv::resize(input, resized, cv::Size(config->input_width, config->input_height));
+            input = resized;
+        }
+        
+        result = write_tensor_slot(input, scratch->blob, 0, config->scale_factor, config->mean, config->swap_rb);
+        if (result != FMD_SUCCESS) {
+            return result;
+        }
+        
+        forward_mask_network(engine, 1);
+        
+        // Parse output (assuming binary classification: mask/no-mask)
+        if (scratch->output.total() >= 2) {
+            decode_mask_scores((const float*)scratch->output.data, status, confidence);
+        } else {
+            log_error("Unexpected output format from mask classification model");
+            return FMD_ERROR_PROCESSING;
+        }
+        
+        return FMD_SUCCESS;
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception in mask classification: %s", e.what());
+        return FMD_ERROR_PROCESSING;
+    }
+}
+
+// Classify every face of an 8-bit BGR frame with as few forward passes as
+// possible. Crops are packed into one NCHW blob of up to max_batch_size
+// faces; row i of the output belongs to the i-th face cropped successfully.
+int classify_mask_batch_dnn(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* faces, int count,
+                           mask_status_t* statuses, float* confidences) {
+    if (!engine || frame.empty() || (!faces && count > 0) || !statuses || !confidences) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (engine->mask_network.empty()) {
+        return FMD_ERROR_MODEL_LOAD;
+    }
+    
+    if (prepare_input_tensor(engine) != FMD_SUCCESS || engine->scratch.blob.empty()) {
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    count = std::min(count, MAX_FACES);
+    detection_scratch_t* scratch = &engine->scratch;
+    const model_config_t* config = &engine->mask_model_config;
+    int batch_limit = scratch->blob.size[0];
+    
+    for (int i = 0; i < count; i++) {
+        statuses[i] = MASK_STATUS_UNKNOWN;
+        confidences[i] = 0.0f;
+    }
+    
+    try {
+        for (int start = 0; start < count; start += batch_limit) {
+            int end = std::min(count, start + batch_limit);
+            int face_index[MAX_FACES];
+            int batch_count = 0;
+            
+            // Each face is read from the frame and lands normalized in its
+            // slot of the tensor, without intermediate images
+            for (int i = start; i < end; i++) {
+                if (crop_face_into_tensor(frame, &faces[i], 10, scratch->blob, batch_count, config->scale_factor,
+                                          config->mean, config->swap_rb) != FMD_SUCCESS) {
+                    continue;
+                }
+                face_index[batch_count++] = i;
+            }
+            
+            if (batch_count == 0) continue;
+            
+            forward_mask_network(engine, batch_count);
+            engine->batches++;
+            engine->batched_faces += batch_count;
+            
+            if (scratch->output.total() < (size_t)batch_count * 2) {
+                log_error("Unexpected output format from mask classification model");
+                return FMD_ERROR_PROCESSING;
+            }
+            
+            int row_size = (int)(scratch->output.total() / batch_count);
+            const float* data = (const float*)scratch->output.data;
+            for (int b = 0; b < batch_count; b++) {
+                int i = face_index[b];
+                decode_mask_scores(data + b * row_size, &statuses[i], &confidences[i]);
+            }
+        }
+        
+        return FMD_SUCCESS;
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception in batched mask classification: %s", e.what());
+        return FMD_ERROR_PROCESSING;
+    }
+}
+
+// Limit how many faces share one forward pass
+int set_mask_batch_size(detection_engine_t* engine, int batch_size) {
+    if (!engine || batch_size < 1) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    engine->max_batch_size = std::min(batch_size, MAX_FACES);
+    return prepare_input_tensor(engine);
+}
+
+// Classify one face under the engine's classifier policy
+int classify_mask_status(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* face,
+                        mask_status_t* status, float* confidence) {
+    if (!engine || frame.empty() || !face || !status || !confidence) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    *status = MASK_STATUS_UNKNOWN;
+    *confidence = 0.0f;
+    return classify_faces(engine, frame, face, 1, status, confidence);
+}
+
+// Detect, classify and smooth all faces in a frame
+int detect_faces_in_frame(detection_engine_t* engine, const cv::Mat& frame, face_detection_t* faces, int max_faces, int* count) {
+    if (!engine || !engine->initialized || frame.empty() || !faces || max_faces <= 0 || !count) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    *count = 0;
+    
+    try {
+        double now = get_current_time();
+        bool keyframe = engine->detection_interval <= 1 ||
+                        engine->frame_index % (uint64_t)engine->detection_interval == 0;
+        engine->frame_index++;
+        
+        if (keyframe) {
+            int result = detect_faces_haar(engine, frame, faces, max_faces, count);
+            if (result != FMD_SUCCESS) {
+                return result;
+            }
+            
+            update_face_tracks(engine->tracks, MAX_FACE_TRACKS, faces, *count, now);
+            for (int i = 0; i < *count; i++) {
+                face_track_t* track = find_face_track(engine->tracks, MAX_FACE_TRACKS, faces[i].track_id);
+                if (track) {
+                    capture_track_appearance(track, engine->scratch.gray);
+                }
+            }
+            engine->keyframes++;
+        } else {
+            // Between keyframes only the known faces are followed
+            prepare_gray_frame(engine, frame);
+            double preprocess_end = get_current_time();
+            
+            for (int t = 0; t < MAX_FACE_TRACKS && *count < max_faces; t++) {
+                face_track_t* track = &engine->tracks[t];
+                if (!track->active || !track->visible) continue;
+                
+                if (!follow_face_track(track, engine->scratch.gray)) {
+                    // Lost until the next keyframe confirms or retires it
+                    track->visible = false;
+                    continue;
+                }
+                
+                face_detection_t* face = &faces[(*count)++];
+                face->x = track->last_detection.x;
+                face->y = track->last_detection.y;
+                face->width = track->last_detection.width;
+                face->height = track->last_detection.height;
+                face->confidence = track->last_detection.confidence;
+                face->track_id = track->track_id;
+            }
+            
+            engine->metrics.preprocessing_time_ms = (preprocess_end - now) * 1000.0;
+            engine->metrics.detection_time_ms = (get_current_time() - preprocess_end) * 1000.0;
+        }
+        double detect_end = get_current_time();
+        
+        int masked = 0;
+        int unmasked = 0;
+        double confidence_sum = 0.0;
+        
+        // Tracked faces that still look the same keep their last result;
+        // only the others are classified
+        mask_status_t raw_statuses[MAX_FACES];
+        float raw_confidences[MAX_FACES];
+        face_track_t* face_tracks[MAX_FACES];
+        uint8_t signatures[MAX_FACES][MASK_SIGNATURE_PIXELS];
+        bool has_signature[MAX_FACES];
+        bool from_cache[MAX_FACES];
+        face_detection_t pending_faces[MAX_FACES];
+        int pending_slots[MAX_FACES];
+        int pending = 0;
+        
+        for (int i = 0; i < *count; i++) {
+            face_tracks[i] = find_face_track(engine->tracks, MAX_FACE_TRACKS, faces[i].track_id);
+            has_signature[i] = false;
+            from_cache[i] = false;
+            
+            if (engine->mask_cache_age > 0 && face_tracks[i]) {
+                engine->metrics.cache_lookups++;
+                has_signature[i] = compute_mask_signature(frame, &faces[i], engine->scratch.signature_thumb, signatures[i]);
+                from_cache[i] = has_signature[i] &&
+                                lookup_mask_cache(face_tracks[i], signatures[i], engine->mask_cache_age,
+                                                  &raw_statuses[i], &raw_confidences[i]);
+                if (from_cache[i]) {
+                    engine->metrics.cache_hits++;
+                }
+            }
+            
+            if (!from_cache[i]) {
+                pending_faces[pending] = faces[i];
+                pending_slots[pending++] = i;
+            }
+        }
+        
+        // The remaining faces go through the classifier policy together
+        if (pending > 0) {
+            mask_status_t pending_statuses[MAX_FACES];
+            float pending_confidences[MAX_FACES];
+            if (classify_faces(engine, frame, pending_faces, pending, pending_statuses, pending_confidences) != FMD_SUCCESS) {
+                for (int p = 0; p < pending; p++) {
+                    pending_statuses[p] = MASK_STATUS_UNKNOWN;
+                    pending_confidences[p] = 0.0f;
+                }
+            }
+            for (int p = 0; p < pending; p++) {
+                raw_statuses[pending_slots[p]] = pending_statuses[p];
+                raw_confidences[pending_slots[p]] = pending_confidences[p];
+            }
+        }
+        
+        for (int i = 0; i < *count; i++) {
+            face_track_t* track = face_tracks[i];
+            
+            mask_status_t raw_mask_status = raw_statuses[i];
+            float mask_confidence = raw_confidences[i];
+            if (has_signature[i] && !from_cache[i]) {
+                store_mask_cache(track, signatures[i], raw_mask_status, mask_confidence);
+            }
+            
+            // Apply temporal smoothing to prevent flickering. The state lives
+            // with the track; an untracked face has no history to smooth with.
+            mask_status_t smooth_status = raw_mask_status;
+            if (track) {
+                smooth_status = apply_temporal_smoothing(&track->smoothing, raw_mask_status);
+            }
+            
+            faces[i].mask_status = smooth_status;
+            faces[i].mask_confidence = mask_confidence;
+            confidence_sum += mask_confidence;
+            
+            if (track) {
+                track->last_detection = faces[i];
+                track->stable_mask_status = smooth_status;
+            }
+            
+            if (smooth_status == MASK_STATUS_WITH_MASK) {
+                masked++;
+            } else if (smooth_status == MASK_STATUS_WITHOUT_MASK) {
+                unmasked++;
+            }
+        }
+        double classify_end = get_current_time();
+        
+        engine->metrics.inference_time_ms = (classify_end - detect_end) * 1000.0;
+        if (*count > 0) {
+            uint64_t previous_faces = engine->metrics.faces_detected;
+            engine->metrics.average_confidence =
+                (engine->metrics.average_confidence * previous_faces + confidence_sum) / (previous_faces + *count);
+        }
+        update_performance_metrics(engine, engine->metrics.detection_time_ms, *count, masked, unmasked);
+        
+        return FMD_SUCCESS;
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception in face detection: %s", e.what());
+        *count = 0;
+        return FMD_ERROR_PROCESSING;
+    }
+}
+
+// Reset accumulated metrics
+void reset_performance_metrics(detection_engine_t* engine) {
+    if (!engine) return;
+    
+    memset(&engine->metrics, 0, sizeof(detection_metrics_t));
+}
+
+// Account one processed frame
+void update_performance_metrics(detection_engine_t* engine, double detection_time, int faces_detected,
+                               int masked, int unmasked) {
+    if (!engine) return;
+    
+    detection_metrics_t* metrics = &engine->metrics;
+    metrics->frames_processed++;
+    metrics->detection_time_ms = detection_time;
+    metrics->faces_detected += faces_detected;
+    metrics->faces_with_mask += masked;
+    metrics->faces_without_mask += unmasked;
+}
+
+// Report keyframe share and cascade usage for one engine
+void print_detection_engine_stats(const detection_engine_t* engine, const char* label) {
+    if (!engine || engine->frame_index == 0) return;
+    
+    if (engine->detection_interval > 1) {
+        log_info("Detector %s: cascade ran on %llu of %llu frames (%.1f%%), interval %d",
+                 label ? label : "detector",
+                 (unsigned long long)engine->keyframes,
+                 (unsigned long long)engine->frame_index,
+                 100.0 * engine->keyframes / engine->frame_index,
+                 engine->detection_interval);
+    }
+    if (engine->roi_search && engine->cascade_scans > 0) {
+        log_info("Detector %s: %llu of %llu scans were full sweeps, %.1f%% of the frame scanned on average",
+                 label ? label : "detector",
+                 (unsigned long long)engine->full_sweeps,
+                 (unsigned long long)engine->cascade_scans,
+                 100.0 * engine->scanned_fraction_sum / engine->cascade_scans);
+    }
+    if (engine->adaptive_scale && engine->adaptive_ready) {
+        const detection_params_t* params = &engine->adaptive_params;
+        log_info("Detector %s: adaptive pyramid scale %.3f, faces %d-%d px (configured %.3f, %d-%d px)",
+                 label ? label : "detector",
+                 params->scale_factor, params->min_size_width, params->max_size_width,
+                 engine->face_detection_params.scale_factor,
+                 engine->face_detection_params.min_size_width,
+                 engine->face_detection_params.max_size_width);
+    }
+    if (engine->verify_detections && engine->candidates_verified + engine->candidates_rejected > 0) {
+        log_info("Detector %s: %llu candidates confirmed at full resolution, %llu rejected",
+                 label ? label : "detector",
+                 (unsigned long long)engine->candidates_verified,
+                 (unsigned long long)engine->candidates_rejected);
+    }
+    if (engine->metrics.cache_lookups > 0) {
+        log_info("Detector %s: mask cache hit rate %.1f%% (%llu of %llu tracked faces)",
+                 label ? label : "detector",
+                 100.0 * engine->metrics.cache_hits / engine->metrics.cache_lookups,
+                 (unsigned long long)engine->metrics.cache_hits,
+                 (unsigned long long)engine->metrics.cache_lookups);
+    }
+    if (engine->fallback_classifier && engine->metrics.classified_faces > 0) {
+        log_info("Detector %s: %.1f%% of %llu faces escalated from %s to %s (margin below %.2f)",
+                 label ? label : "detector",
+                 100.0 * engine->metrics.escalated_faces / engine->metrics.classified_faces,
+                 (unsigned long long)engine->metrics.classified_faces,
+                 engine->primary_classifier->name, engine->fallback_classifier->name,
+                 engine->escalation_margin);
+    }
+    if (engine->scratch.plane.builds > 0) {
+        log_info("Detector %s: feature plane shared by the faces of %llu frames",
+                 label ? label : "detector",
+                 (unsigned long long)engine->scratch.plane.builds);
+    }
+    // Face workers run their own forward passes
+    uint64_t batches = engine->batches;
+    uint64_t batched_faces = engine->batched_faces;
+    for (int i = 0; i < MAX_POOL_THREADS; i++) {
+        if (engine->face_engines[i]) {
+            batches += engine->face_engines[i]->batches;
+            batched_faces += engine->face_engines[i]->batched_faces;
+        }
+    }
+    if (batches > 0) {
+        log_info("Detector %s: %llu mask forward passes, %.1f faces per pass",
+                 label ? label : "detector",
+                 (unsigned long long)batches,
+                 (double)batched_faces / batches);
+    }
+    if (engine->face_pool) {
+        log_info("Detector %s: faces classified on %d threads", label ? label : "detector", engine->face_threads);
+    }
+    if (engine->tensor_allocations > 0) {
+        log_info("Detector %s: mask input tensor allocated %llu times, %llu input reshapes after warm-up (%.1f ms), "
+                 "%llu scratch reallocations",
+                 label ? label : "detector",
+                 (unsigned long long)engine->tensor_allocations,
+                 (unsigned long long)engine->network_reshapes,
+                 engine->warmup_time_ms,
+                 (unsigned long long)engine->scratch.reallocations);
+    }
+    print_cascade_registry_stats(&engine->cascades, label);
+}
@@ -0,0 +1,305 @@
+#include "detection_engine.h"
+#include "face_mask_detector.h"
+
+// Track ids are unique for the lifetime of the process
+static int g_next_track_id = 1;
+
+// Intersection over union of two face boxes
+float calculate_iou(const face_detection_t* face1, const face_detection_t* face2) {
+    if (!face1 || !face2) return 0.0f;
+    
+    int x1 = std::max(face1->x, face2->x);
+    int y1 = std::max(face1->y, face2->y);
+    int x2 = std::min(face1->x + face1->width, face2->x + face2->width);
+    int y2 = std::min(face1->y + face1->height, face2->y + face2->height);
+    
+    if (x2 <= x1 || y2 <= y1) return 0.0f;
+    
+    float intersection = (float)(x2 - x1) * (y2 - y1);
+    float area1 = (float)face1->width * face1->height;
+    float area2 = (float)face2->width * face2->height;
+    return intersection / (area1 + area2 - intersection);
+}
+
+// Reset all tracks to inactive
+int init_face_tracking(face_track_t* tracks, int max_tracks) {
+    if (!tracks || max_tracks <= 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    for (int i = 0; i < max_tracks; i++) {
+        face_track_t* track = &tracks[i];
+        track->track_id = -1;
+        memset(&track->last_detection, 0, sizeof(face_detection_t));
+        track->last_detection.track_id = -1;
+        reset_mask_smoothing(&track->smoothing);
+        track->stable_mask_status = MASK_STATUS_UNKNOWN;
+        track->consecutive_detections = 0;
+        track->last_update_time = 0.0;
+        track->active = false;
+        track->visible = false;
+        track->missed_keyframes = 0;
+        track->appearance.release();
+        track->mask_cached = false;
+    }
+    
+    return FMD_SUCCESS;
+}
+
+// Match score between a track and a detection: IoU when the boxes overlap
+// enough, otherwise a small centroid-distance score so overlap always wins
+static float track_match_score(const face_track_t* track, const face_detection_t* detection) {
+    const face_detection_t* last = &track->last_detection;
+    
+    float iou = calculate_iou(last, detection);
+    if (iou >= TRACK_IOU_THRESHOLD) {
+        return iou;
+    }
+    
+    float dx = (last->x + last->width * 0.5f) - (detection->x + detection->width * 0.5f);
+    float dy = (last->y + last->height * 0.5f) - (detection->y + detection->height * 0.5f);
+    float size = (float)std::max(last->width, last->height);
+    if (size <= 0.0f) return 0.0f;
+    
+    float distance = sqrtf(dx * dx + dy * dy) / size;
+    if (distance >= 0.5f) return 0.0f;
+    
+    return (0.5f - distance) * 0.5f * TRACK_IOU_THRESHOLD;
+}
+
+// Associate keyframe detections with tracks. Each detection's track_id is
+// set; unmatched detections start new tracks and tracks missing for too
+// many keyframes are retired. Returns the number of active tracks.
+int update_face_tracks(face_track_t* tracks, int max_tracks, face_detection_t* detections,
+                      int detection_count, double current_time) {
+    if (!tracks || max_tracks <= 0 || (!detections && detection_count > 0)) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    max_tracks = std::min(max_tracks, MAX_FACE_TRACKS);
+    detection_count = std::min(detection_count, MAX_FACES);
+    
+    bool track_matched[MAX_FACE_TRACKS] = {false};
+    bool detection_matched[MAX_FACES] = {false};
+    
+    for (int d = 0; d < detection_count; d++) {
+        detections[d].track_id = -1;
+    }
+    
+    // Greedy assignment, best pair first
+    while (true) {
+        float best_score = 0.0f;
+        int best_track = -1;
+        int best_detection = -1;
+        
+        for (int t = 0; t < max_tracks; t++) {
+            if (!tracks[t].active || track_matched[t]) continue;
+            for (int d = 0; d < detection_count; d++) {
+                if (detection_matched[d]) continue;
+                float score = track_match_score(&tracks[t], &detections[d]);
+                if (score > best_score) {
+                    best_score = score;
+                    best_track = t;
+                    best_detection = d;
+                }
+            }
+        }
+        
+        if (best_track < 0) break;
+        
+        face_track_t* track = &tracks[best_track];
+        face_detection_t* detection = &detections[best_detection];
+        track_matched[best_track] = true;
+        detection_matched[best_detection] = true;
+        
+        // Move the box but keep the track's smoothing history
+        track->last_detection.x = detection->x;
+        track->last_detection.y = detection->y;
+        track->last_detection.width = detection->width;
+        track->last_detection.height = detection->height;
+        track->last_detection.confidence = detection->confidence;
+        track->consecutive_detections++;
+        track->missed_keyframes = 0;
+        track->last_update_time = current_time;
+        track->visible = true;
+        detection->track_id = track->track_id;
+    }
+    
+    // Tracks without a detection this keyframe
+    for (int t = 0; t < max_tracks; t++) {
+        face_track_t* track = &tracks[t];
+        if (!track->active || track_matched[t]) continue;
+        
+        track->consecutive_detections = 0;
+        track->visible = false;
+        if (++track->missed_keyframes > TRACK_MAX_MISSED_KEYFRAMES) {
+            track->active = false;
+        }
+    }
+    
+    // New tracks for unmatched detections
+    for (int d = 0; d < detection_count; d++) {
+        if (detection_matched[d]) continue;
+        
+        for (int t = 0; t < max_tracks; t++) {
+            face_track_t* track = &tracks[t];
+            if (track->active) continue;
+            
+            track->track_id = __sync_fetch_and_add(&g_next_track_id, 1);
+            memset(&track->last_detection, 0, sizeof(face_detection_t));
+            track->last_detection.x = detections[d].x;
+            track->last_detection.y = detections[d].y;
+            track->last_detection.width = detections[d].width;
+            track->last_detection.height = detections[d].height;
+            track->last_detection.confidence = detections[d].confidence;
+            track->last_detection.track_id = track->track_id;
+            reset_mask_smoothing(&track->smoothing);
+            track->stable_mask_status = MASK_STATUS_UNKNOWN;
+            track->consecutive_detections = 1;
+            track->last_update_time = current_time;
+            track->active = true;
+            track->visible = true;
+            track->missed_keyframes = 0;
+            track->appearance.release();
+            track->mask_cached = false;
+            detections[d].track_id = track->track_id;
+            break;
+        }
+    }
+    
+    int active = 0;
+    for (int t = 0; t < max_tracks; t++) {
+        if (tracks[t].active) active++;
+    }
+    return active;
+}
+
+int get_stable_mask_status(const face_track_t* track) {
+    if (!track || !track->active) return MASK_STATUS_UNKNOWN;
+    
+    return track->stable_mask_status;
+}
+
+face_track_t* find_face_track(face_track_t* tracks, int max_tracks, int track_id) {
+    if (!tracks || track_id < 0) return NULL;
+    
+    for (int t = 0; t < max_tracks; t++) {
+        if (tracks[t].active && tracks[t].track_id == track_id) {
+            return &tracks[t];
+        }
+    }
+    return NULL;
+}
+
+// Store a small gray template of the track's current box
+void capture_track_appearance(face_track_t* track, const cv::Mat& gray) {
+    if (!track || gray.empty()) return;
+    
+    const face_detection_t* last = &track->last_detection;
+    cv::Rect box = cv::Rect(last->x, last->y, last->width, last->height) & cv::Rect(0, 0, gray.cols, gray.rows);
+    if (box.width < TRACK_TEMPLATE_SIZE / 2 || box.height < TRACK_TEMPLATE_SIZE / 2) {
+        track->appearance.release();
+        return;
+    }
+    
+    cv::resize(gray(box), track->appearance, cv::Size(TRACK_TEMPLATE_SIZE, TRACK_TEMPLATE_SIZE), 0, 0, cv::INTER_AREA);
+}
+
+// Move a track to the best template match in a window around its last box.
+// Matching runs at template scale, so the cost does not depend on face size.
+bool follow_face_track(face_track_t* track, const cv::Mat& gray) {
+    if (!track || !track->active || track->appearance.empty() || gray.empty()) {
+        return false;
+    }
+    
+    face_detection_t* last = &track->last_detection;
+    if (last->width <= 0 || last->height <= 0) return false;
+    
+    int margin_x = last->width / 2;
+    int margin_y = last->height / 2;
+    cv::Rect window(last->x - margin_x, last->y - margin_y, last->width + 2 * margin_x, last->height + 2 * margin_y);
+    window &= cv::Rect(0, 0, gray.cols, gray.rows);
+    
+    double scale_x = (double)TRACK_TEMPLATE_SIZE / last->width;
+    double scale_y = (double)TRACK_TEMPLATE_SIZE / last->height;
+    cv::Size search_size(cvRound(window.width * scale_x), cvRound(window.height * scale_y));
+    if (search_size.width < TRACK_TEMPLATE_SIZE || search_size.height < TRACK_TEMPLATE_SIZE) {
+        return false;
+    }
+    
+    try {
+        cv::resize(gray(window), track->search_buffer, search_size, 0, 0, cv::INTER_AREA);
+        cv::matchTemplate(track->search_buffer, track->appearance, track->match_buffer, cv::TM_CCOEFF_NORMED);
+        
+        double best_score = 0.0;
+        cv::Point best_location;
+        cv::minMaxLoc(track->match_buffer, NULL, &best_score, NULL, &best_location);
+        
+        if (best_score < TRACK_MATCH_THRESHOLD) {
+            return false;
+        }
+        
+        last->x = window.x + cvRound(best_location.x / scale_x);
+        last->y = window.y + cvRound(best_location.y / scale_y);
+        last->confidence = (float)best_score;
+        return true;
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception while following track %d: %s", track->track_id, e.what());
+        return false;
+    }
+}
+
+// Reduce the lower face to a small luma thumbnail for the classification
+// cache. Returns false when the region is too small to describe.
+bool compute_mask_signature(const cv::Mat& frame, const face_detection_t* face, cv::Mat& thumbnail, uint8_t* signature) {
+    if (frame.empty() || frame.type() != CV_8UC3 || !face || !signature) return false;
+    
+    cv::Rect face_rect = cv::Rect(face->x, face->y, face->width, face->height) & cv::Rect(0, 0, frame.cols, frame.rows);
+    cv::Rect region = get_mouth_region(face_rect);
+    if (region.width < MASK_SIGNATURE_SIZE || region.height < MASK_SIGNATURE_SIZE) return false;
+    
+    cv::resize(frame(region), thumbnail, cv::Size(MASK_SIGNATURE_SIZE, MASK_SIGNATURE_SIZE), 0, 0, cv::INTER_AREA);
+    for (int y = 0; y < MASK_SIGNATURE_SIZE; y++) {
+        const uchar* row = thumbnail.ptr<uchar>(y);
+        for (int x = 0; x < MASK_SIGNATURE_SIZE; x++) {
+            const uchar* pixel = row + 3 * x;
+            signature[y * MASK_SIGNATURE_SIZE + x] = (uint8_t)((pixel[0] + 2 * pixel[1] + pixel[2] + 2) >> 2);
+        }
+    }
+    return true;
+}
+
+// Hand back the track's last classification if it is younger than max_age
+// frames and the face still looks the same. The signature is compared with
+// the one the result was made on, so slow drift also forces a refresh.
+bool lookup_mask_cache(face_track_t* track, const uint8_t* signature, int max_age, mask_status_t* status, float* confidence) {
+    if (!track || !signature || !status || !confidence || !track->mask_cached || track->cache_age >= max_age) {
+        return false;
+    }
+    
+    int difference = 0;
+    for (int i = 0; i < MASK_SIGNATURE_PIXELS; i++) {
+        difference += abs((int)signature[i] - (int)track->mask_signature[i]);
+    }
+    if (difference > MASK_SIGNATURE_TOLERANCE * MASK_SIGNATURE_PIXELS) {
+        return false;
+    }
+    
+    track->cache_age++;
+    *status = track->cached_status;
+    *confidence = track->cached_confidence;
+    return true;
+}
+
+// Remember a fresh classification; unknown results are not cached
+void store_mask_cache(face_track_t* track, const uint8_t* signature, mask_status_t status, float confidence) {
+    if (!track) return;
+    
+    track->mask_cached = signature != NULL && status != MASK_STATUS_UNKNOWN;
+    if (!track->mask_cached) return;
+    
+    memcpy(track->mask_signature, signature, sizeof(track->mask_signature));
+    track->cached_status = status;
+    track->cached_confidence = confidence;
+    track->cache_age = 0;
+}
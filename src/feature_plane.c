@@ -0,0 +1,143 @@
+#include "image_processing.h"
+#include "face_mask_detector.h"
+
+// Skin range of the heuristic classifiers, in OpenCV's 8-bit HSV
+#define SKIN_HUE_MAX 30
+#define SKIN_SAT_MIN 30
+#define SKIN_SAT_MAX 150
+#define SKIN_VAL_MIN 50
+
+// Canny thresholds of each edge map
+static const double g_edge_thresholds[PLANE_EDGE_MAPS][2] = {{50, 150}, {30, 100}};
+
+// 32-bit sums of 8-bit channels overflow beyond this many pixels
+#define FEATURE_PLANE_MAX_PIXELS (INT_MAX / 255)
+
+// Sum of one channel of an integral image over rect
+template <typename T>
+static double rect_sum(const cv::Mat& integral, const cv::Rect& rect, int channel) {
+    int channels = integral.channels();
+    const T* top = integral.ptr<T>(rect.y);
+    const T* bottom = integral.ptr<T>(rect.y + rect.height);
+    int left = rect.x * channels + channel;
+    int right = (rect.x + rect.width) * channels + channel;
+    
+    return (double)bottom[right] - (double)bottom[left] - (double)top[right] + (double)top[left];
+}
+
+// Convert area of the frame once and build the integral images of hue,
+// saturation, value, gray, gray squared and the skin mask. Buffers are kept
+// in the plane and reused by the next build of the same size.
+int build_feature_plane(const cv::Mat& frame, const cv::Rect& area, feature_plane_t* plane) {
+    if (frame.empty() || frame.type() != CV_8UC3 || !plane) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    plane->valid = false;
+    for (int i = 0; i < PLANE_EDGE_MAPS; i++) {
+        plane->edges_ready[i] = false;
+    }
+    cv::Rect clipped = area & cv::Rect(0, 0, frame.cols, frame.rows);
+    if (clipped.empty() || clipped.area() > FEATURE_PLANE_MAX_PIXELS) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    try {
+        cv::Mat region = frame(clipped);
+        cv::cvtColor(region, plane->hsv, cv::COLOR_BGR2HSV);
+        cv::cvtColor(region, plane->gray, cv::COLOR_BGR2GRAY);
+        cv::inRange(plane->hsv, cv::Scalar(0, SKIN_SAT_MIN, SKIN_VAL_MIN),
+                    cv::Scalar(SKIN_HUE_MAX, SKIN_SAT_MAX, 255), plane->skin);
+        
+        cv::integral(plane->hsv, plane->hsv_sum, CV_32S);
+        cv::integral(plane->gray, plane->gray_sum, plane->gray_sqsum, CV_32S, CV_64F);
+        cv::integral(plane->skin, plane->skin_sum, CV_32S);
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception while building feature plane: %s", e.what());
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    plane->area = clipped;
+    plane->valid = true;
+    plane->builds++;
+    return FMD_SUCCESS;
+}
+
+void release_feature_plane(feature_plane_t* plane) {
+    if (!plane) return;
+    
+    plane->valid = false;
+    plane->area = cv::Rect();
+    plane->hsv.release();
+    plane->gray.release();
+    plane->skin.release();
+    plane->hsv_sum.release();
+    plane->gray_sum.release();
+    plane->gray_sqsum.release();
+    plane->skin_sum.release();
+    plane->edges.release();
+    for (int i = 0; i < PLANE_EDGE_MAPS; i++) {
+        plane->edges_ready[i] = false;
+        plane->edge_sum[i].release();
+    }
+}
+
+// True if rect (frame coordinates) lies inside the plane's area
+bool feature_plane_covers(const feature_plane_t* plane, const cv::Rect& rect) {
+    if (!plane || !plane->valid || rect.empty()) return false;
+    
+    return (rect & plane->area) == rect;
+}
+
+// Statistics of rect (frame coordinates) from the integral images, in
+// constant time regardless of the rectangle's size
+int feature_plane_stats(const feature_plane_t* plane, const cv::Rect& rect, roi_features_t* features) {
+    if (!features || !feature_plane_covers(plane, rect)) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    cv::Rect local = rect - plane->area.tl();
+    double count = (double)local.area();
+    
+    features->hue_mean = rect_sum<int>(plane->hsv_sum, local, 0) / count;
+    features->saturation_mean = rect_sum<int>(plane->hsv_sum, local, 1) / count;
+    features->value_mean = rect_sum<int>(plane->hsv_sum, local, 2) / count;
+    features->gray_mean = rect_sum<int>(plane->gray_sum, local, 0) / count;
+    double variance = rect_sum<double>(plane->gray_sqsum, local, 0) / count - features->gray_mean * features->gray_mean;
+    features->gray_std = sqrt(std::max(variance, 0.0));
+    features->skin_ratio = rect_sum<int>(plane->skin_sum, local, 0) / (255.0 * count);
+    return FMD_SUCCESS;
+}
+
+// View of the plane's gray image over rect (frame coordinates)
+cv::Mat feature_plane_gray(const feature_plane_t* plane, const cv::Rect& rect) {
+    if (!feature_plane_covers(plane, rect)) {
+        return cv::Mat();
+    }
+    
+    return plane->gray(rect - plane->area.tl());
+}
+
+// Share of edge pixels in rect (frame coordinates), or -1 if the plane does
+// not cover it. The first call for an edge map runs Canny over the whole
+// plane and integrates the result; later calls are O(1) lookups. Edges near
+// a region's border therefore see the pixels beyond it.
+double feature_plane_edge_density(feature_plane_t* plane, const cv::Rect& rect, plane_edges_t which) {
+    if (which < 0 || which >= PLANE_EDGE_MAPS || !feature_plane_covers(plane, rect)) {
+        return -1.0;
+    }
+    
+    if (!plane->edges_ready[which]) {
+        try {
+            cv::Canny(plane->gray, plane->edges, g_edge_thresholds[which][0], g_edge_thresholds[which][1]);
+            cv::integral(plane->edges, plane->edge_sum[which], CV_32S);
+        } catch (const cv::Exception& e) {
+            log_error("OpenCV exception while building edge map: %s", e.what());
+            return -1.0;
+        }
+        plane->edges_ready[which] = true;
+    }
+    
+    cv::Rect local = rect - plane->area.tl();
+    return rect_sum<int>(plane->edge_sum[which], local, 0) / (255.0 * local.area());
+}
@@ -0,0 +1,544 @@
+#include "frame_source.h"
+#include "face_mask_detector.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <strings.h>
+
+#define Y4M_MAGIC "YUV4MPEG2"
+#define Y4M_FRAME_TAG "FRAME"
+#define DEFAULT_SOURCE_FPS 30.0
+
+// Reset a source to the closed state
+void init_frame_source(frame_source_t* source) {
+    if (!source) return;
+    
+    source->type = FRAME_SOURCE_NONE;
+    source->capture = NULL;
+    source->owns_capture = false;
+    source->data = NULL;
+    source->size = 0;
+    source->width = 0;
+    source->height = 0;
+    source->pixels = FRAME_PIXELS_BGR;
+    source->frame_bytes = 0;
+    source->frame_offsets.clear();
+    source->frame_times.clear();
+    source->next_frame = 0;
+    source->fps = 0.0;
+}
+
+// Files read through a mapping instead of a decoder: .y4m, .fmdv recordings,
+// and headerless .raw/.bgr/.gray frames described by a raw format
+bool is_mapped_frame_file(const char* path) {
+    if (!path) return false;
+    
+    const char* extension = strrchr(path, '.');
+    if (!extension) return false;
+    
+    return strcasecmp(extension, ".y4m") == 0 || strcasecmp(extension, ".fmdv") == 0 ||
+           strcasecmp(extension, ".raw") == 0 || strcasecmp(extension, ".bgr") == 0 ||
+           strcasecmp(extension, ".gray") == 0;
+}
+
+// Parse "WIDTHxHEIGHT:bgr|gray[@FPS]", e.g. "1280x720:bgr@25"
+int parse_raw_frame_format(const char* text, raw_frame_format_t* format) {
+    if (!text || !format) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    int width = 0;
+    int height = 0;
+    char pixels[16] = {0};
+    double fps = DEFAULT_SOURCE_FPS;
+    int fields = sscanf(text, "%dx%d:%15[a-z]@%lf", &width, &height, pixels, &fps);
+    if (fields < 3 || width <= 0 || height <= 0 || fps <= 0.0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (strcmp(pixels, "bgr") == 0) {
+        format->pixels = FRAME_PIXELS_BGR;
+    } else if (strcmp(pixels, "gray") == 0) {
+        format->pixels = FRAME_PIXELS_GRAY;
+    } else {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    format->width = width;
+    format->height = height;
+    format->fps = fps;
+    return FMD_SUCCESS;
+}
+
+// Read the Y4M stream header and index the frames that follow it. Each frame
+// is "FRAME[ params]\n" followed by its planes; a truncated last frame is dropped.
+static int index_y4m_frames(frame_source_t* source) {
+    const uint8_t* data = source->data;
+    size_t magic_length = strlen(Y4M_MAGIC);
+    if (source->size <= magic_length || memcmp(data, Y4M_MAGIC, magic_length) != 0) {
+        log_error("Not a Y4M stream");
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    const uint8_t* header_end = (const uint8_t*)memchr(data, '\n', source->size);
+    if (!header_end) {
+        log_error("Y4M stream header is not terminated");
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    // Parameters are space separated, each a tag letter followed by its value
+    std::string header((const char*)data + magic_length, header_end - data - magic_length);
+    source->pixels = FRAME_PIXELS_I420;
+    source->fps = DEFAULT_SOURCE_FPS;
+    size_t position = 0;
+    while (position < header.size()) {
+        size_t next = header.find(' ', position);
+        if (next == std::string::npos) next = header.size();
+        std::string token = header.substr(position, next - position);
+        position = next + 1;
+        if (token.empty()) continue;
+        
+        const char* value = token.c_str() + 1;
+        switch (token[0]) {
+            case 'W':
+                source->width = atoi(value);
+                break;
+            case 'H':
+                source->height = atoi(value);
+                break;
+            case 'F': {
+                int numerator = 0;
+                int denominator = 0;
+                if (sscanf(value, "%d:%d", &numerator, &denominator) == 2 && numerator > 0 && denominator > 0) {
+                    source->fps = (double)numerator / denominator;
+                }
+                break;
+            }
+            case 'C':
+                // Only the 8-bit 4:2:0 tags; 420p10 and friends have 16-bit samples
+                if (strcmp(value, "420") == 0 || strcmp(value, "420jpeg") == 0 ||
+                    strcmp(value, "420paldv") == 0 || strcmp(value, "420mpeg2") == 0) {
+                    source->pixels = FRAME_PIXELS_I420;
+                } else if (strcmp(value, "mono") == 0) {
+                    source->pixels = FRAME_PIXELS_GRAY;
+                } else {
+                    log_error("Unsupported Y4M colorspace: %s (8-bit 420 and mono are supported)", value);
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    
+    if (source->width <= 0 || source->height <= 0 ||
+        (source->pixels == FRAME_PIXELS_I420 && (source->width % 2 != 0 || source->height % 2 != 0))) {
+        log_error("Invalid Y4M frame size %dx%d", source->width, source->height);
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    size_t plane = (size_t)source->width * source->height;
+    source->frame_bytes = source->pixels == FRAME_PIXELS_I420 ? plane * 3 / 2 : plane;
+    
+    size_t tag_length = strlen(Y4M_FRAME_TAG);
+    size_t offset = header_end - data + 1;
+    while (offset + tag_length <= source->size && memcmp(data + offset, Y4M_FRAME_TAG, tag_length) == 0) {
+        const uint8_t* line_end = (const uint8_t*)memchr(data + offset, '\n', source->size - offset);
+        if (!line_end) break;
+        
+        size_t pixels = line_end - data + 1;
+        if (pixels + source->frame_bytes > source->size) break;
+        
+        source->frame_offsets.push_back(pixels);
+        offset = pixels + source->frame_bytes;
+    }
+    
+    return FMD_SUCCESS;
+}
+
+// Frames of a headerless raw file follow each other with no padding
+static int index_raw_frames(frame_source_t* source, const char* raw_format) {
+    raw_frame_format_t format;
+    if (!raw_format || parse_raw_frame_format(raw_format, &format) != FMD_SUCCESS) {
+        log_error("Raw frame files need a raw format such as 640x480:bgr (got \"%s\")", raw_format ? raw_format : "");
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    source->width = format.width;
+    source->height = format.height;
+    source->pixels = format.pixels;
+    source->fps = format.fps;
+    source->frame_bytes = (size_t)format.width * format.height * (format.pixels == FRAME_PIXELS_BGR ? 3 : 1);
+    
+    size_t count = source->size / source->frame_bytes;
+    if (source->size % source->frame_bytes != 0) {
+        log_warning("Raw file size is not a multiple of the %zu byte frame; ignoring the trailing bytes",
+                    source->frame_bytes);
+    }
+    
+    source->frame_offsets.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        source->frame_offsets[i] = i * source->frame_bytes;
+    }
+    return FMD_SUCCESS;
+}
+
+// Read a recording's header and index its fixed-size frames; a truncated
+// last frame is dropped
+static int index_recorded_frames(frame_source_t* source) {
+    if (source->size < RECORDING_HEADER_BYTES || memcmp(source->data, RECORDING_MAGIC, 4) != 0) {
+        log_error("Not a frame recording");
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    uint32_t version;
+    int32_t geometry[3];
+    memcpy(&version, source->data + 4, sizeof(version));
+    memcpy(geometry, source->data + 8, sizeof(geometry));
+    memcpy(&source->fps, source->data + 24, sizeof(double));
+    if (version != RECORDING_VERSION || geometry[0] <= 0 || geometry[1] <= 0 || geometry[2] != 3) {
+        log_error("Unsupported recording: version %u, %dx%dx%d", version, geometry[0], geometry[1], geometry[2]);
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    source->width = geometry[0];
+    source->height = geometry[1];
+    source->pixels = FRAME_PIXELS_BGR;
+    source->frame_bytes = (size_t)source->width * source->height * 3;
+    
+    size_t stride = RECORDING_FRAME_HEADER_BYTES + source->frame_bytes;
+    size_t count = (source->size - RECORDING_HEADER_BYTES) / stride;
+    source->frame_offsets.resize(count);
+    source->frame_times.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        size_t offset = RECORDING_HEADER_BYTES + i * stride;
+        memcpy(&source->frame_times[i], source->data + offset, sizeof(double));
+        source->frame_offsets[i] = offset + RECORDING_FRAME_HEADER_BYTES;
+    }
+    return FMD_SUCCESS;
+}
+
+// Map a raw, Y4M or recording file and index its frames
+int open_mapped_frame_source(frame_source_t* source, const char* path, const char* raw_format) {
+    if (!source || !path) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    close_frame_source(source);
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_error("Could not open %s", path);
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        log_error("Could not read the size of %s", path);
+        close(fd);
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    
+    // Private writable mapping: frames handed out can be written without
+    // touching the file, but each page written stays resident as a private
+    // copy until the mapping is closed, so callers draw on copies
+    void* data = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        log_error("Could not map %s", path);
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+    
+    source->type = FRAME_SOURCE_MAPPED;
+    source->data = (uint8_t*)data;
+    source->size = (size_t)info.st_size;
+    
+    const char* extension = strrchr(path, '.');
+    int result;
+    if (extension && strcasecmp(extension, ".y4m") == 0) {
+        result = index_y4m_frames(source);
+    } else if (extension && strcasecmp(extension, ".fmdv") == 0) {
+        result = index_recorded_frames(source);
+    } else {
+        result = index_raw_frames(source, raw_format);
+    }
+    if (result == FMD_SUCCESS && source->frame_offsets.empty()) {
+        log_error("No complete frames in %s", path);
+        result = FMD_ERROR_PROCESSING;
+    }
+    if (result != FMD_SUCCESS) {
+        close_frame_source(source);
+        return result;
+    }
+    
+    log_debug("Mapped %s: %dx%d, %zu frames at %.2f fps", path, source->width, source->height,
+              source->frame_offsets.size(), source->fps);
+    return FMD_SUCCESS;
+}
+
+// Read frames through an already opened capture owned by the caller
+int attach_capture_frame_source(frame_source_t* source, cv::VideoCapture* capture) {
+    if (!source || !capture) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    close_frame_source(source);
+    source->type = FRAME_SOURCE_CAPTURE;
+    source->capture = capture;
+    source->owns_capture = false;
+    return FMD_SUCCESS;
+}
+
+// Open a file: mapped when it is a raw or Y4M file, decoded otherwise
+int open_frame_source(frame_source_t* source, const char* path, const char* raw_format) {
+    if (!source || !path || strlen(path) == 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (is_mapped_frame_file(path)) {
+        return open_mapped_frame_source(source, path, raw_format);
+    }
+    
+    close_frame_source(source);
+    cv::VideoCapture* capture = new cv::VideoCapture();
+    try {
+        if (!capture->open(path)) {
+            delete capture;
+            return FMD_ERROR_FILE_NOT_FOUND;
+        }
+    } catch (const cv::Exception& e) {
+        log_error("Could not open %s: %s", path, e.what());
+        delete capture;
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    
+    source->type = FRAME_SOURCE_CAPTURE;
+    source->capture = capture;
+    source->owns_capture = true;
+    return FMD_SUCCESS;
+}
+
+bool frame_source_is_open(const frame_source_t* source) {
+    if (!source) return false;
+    
+    if (source->type == FRAME_SOURCE_CAPTURE) return source->capture->isOpened();
+    return source->type == FRAME_SOURCE_MAPPED;
+}
+
+// Next frame. Mapped BGR frames are views into the mapping; gray and YUV
+// frames are converted to BGR into a new buffer.
+bool read_frame_source(frame_source_t* source, cv::Mat& frame) {
+    if (!source) return false;
+    
+    if (source->type == FRAME_SOURCE_CAPTURE) {
+        return source->capture->read(frame);
+    }
+    if (source->type != FRAME_SOURCE_MAPPED || source->next_frame >= (int64_t)source->frame_offsets.size()) {
+        return false;
+    }
+    
+    uint8_t* pixels = source->data + source->frame_offsets[source->next_frame++];
+    switch (source->pixels) {
+        case FRAME_PIXELS_BGR:
+            frame = cv::Mat(source->height, source->width, CV_8UC3, pixels);
+            break;
+        case FRAME_PIXELS_GRAY:
+            cv::cvtColor(cv::Mat(source->height, source->width, CV_8UC1, pixels), frame, cv::COLOR_GRAY2BGR);
+            break;
+        case FRAME_PIXELS_I420:
+            cv::cvtColor(cv::Mat(source->height * 3 / 2, source->width, CV_8UC1, pixels), frame,
+                         cv::COLOR_YUV2BGR_I420);
+            break;
+    }
+    return true;
+}
+
+// True when read_frame_source hands out views into the mapping rather than
+// frames of their own; such frames must be copied before being drawn on
+bool frame_source_shares_frames(const frame_source_t* source) {
+    return source && source->type == FRAME_SOURCE_MAPPED && source->pixels == FRAME_PIXELS_BGR;
+}
+
+// Skip the next frame without decoding or converting it
+bool grab_frame_source(frame_source_t* source) {
+    if (!source) return false;
+    
+    if (source->type == FRAME_SOURCE_CAPTURE) {
+        return source->capture->grab();
+    }
+    if (source->type != FRAME_SOURCE_MAPPED || source->next_frame >= (int64_t)source->frame_offsets.size()) {
+        return false;
+    }
+    
+    source->next_frame++;
+    return true;
+}
+
+// Position the source so the next read returns the given frame
+int seek_frame_source(frame_source_t* source, int64_t frame) {
+    if (!source || frame < 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (source->type == FRAME_SOURCE_CAPTURE) {
+        return source->capture->set(cv::CAP_PROP_POS_FRAMES, (double)frame) ? FMD_SUCCESS : FMD_ERROR_PROCESSING;
+    }
+    if (source->type != FRAME_SOURCE_MAPPED) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    source->next_frame = std::min(frame, (int64_t)source->frame_offsets.size());
+    return FMD_SUCCESS;
+}
+
+// Index of the frame the next read returns
+int64_t frame_source_position(const frame_source_t* source) {
+    if (!source) return 0;
+    
+    if (source->type == FRAME_SOURCE_CAPTURE) {
+        return (int64_t)source->capture->get(cv::CAP_PROP_POS_FRAMES);
+    }
+    return source->next_frame;
+}
+
+// Number of frames, 0 when the source does not know
+int64_t frame_source_frame_count(const frame_source_t* source) {
+    if (!source) return 0;
+    
+    if (source->type == FRAME_SOURCE_CAPTURE) {
+        return std::max((int64_t)0, (int64_t)source->capture->get(cv::CAP_PROP_FRAME_COUNT));
+    }
+    return (int64_t)source->frame_offsets.size();
+}
+
+// Nominal frame rate, 0 when the source does not know
+double frame_source_fps(const frame_source_t* source) {
+    if (!source) return 0.0;
+    
+    if (source->type == FRAME_SOURCE_CAPTURE) {
+        return source->capture->get(cv::CAP_PROP_FPS);
+    }
+    return source->fps;
+}
+
+cv::Size frame_source_size(const frame_source_t* source) {
+    if (!source) return cv::Size();
+    
+    if (source->type == FRAME_SOURCE_CAPTURE) {
+        return cv::Size((int)source->capture->get(cv::CAP_PROP_FRAME_WIDTH),
+                        (int)source->capture->get(cv::CAP_PROP_FRAME_HEIGHT));
+    }
+    return cv::Size(source->width, source->height);
+}
+
+// Capture timestamp of the frame the next read returns, in seconds from the
+// start of the recording; negative when the source has no timestamps
+double frame_source_next_time(const frame_source_t* source) {
+    if (!source || source->next_frame >= (int64_t)source->frame_times.size()) return -1.0;
+    
+    return source->frame_times[source->next_frame];
+}
+
+// Unmap the file or release an owned capture. Views handed out by a mapped
+// source must not be used afterwards.
+void close_frame_source(frame_source_t* source) {
+    if (!source) return;
+    
+    if (source->data) {
+        munmap(source->data, source->size);
+    }
+    if (source->owns_capture && source->capture) {
+        source->capture->release();
+        delete source->capture;
+    }
+    
+    std::vector<size_t>().swap(source->frame_offsets);
+    std::vector<double>().swap(source->frame_times);
+    init_frame_source(source);
+}
+
+// Create a recording; its header is written with the first frame, once the
+// frame size is known
+int open_frame_recorder(frame_recorder_t* recorder, const char* path, double fps) {
+    if (!recorder || !path || strlen(path) == 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->fps = fps > 0.0 ? fps : DEFAULT_SOURCE_FPS;
+    recorder->file = fopen(path, "wb");
+    if (!recorder->file) {
+        log_error("Could not create recording %s", path);
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    return FMD_SUCCESS;
+}
+
+// Append a BGR frame with its capture timestamp in seconds. Frames of a
+// different size or type than the first are rejected, so the file stays
+// seekable by offset.
+int record_frame(frame_recorder_t* recorder, const cv::Mat& frame, double timestamp) {
+    if (!recorder || !recorder->file || frame.empty()) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    if (recorder->failed) {
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    double start = get_current_time();
+    if (frame.type() != CV_8UC3 || (recorder->frames > 0 &&
+        (frame.cols != recorder->width || frame.rows != recorder->height))) {
+        if (recorder->rejected++ == 0) {
+            log_warning("Not recording %dx%d frames of type %d; the recording holds %dx%d BGR frames",
+                        frame.cols, frame.rows, frame.type(), recorder->width, recorder->height);
+        }
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    bool written = true;
+    if (recorder->frames == 0) {
+        uint32_t version = RECORDING_VERSION;
+        int32_t geometry[3] = {frame.cols, frame.rows, 3};
+        uint32_t reserved = 0;
+        written = fwrite(RECORDING_MAGIC, 1, 4, recorder->file) == 4 &&
+                  fwrite(&version, sizeof(version), 1, recorder->file) == 1 &&
+                  fwrite(geometry, sizeof(geometry), 1, recorder->file) == 1 &&
+                  fwrite(&reserved, sizeof(reserved), 1, recorder->file) == 1 &&
+                  fwrite(&recorder->fps, sizeof(double), 1, recorder->file) == 1;
+        recorder->width = frame.cols;
+        recorder->height = frame.rows;
+        recorder->bytes += RECORDING_HEADER_BYTES;
+    }
+    
+    size_t row_bytes = (size_t)frame.cols * 3;
+    written = written && fwrite(&timestamp, sizeof(timestamp), 1, recorder->file) == 1;
+    if (frame.isContinuous()) {
+        written = written && fwrite(frame.data, 1, row_bytes * frame.rows, recorder->file) == row_bytes * frame.rows;
+    } else {
+        for (int y = 0; y < frame.rows && written; y++) {
+            written = fwrite(frame.ptr<uchar>(y), 1, row_bytes, recorder->file) == row_bytes;
+        }
+    }
+    
+    if (!written) {
+        log_error("Failed to write the recording; recording stopped after %llu frames",
+                  (unsigned long long)recorder->frames);
+        recorder->failed = true;
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    recorder->frames++;
+    recorder->bytes += RECORDING_FRAME_HEADER_BYTES + row_bytes * frame.rows;
+    recorder->write_time += get_current_time() - start;
+    return FMD_SUCCESS;
+}
+
+void close_frame_recorder(frame_recorder_t* recorder) {
+    if (!recorder || !recorder->file) return;
+    
+    if (fclose(recorder->file) != 0 && !recorder->failed) {
+        log_error("Failed to finish the recording");
+    }
+    recorder->file = NULL;
+}
@@ -275,6 +275,151 @@ int create_blob_from_image(const cv::Mat& image, cv::Mat& blob, double scale_fac
     }
 }
 
+// Widest tensor crop_face_into_tensor writes; its column tables live on
+// the stack
+#define TENSOR_MAX_WIDTH 2048
+
+// True if tensor is a continuous NCHW float tensor with 3 channels and slot
+// is one of its batch entries
+static bool is_tensor_slot(const cv::Mat& tensor, int slot) {
+    return tensor.dims == 4 && tensor.type() == CV_32F && tensor.isContinuous() &&
+           tensor.size[1] == 3 && slot >= 0 && slot < tensor.size[0];
+}
+
+// Per-channel normalization of blobFromImage: output channel c is
+// input channel source[c] * gain + offset[c]
+static void tensor_normalization(double scale, const cv::Scalar& mean, bool swap_rb,
+                                 int source[3], float* gain, float offset[3]) {
+    source[0] = swap_rb ? 2 : 0;
+    source[1] = 1;
+    source[2] = swap_rb ? 0 : 2;
+    *gain = (float)scale;
+    for (int c = 0; c < 3; c++) {
+        offset[c] = (float)(-mean[c] * scale);
+    }
+}
+
+// Write an 8-bit BGR image into one slot of an NCHW float tensor the way
+// blobFromImage would: (pixel - mean) * scale, mean in output channel order.
+// The image must already have the tensor's height and width.
+int write_tensor_slot(const cv::Mat& image, cv::Mat& tensor, int slot, double scale,
+                      const cv::Scalar& mean, bool swap_rb) {
+    if (image.empty() || image.type() != CV_8UC3 || !is_tensor_slot(tensor, slot) ||
+        image.rows != tensor.size[2] || image.cols != tensor.size[3]) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    int rows = image.rows;
+    int cols = image.cols;
+    size_t plane = (size_t)rows * cols;
+    float* slot_data = tensor.ptr<float>(slot);
+    
+    int source[3];
+    float gain;
+    float offset[3];
+    tensor_normalization(scale, mean, swap_rb, source, &gain, offset);
+    
+    for (int y = 0; y < rows; y++) {
+        const uchar* pixel = image.ptr<uchar>(y);
+        float* out0 = slot_data + (size_t)y * cols;
+        float* out1 = out0 + plane;
+        float* out2 = out1 + plane;
+        for (int x = 0; x < cols; x++, pixel += 3) {
+            out0[x] = pixel[source[0]] * gain + offset[0];
+            out1[x] = pixel[source[1]] * gain + offset[1];
+            out2[x] = pixel[source[2]] * gain + offset[2];
+        }
+    }
+    return FMD_SUCCESS;
+}
+
+// Source pixel pair and blend weight of output position d for a bilinear
+// resize of length src to dst, with cv::resize's pixel centers
+static void bilinear_tap(int src, int dst, int d, int* first, int* second, float* weight) {
+    double position = (d + 0.5) * src / dst - 0.5;
+    int index = (int)floor(position);
+    float w = (float)(position - index);
+    if (index < 0) {
+        index = 0;
+        w = 0.0f;
+    }
+    if (index >= src - 1) {
+        index = src - 1;
+        w = 0.0f;
+    }
+    *first = index;
+    *second = std::min(index + 1, src - 1);
+    *weight = w;
+}
+
+// Crop a face with padding, resize it bilinearly to the tensor's height and
+// width and write it normalized into one slot, in one pass that reads the
+// frame in place: no ROI copy, no resized crop and no float image
+int crop_face_into_tensor(const cv::Mat& frame, const face_detection_t* face, int padding,
+                          cv::Mat& tensor, int slot, double scale, const cv::Scalar& mean, bool swap_rb) {
+    if (frame.empty() || frame.type() != CV_8UC3 || !face || !is_tensor_slot(tensor, slot) ||
+        tensor.size[3] > TENSOR_MAX_WIDTH) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    int x = std::max(0, face->x - padding);
+    int y = std::max(0, face->y - padding);
+    int width = std::min(frame.cols - x, face->width + 2 * padding);
+    int height = std::min(frame.rows - y, face->height + 2 * padding);
+    if (width <= 0 || height <= 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    int rows = tensor.size[2];
+    int cols = tensor.size[3];
+    size_t plane = (size_t)rows * cols;
+    float* slot_data = tensor.ptr<float>(slot);
+    
+    int source[3];
+    float gain;
+    float offset[3];
+    tensor_normalization(scale, mean, swap_rb, source, &gain, offset);
+    
+    // Column taps as byte offsets into a frame row
+    int left[TENSOR_MAX_WIDTH];
+    int right[TENSOR_MAX_WIDTH];
+    float x_weight[TENSOR_MAX_WIDTH];
+    for (int dx = 0; dx < cols; dx++) {
+        bilinear_tap(width, cols, dx, &left[dx], &right[dx], &x_weight[dx]);
+        left[dx] = (x + left[dx]) * 3;
+        right[dx] = (x + right[dx]) * 3;
+    }
+    
+    for (int dy = 0; dy < rows; dy++) {
+        int top_row;
+        int bottom_row;
+        float y_weight;
+        bilinear_tap(height, rows, dy, &top_row, &bottom_row, &y_weight);
+        
+        const uchar* top = frame.ptr<uchar>(y + top_row);
+        const uchar* bottom = frame.ptr<uchar>(y + bottom_row);
+        float* out[3];
+        out[0] = slot_data + (size_t)dy * cols;
+        out[1] = out[0] + plane;
+        out[2] = out[1] + plane;
+        
+        for (int dx = 0; dx < cols; dx++) {
+            const uchar* top_left = top + left[dx];
+            const uchar* top_right = top + right[dx];
+            const uchar* bottom_left = bottom + left[dx];
+            const uchar* bottom_right = bottom + right[dx];
+            float wx = x_weight[dx];
+            for (int c = 0; c < 3; c++) {
+                int s = source[c];
+                float upper = top_left[s] + (top_right[s] - top_left[s]) * wx;
+                float lower = bottom_left[s] + (bottom_right[s] - bottom_left[s]) * wx;
+                out[c][dx] = (upper + (lower - upper) * y_weight) * gain + offset[c];
+            }
+        }
+    }
+    return FMD_SUCCESS;
+}
+
 // Extract region of interest
 int extract_roi(const cv::Mat& input, cv::Mat& output, const roi_t* roi) {
     if (input.empty() || !roi || !roi->valid) {
@@ -326,6 +471,65 @@ int crop_face_region(const cv::Mat& input, cv::Mat& output, const face_detection
     }
 }
 
+// Crop and resize a face region without cloning the source ROI.
+// The output buffer is reused when it already has the target size.
+int crop_face_region_into(const cv::Mat& input, cv::Mat& output, const face_detection_t* face,
+                          int padding, int target_size) {
+    return crop_face_region_sized(input, output, face, padding, cv::Size(target_size, target_size));
+}
+
+// Same, for targets that are not square
+int crop_face_region_sized(const cv::Mat& input, cv::Mat& output, const face_detection_t* face,
+                           int padding, const cv::Size& target_size) {
+    if (input.empty() || !face || target_size.width <= 0 || target_size.height <= 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    try {
+        // Calculate padded rectangle
+        int x = std::max(0, face->x - padding);
+        int y = std::max(0, face->y - padding);
+        int width = std::min(input.cols - x, face->width + 2 * padding);
+        int height = std::min(input.rows - y, face->height + 2 * padding);
+        
+        if (width <= 0 || height <= 0) {
+            return FMD_ERROR_INVALID_ARGS;
+        }
+        
+        cv::resize(input(cv::Rect(x, y, width, height)), output, target_size);
+        return FMD_SUCCESS;
+    } catch (const cv::Exception& e) {
+        log_error("OpenCV exception while cropping face region: %s", e.what());
+        return FMD_ERROR_PROCESSING;
+    }
+}
+
+// Lower-middle part of a face where a mask is visible, in the same
+// coordinates as face_rect
+cv::Rect get_mouth_region(const cv::Rect& face_rect) {
+    int lower_y = face_rect.height * 0.65;
+    int lower_height = face_rect.height * 0.25;
+    cv::Rect lower_face(face_rect.width * 0.2, lower_y, face_rect.width * 0.6, lower_height);
+    lower_face &= cv::Rect(0, 0, face_rect.width, face_rect.height);
+    
+    return lower_face + face_rect.tl();
+}
+
+// Return a rows x cols view into a reusable backing buffer, growing the
+// buffer only when it is too small
+cv::Mat scratch_view(cv::Mat& backing, int rows, int cols, int type, uint64_t* reallocations) {
+    if (backing.empty() || backing.type() != type || backing.rows < rows || backing.cols < cols) {
+        int new_rows = (backing.type() == type) ? std::max(rows, backing.rows) : rows;
+        int new_cols = (backing.type() == type) ? std::max(cols, backing.cols) : cols;
+        backing.create(new_rows, new_cols, type);
+        if (reallocations) {
+            (*reallocations)++;
+        }
+    }
+    
+    return backing(cv::Rect(0, 0, cols, rows));
+}
+
 // Calculate image statistics
 int calculate_image_stats(const cv::Mat& image, image_stats_t* stats) {
     if (image.empty() || !stats) {
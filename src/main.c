@@ -2,6 +2,9 @@
 #include "config.h"
 #include "detection_engine.h"
 #include "image_processing.h"
+#include "pipeline.h"
+#include "offline_processing.h"
+#include "frame_source.h"
 
 // Global application state
 static app_state_t g_app_state = {0};
@@ -20,7 +23,7 @@ void print_usage(const char* program_name) {
     printf("Advanced Face Mask Detection System v%s\n\n", PROJECT_VERSION);
     printf("OPTIONS:\n");
     printf("  -c, --config FILE       Configuration file path (default: %s)\n", DEFAULT_CONFIG_FILE);
-    printf("  -i, --input FILE/INDEX  Input source (file path or camera index)\n");
+    printf("  -i, --input FILE/INDEX  Input source: video file, camera index, or image directory/glob\n");
     printf("  -o, --output FILE       Output video file path\n");
     printf("  -m, --model FILE        Face detection model file\n");
     printf("  -M, --mask-model FILE   Mask classification model file\n");
@@ -32,6 +35,35 @@ void print_usage(const char* program_name) {
     printf("  -q, --quiet             Disable preview window\n");
     printf("  -r, --real-time         Real-time processing mode\n");
     printf("  -S, --save-output       Save output video\n");
+    printf("  -w, --workers N         Number of detection worker threads (1-%d; 1 with --detect-interval,\n", MAX_DETECTION_WORKERS);
+    printf("                          --roi-search or --cache-age)\n");
+    printf("      --queue-depth N     Frames buffered between pipeline stages\n");
+    printf("      --writer-queue N    Rendered frames buffered for the output video encoder\n");
+    printf("      --writer-policy P   When encoding falls behind: block, oldest or newest\n");
+    printf("      --batch             Process the input video headless in parallel segments\n");
+    printf("      --segment-workers N Batch and image mode workers (0 = one per core)\n");
+    printf("      --results FILE      Batch results: per-frame for videos (default: INPUT.csv),\n");
+    printf("                          per-image for image inputs (default: %s)\n", DEFAULT_IMAGE_RESULTS_FILE);
+    printf("      --face-threads N    Threads classifying the faces of a frame (0 = one per core)\n");
+    printf("      --detect-interval N Run the face cascade every N frames, track in between\n");
+    printf("      --batch-size N      Most faces classified in one network pass (1-%d)\n", MAX_FACES);
+    printf("      --roi-search        Scan only around known faces and motion between full sweeps\n");
+    printf("      --full-sweep N      Scans between full-frame sweeps in ROI search mode\n");
+    printf("      --adaptive-scale    Learn cascade scale step and size range from observed faces\n");
+    printf("      --detect-size N     Run the cascade on a copy downscaled to N px on the long side\n");
+    printf("      --verify            Confirm downscaled detections at full resolution\n");
+    printf("      --drop-policy P     Real-time overload policy: oldest, newest or block\n");
+    printf("      --latency-budget MS Shed frames older than MS in real-time mode (0 = off)\n");
+    printf("      --cache-age N       Reuse a tracked face's mask result for up to N frames (0 = off)\n");
+    printf("      --mask-policy P     Mask classifier: auto, heuristic, network or cascade\n");
+    printf("      --escalation M      Cascade: send heuristic results with margin below M (0-1) to the network\n");
+    printf("      --precision P       Mask network precision: fp32 or int8\n");
+    printf("      --int8-model FILE   Quantized mask model used with --precision int8\n");
+    printf("      --raw-format F      Geometry of .raw/.bgr/.gray inputs: WxH:bgr|gray[@FPS]\n");
+    printf("      --result-stream F   Stream per-frame detections to file F\n");
+    printf("      --result-format F   Result stream encoding: binary or jsonl\n");
+    printf("      --record FILE       Record captured frames to FILE (.fmdv) for replay with -i\n");
+    printf("      --max-speed         Process every frame as fast as possible (no pacing or shedding)\n");
     printf("      --no-display        Disable GUI display\n");
     printf("      --log-file FILE     Log file path\n");
     printf("      --log-level LEVEL   Log level (debug, info, warning, error)\n");
@@ -44,6 +76,7 @@ void print_usage(const char* program_name) {
     printf("  %s -i video.mp4         # Process video file\n", program_name);
     printf("  %s -i 0 -o output.avi   # Record from camera to file\n", program_name);
     printf("  %s -c custom.conf -g    # Use custom config with GPU\n", program_name);
+    printf("  %s -i video.mp4 -w 4    # Process video with 4 detection workers\n", program_name);
     printf("\n");
 }
 
@@ -70,6 +103,33 @@ int parse_arguments(int argc, char* argv[], app_config_t* config) {
         {"quiet",          no_argument,       0, 'q'},
         {"real-time",      no_argument,       0, 'r'},
         {"save-output",    no_argument,       0, 'S'},
+        {"workers",        required_argument, 0, 'w'},
+        {"queue-depth",    required_argument, 0, 1003},
+        {"detect-interval", required_argument, 0, 1004},
+        {"batch-size",     required_argument, 0, 1005},
+        {"roi-search",     no_argument,       0, 1006},
+        {"full-sweep",     required_argument, 0, 1007},
+        {"adaptive-scale", no_argument,       0, 1008},
+        {"detect-size",    required_argument, 0, 1009},
+        {"verify",         no_argument,       0, 1010},
+        {"drop-policy",    required_argument, 0, 1011},
+        {"latency-budget", required_argument, 0, 1012},
+        {"cache-age",      required_argument, 0, 1013},
+        {"mask-policy",    required_argument, 0, 1014},
+        {"escalation",     required_argument, 0, 1015},
+        {"precision",      required_argument, 0, 1016},
+        {"int8-model",     required_argument, 0, 1017},
+        {"face-threads",   required_argument, 0, 1018},
+        {"writer-queue",   required_argument, 0, 1019},
+        {"writer-policy",  required_argument, 0, 1020},
+        {"batch",          no_argument,       0, 1021},
+        {"segment-workers", required_argument, 0, 1022},
+        {"results",        required_argument, 0, 1023},
+        {"raw-format",     required_argument, 0, 1024},
+        {"result-stream",  required_argument, 0, 1025},
+        {"result-format",  required_argument, 0, 1026},
+        {"record",         required_argument, 0, 1027},
+        {"max-speed",      no_argument,       0, 1028},
         {"no-display",     no_argument,       0, 1000},
         {"log-file",       required_argument, 0, 1001},
         {"log-level",      required_argument, 0, 1002},
@@ -77,11 +137,11 @@ int parse_arguments(int argc, char* argv[], app_config_t* config) {
         {"version",        no_argument,       0, 'V'},
         {0, 0, 0, 0}
     };
-
+    
     int c;
     int option_index = 0;
     
-    while ((c = getopt_long(argc, argv, "c:i:o:m:M:t:n:s:gvqrShV", long_options, &option_index)) != -1) {
+    while ((c = getopt_long(argc, argv, "c:i:o:m:M:t:n:s:gvqrSw:hV", long_options, &option_index)) != -1) {
         switch (c) {
             case 'c':
                 strncpy(config->config_path, optarg, MAX_PATH_LENGTH - 1);
@@ -146,9 +206,159 @@ int parse_arguments(int argc, char* argv[], app_config_t* config) {
             case 'S':
                 config->save_output = true;
                 break;
+            case 'w':
+                config->detection_workers = atoi(optarg);
+                if (config->detection_workers < 1 || config->detection_workers > MAX_DETECTION_WORKERS) {
+                    log_error("Worker count must be between 1 and %d", MAX_DETECTION_WORKERS);
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
             case 1000: // --no-display
                 config->show_preview = false;
                 break;
+            case 1003: // --queue-depth
+                config->queue_depth = atoi(optarg);
+                if (config->queue_depth < 1) {
+                    log_error("Queue depth must be at least 1");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1004: // --detect-interval
+                config->detection_interval = atoi(optarg);
+                if (config->detection_interval < 1) {
+                    log_error("Detection interval must be at least 1");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1005: // --batch-size
+                config->mask_batch_size = atoi(optarg);
+                if (config->mask_batch_size < 1 || config->mask_batch_size > MAX_FACES) {
+                    log_error("Batch size must be between 1 and %d", MAX_FACES);
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1006: // --roi-search
+                config->roi_search = true;
+                break;
+            case 1007: // --full-sweep
+                config->full_sweep_interval = atoi(optarg);
+                if (config->full_sweep_interval < 1) {
+                    log_error("Full sweep interval must be at least 1");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1008: // --adaptive-scale
+                config->adaptive_scale = true;
+                break;
+            case 1009: // --detect-size
+                config->detection_size = atoi(optarg);
+                if (config->detection_size < 0) {
+                    log_error("Detection size must not be negative");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1010: // --verify
+                config->verify_detections = true;
+                break;
+            case 1011: // --drop-policy
+                if (parse_drop_policy(optarg, &config->drop_policy) != FMD_SUCCESS) {
+                    log_error("Drop policy must be oldest, newest or block");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1012: // --latency-budget
+                config->latency_budget_ms = atoi(optarg);
+                if (config->latency_budget_ms < 0) {
+                    log_error("Latency budget must not be negative");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1013: // --cache-age
+                config->mask_cache_age = atoi(optarg);
+                if (config->mask_cache_age < 0) {
+                    log_error("Cache age must not be negative");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1014: // --mask-policy
+                if (parse_mask_policy(optarg, &config->mask_policy) != FMD_SUCCESS) {
+                    log_error("Mask policy must be auto, heuristic, network or cascade");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1015: // --escalation
+                config->escalation_margin = atof(optarg);
+                if (config->escalation_margin < 0.0f || config->escalation_margin > 1.0f) {
+                    log_error("Escalation margin must be between 0 and 1");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1016: // --precision
+                if (parse_model_precision(optarg, &config->model_precision) != FMD_SUCCESS) {
+                    log_error("Model precision must be fp32 or int8");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1017: // --int8-model
+                strncpy(config->int8_model_path, optarg, MAX_PATH_LENGTH - 1);
+                break;
+            case 1018: // --face-threads
+                config->face_threads = atoi(optarg);
+                if (config->face_threads < 0) {
+                    log_error("Face thread count must not be negative");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1019: // --writer-queue
+                config->writer_queue_depth = atoi(optarg);
+                if (config->writer_queue_depth < 1) {
+                    log_error("Writer queue depth must be at least 1");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1020: // --writer-policy
+                if (parse_drop_policy(optarg, &config->writer_policy) != FMD_SUCCESS) {
+                    log_error("Writer policy must be block, oldest or newest");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1021: // --batch
+                config->batch_mode = true;
+                break;
+            case 1022: // --segment-workers
+                config->segment_workers = atoi(optarg);
+                if (config->segment_workers < 0) {
+                    log_error("Segment worker count must not be negative");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1023: // --results
+                strncpy(config->results_path, optarg, MAX_PATH_LENGTH - 1);
+                break;
+            case 1024: { // --raw-format
+                raw_frame_format_t format;
+                if (parse_raw_frame_format(optarg, &format) != FMD_SUCCESS) {
+                    log_error("Raw format must look like 640x480:bgr or 640x480:gray@25");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                strncpy(config->raw_format, optarg, MAX_STRING_LENGTH - 1);
+                break;
+            }
+            case 1025: // --result-stream
+                strncpy(config->result_stream_path, optarg, MAX_PATH_LENGTH - 1);
+                break;
+            case 1026: // --result-format
+                if (parse_result_format(optarg, &config->result_format) != FMD_SUCCESS) {
+                    log_error("Result format must be binary or jsonl");
+                    return FMD_ERROR_INVALID_ARGS;
+                }
+                break;
+            case 1027: // --record
+                strncpy(config->record_path, optarg, MAX_PATH_LENGTH - 1);
+                break;
+            case 1028: // --max-speed
+                config->real_time = false;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 1;
@@ -184,49 +394,33 @@ int initialize_application(app_state_t* state, const app_config_t* config) {
         return FMD_ERROR_MEMORY_ALLOCATION;
     }
     
-    // Load face detection cascade
-    if (!state->face_cascade.load(config->cascade_path)) {
-        log_error("Failed to load face cascade from: %s", config->cascade_path);
-        return FMD_ERROR_MODEL_LOAD;
-    }
-    log_info("Loaded face detection cascade: %s", config->cascade_path);
-    
-    // Load mask detection model if specified (optional)
-    if (strlen(config->model_path) > 0) {
-        try {
-            state->mask_net = cv::dnn::readNet(config->model_path);
-            if (state->mask_net.empty()) {
-                log_warning("Failed to load mask detection model: %s. Using heuristic-based detection.", config->model_path);
-            } else {
-                // Set backend and target
-                if (config->use_gpu) {
-                    state->mask_net.setPreferableBackend(cv::dnn::DNN_BACKEND_CUDA);
-                    state->mask_net.setPreferableTarget(cv::dnn::DNN_TARGET_CUDA);
-                    log_info("Using GPU acceleration for mask detection");
-                } else {
-                    state->mask_net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-                    state->mask_net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
-                    log_info("Using CPU for mask detection");
-                }
-                
-                log_info("Loaded mask detection model: %s", config->model_path);
-            }
-        } catch (const cv::Exception& e) {
-            log_warning("OpenCV exception while loading model: %s. Using heuristic-based detection.", e.what());
-            // Clear the network so it will fall back to heuristic detection
-            state->mask_net = cv::dnn::Net();
-        }
-    } else {
-        log_info("No mask detection model specified. Using heuristic-based detection.");
+    // Load face cascade and mask network
+    int result = load_detection_models(state, config);
+    if (result != FMD_SUCCESS) {
+        return result;
     }
     
-    // Initialize camera or video file
-    if (strlen(config->input_path) > 0) {
+    // Initialize camera or video file; image inputs are read by the image mode
+    state->source = new frame_source_t();
+    init_frame_source(state->source);
+    if (is_image_input(config->input_path)) {
+        log_info("Image input: %s", config->input_path);
+    } else if (is_mapped_frame_file(config->input_path)) {
+        // Raw or Y4M frames, read from a memory mapping without decoding
+        if (open_mapped_frame_source(state->source, config->input_path, config->raw_format) != FMD_SUCCESS) {
+            log_error("Failed to map frame file: %s", config->input_path);
+            return FMD_ERROR_CAMERA_INIT;
+        }
+        cv::Size size = frame_source_size(state->source);
+        log_info("Mapped frame file: %s (%dx%d, %lld frames)", config->input_path, size.width, size.height,
+                 (long long)frame_source_frame_count(state->source));
+    } else if (strlen(config->input_path) > 0) {
         // Video file input
         if (!state->cap.open(config->input_path)) {
             log_error("Failed to open video file: %s", config->input_path);
             return FMD_ERROR_CAMERA_INIT;
         }
+        attach_capture_frame_source(state->source, &state->cap);
         log_info("Opened video file: %s", config->input_path);
     } else {
         // Camera input
@@ -240,16 +434,18 @@ int initialize_application(app_state_t* state, const app_config_t* config) {
         state->cap.set(cv::CAP_PROP_FRAME_WIDTH, 640);
         state->cap.set(cv::CAP_PROP_FRAME_HEIGHT, 480);
         state->cap.set(cv::CAP_PROP_FPS, 30);
+        attach_capture_frame_source(state->source, &state->cap);
     }
     
-    // Initialize video writer if output is requested
-    if (config->save_output && strlen(config->output_path) > 0) {
+    // Initialize video writer if output is requested (batch mode writes results
+    // only, image mode saves annotated copies into the output directory)
+    if (config->save_output && !config->batch_mode && frame_source_is_open(state->source) &&
+        strlen(config->output_path) > 0) {
         int fourcc = cv::VideoWriter::fourcc('X', 'V', 'I', 'D');
-        double fps = state->cap.get(cv::CAP_PROP_FPS);
+        double fps = frame_source_fps(state->source);
         if (fps <= 0) fps = 30.0;
         
-        cv::Size frame_size((int)state->cap.get(cv::CAP_PROP_FRAME_WIDTH),
-                           (int)state->cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+        cv::Size frame_size = frame_source_size(state->source);
         
         if (!state->writer.open(config->output_path, fourcc, fps, frame_size)) {
             log_warning("Failed to initialize video writer for: %s", config->output_path);
@@ -273,7 +469,15 @@ void cleanup_application(app_state_t* state) {
     
     state->running = false;
     
-    // Release video capture and writer
+    // Release the frame source, video capture and writer. The last frame may
+    // be a view into a mapped source, so it goes first.
+    state->current_frame.release();
+    if (state->source) {
+        close_frame_source(state->source);
+        delete state->source;
+        state->source = NULL;
+    }
+    
     if (state->cap.isOpened()) {
         state->cap.release();
     }
@@ -282,6 +486,12 @@ void cleanup_application(app_state_t* state) {
         state->writer.release();
     }
     
+    // Release detection models
+    if (state->engine) {
+        print_detection_engine_stats(state->engine, "main");
+    }
+    unload_detection_models(state);
+    
     // Cleanup threading primitives
     pthread_cond_destroy(&state->frame_cond);
     pthread_mutex_destroy(&state->frame_mutex);
@@ -292,88 +502,27 @@ void cleanup_application(app_state_t* state) {
     log_info("Application cleanup completed");
 }
 
-// Main processing loop
+// Main processing loop: capture, detection and render run as pipeline stages
 int run_detection_loop(app_state_t* state) {
-    cv::Mat frame;
-    double start_time, end_time;
-    double fps_timer = get_current_time();
-    int frame_count = 0;
+    detection_pipeline_t pipeline;
     
     log_info("Starting detection loop...");
     
-    while (state->running && g_running) {
-        start_time = get_current_time();
-        
-        // Capture frame
-        if (!state->cap.read(frame)) {
-            if (strlen(state->config.input_path) > 0) {
-                // End of video file
-                log_info("Reached end of video file");
-                break;
-            } else {
-                log_error("Failed to capture frame from camera");
-                continue;
-            }
-        }
-        
-        if (frame.empty()) {
-            continue;
-        }
-        
-        // Detect faces
-        int face_count = detect_faces(state, frame, state->detections, MAX_FACES);
-        state->detection_count = face_count;
-        
-        // Draw detections on frame
-        if (face_count > 0) {
-            draw_detections(frame, state->detections, face_count);
-        }
-        
-        // Display frame
-        if (state->config.show_preview) {
-            cv::imshow("Face Mask Detection", frame);
-            
-            int key = cv::waitKey(1) & 0xFF;
-            if (key == 27 || key == 'q') { // ESC or 'q' to quit
-                log_info("User requested quit");
-                break;
-            }
-            
-            // Handle other key inputs
-            handle_key_input(state, key);
-        }
-        
-        // Save frame if recording
-        if (state->writer.isOpened()) {
-            state->writer.write(frame);
-        }
-        
-        // Calculate FPS
-        end_time = get_current_time();
-        frame_count++;
-        state->frame_count++;
-        
-        if (end_time - fps_timer >= 1.0) {
-            state->fps = frame_count / (end_time - fps_timer);
-            if (state->config.verbose) {
-                log_info("FPS: %.2f, Faces detected: %d", state->fps, face_count);
-            }
-            frame_count = 0;
-            fps_timer = end_time;
-        }
-        
-        // Real-time processing delay
-        if (state->config.real_time) {
-            double processing_time = end_time - start_time;
-            double target_frame_time = 1.0 / 30.0; // 30 FPS
-            if (processing_time < target_frame_time) {
-                usleep((target_frame_time - processing_time) * 1000000);
-            }
-        }
+    int result = init_detection_pipeline(&pipeline, state);
+    if (result != FMD_SUCCESS) {
+        log_error("Failed to initialize detection pipeline");
+        return result;
     }
     
+    result = run_detection_pipeline(&pipeline);
+    
+    if (state->config.verbose) {
+        print_pipeline_stats(&pipeline);
+    }
+    cleanup_detection_pipeline(&pipeline);
+    
     log_info("Detection loop completed. Processed %llu frames", state->frame_count);
-    return FMD_SUCCESS;
+    return result;
 }
 
 // Main function
@@ -418,8 +567,14 @@ int main(int argc, char* argv[]) {
         return result;
     }
     
-    // Run main processing loop
-    result = run_detection_loop(&g_app_state);
+    // Run main processing loop, the still-image mode or the segment-parallel batch mode
+    if (is_image_input(config.input_path)) {
+        result = run_image_processing(&g_app_state);
+    } else if (config.batch_mode) {
+        result = run_offline_processing(&g_app_state);
+    } else {
+        result = run_detection_loop(&g_app_state);
+    }
     
     // Cleanup and exit
     cleanup_application(&g_app_state);
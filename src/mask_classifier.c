@@ -0,0 +1,368 @@
+#include "detection_engine.h"
+#include "face_mask_detector.h"
+#include "thread_pool.h"
+
+// Fixed confidence reported for heuristic decisions
+#define HEURISTIC_CONFIDENCE 0.80f
+
+// Simple reliable heuristic on the fused ROI features
+static int classify_simple(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* face,
+                           mask_status_t* status, float* confidence, float* margin) {
+    *status = classify_mask_simple_reliable_scratch(frame, face, &engine->scratch, margin);
+    *confidence = HEURISTIC_CONFIDENCE;
+    return FMD_SUCCESS;
+}
+
+// Skin-ratio heuristic; reads the frame's feature plane while one is built,
+// otherwise builds the engine's plane over this face, reusing its buffers,
+// and drops it again so no later frame mistakes it for its own
+static int classify_heuristic(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* face,
+                              mask_status_t* status, float* confidence, float* margin) {
+    feature_plane_t* plane = &engine->scratch.plane;
+    bool frame_plane = plane->valid;
+    *status = classify_mask_heuristic_plane(frame, face, plane, margin);
+    if (!frame_plane) {
+        plane->valid = false;
+    }
+    *confidence = HEURISTIC_CONFIDENCE;
+    return FMD_SUCCESS;
+}
+
+// The network's two outputs are softmax probabilities, so the gap between
+// them is the margin
+static float network_margin(mask_status_t status, float confidence) {
+    if (status == MASK_STATUS_UNKNOWN) return 0.0f;
+    
+    return std::max(0.0f, std::min(1.0f, 2.0f * confidence - 1.0f));
+}
+
+static int classify_network_batch(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* faces, int count,
+                                  mask_status_t* statuses, float* confidences, float* margins) {
+    int result = classify_mask_batch_dnn(engine, frame, faces, count, statuses, confidences);
+    for (int i = 0; margins && i < count; i++) {
+        margins[i] = network_margin(statuses[i], confidences[i]);
+    }
+    return result;
+}
+
+// A single face is a batch of one: it goes straight from the frame into
+// the input tensor like the others
+static int classify_network(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* face,
+                            mask_status_t* status, float* confidence, float* margin) {
+    return classify_network_batch(engine, frame, face, 1, status, confidence, margin);
+}
+
+// Built-in classifiers
+static const mask_classifier_t g_mask_classifiers[] = {
+    {"simple", false, classify_simple, NULL},
+    {"heuristic", false, classify_heuristic, NULL},
+    {"dnn", true, classify_network, classify_network_batch}
+};
+
+const mask_classifier_t* find_mask_classifier(const char* name) {
+    if (!name) return NULL;
+    
+    for (size_t i = 0; i < sizeof(g_mask_classifiers) / sizeof(g_mask_classifiers[0]); i++) {
+        if (strcmp(g_mask_classifiers[i].name, name) == 0) {
+            return &g_mask_classifiers[i];
+        }
+    }
+    return NULL;
+}
+
+// Install any pair of classifiers: primary decides every face, fallback
+// (optional) takes over the faces the primary is unsure of
+int set_mask_classifiers(detection_engine_t* engine, const mask_classifier_t* primary,
+                         const mask_classifier_t* fallback, float escalation_margin) {
+    if (!engine || !primary || !primary->classify || (fallback && !fallback->classify) ||
+        escalation_margin < 0.0f || escalation_margin > 1.0f) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    bool have_network = !engine->mask_network.empty();
+    if ((primary->needs_network || (fallback && fallback->needs_network)) && !have_network) {
+        return FMD_ERROR_MODEL_LOAD;
+    }
+    
+    engine->primary_classifier = primary;
+    engine->fallback_classifier = fallback;
+    engine->escalation_margin = escalation_margin;
+    return FMD_SUCCESS;
+}
+
+// Pick the built-in classifiers for a policy. Policies that need the network
+// fall back to the heuristic when no model is loaded.
+int set_mask_policy(detection_engine_t* engine, mask_policy_t policy, float escalation_margin) {
+    if (!engine) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    const mask_classifier_t* heuristic = find_mask_classifier("simple");
+    const mask_classifier_t* network = find_mask_classifier("dnn");
+    bool have_network = !engine->mask_network.empty();
+    
+    if (!have_network && (policy == MASK_POLICY_NETWORK || policy == MASK_POLICY_CASCADE)) {
+        log_warning("Mask policy '%s' needs a mask model; using the heuristic", mask_policy_to_string(policy));
+    }
+    
+    int result;
+    switch (policy) {
+        case MASK_POLICY_HEURISTIC:
+            result = set_mask_classifiers(engine, heuristic, NULL, escalation_margin);
+            break;
+        case MASK_POLICY_CASCADE:
+            result = set_mask_classifiers(engine, heuristic, have_network ? network : NULL, escalation_margin);
+            break;
+        case MASK_POLICY_AUTO:
+        case MASK_POLICY_NETWORK:
+            result = set_mask_classifiers(engine, have_network ? network : heuristic, NULL, escalation_margin);
+            break;
+        default:
+            return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (result == FMD_SUCCESS) {
+        engine->mask_policy = policy;
+    }
+    return result;
+}
+
+// Run one classifier over many faces, in one batch when it supports it.
+// margins may be NULL when nobody needs them.
+static int run_classifier_serial(detection_engine_t* engine, const mask_classifier_t* classifier, const cv::Mat& frame,
+                                 const face_detection_t* faces, int count, mask_status_t* statuses,
+                                 float* confidences, float* margins) {
+    if (classifier->classify_batch &&
+        classifier->classify_batch(engine, frame, faces, count, statuses, confidences, margins) == FMD_SUCCESS) {
+        return FMD_SUCCESS;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        statuses[i] = MASK_STATUS_UNKNOWN;
+        confidences[i] = 0.0f;
+        float* margin = margins ? &margins[i] : NULL;
+        if (margin) {
+            *margin = 0.0f;
+        }
+        classifier->classify(engine, frame, &faces[i], &statuses[i], &confidences[i], margin);
+    }
+    return FMD_SUCCESS;
+}
+
+// Faces of one frame shared out to the face pool. Task i covers faces
+// [i * chunk, (i + 1) * chunk).
+typedef struct {
+    detection_engine_t* engine;
+    const mask_classifier_t* classifier;
+    const cv::Mat* frame;
+    const face_detection_t* faces;
+    int count;
+    int chunk;
+    mask_status_t* statuses;
+    float* confidences;
+    float* margins;
+} face_job_t;
+
+// Pool task: classify a chunk of faces with the calling thread's engine
+static void classify_face_task(void* context, int task_index, int worker_index) {
+    face_job_t* job = (face_job_t*)context;
+    detection_engine_t* worker_engine = job->engine->face_engines[worker_index];
+    int start = task_index * job->chunk;
+    int count = std::min(job->chunk, job->count - start);
+    
+    run_classifier_serial(worker_engine, job->classifier, *job->frame, job->faces + start, count,
+                          job->statuses + start, job->confidences + start,
+                          job->margins ? job->margins + start : NULL);
+}
+
+// Classify faces on the face pool when there is one, otherwise in place.
+// Per-face classifiers get one task per face, which idle threads take as
+// they finish; batch classifiers get one batch per thread, each on its own
+// copy of the network.
+static int run_classifier(detection_engine_t* engine, const mask_classifier_t* classifier, const cv::Mat& frame,
+                          const face_detection_t* faces, int count, mask_status_t* statuses, float* confidences,
+                          float* margins) {
+    if (!engine->face_pool || count < 2) {
+        return run_classifier_serial(engine, classifier, frame, faces, count, statuses, confidences, margins);
+    }
+    
+    int threads = engine->face_pool->thread_count;
+    face_job_t job;
+    job.engine = engine;
+    job.classifier = classifier;
+    job.frame = &frame;
+    job.faces = faces;
+    job.count = count;
+    job.chunk = classifier->classify_batch ? (count + threads - 1) / threads : 1;
+    job.statuses = statuses;
+    job.confidences = confidences;
+    job.margins = margins;
+    
+    int result = thread_pool_run(engine->face_pool, classify_face_task, &job, (count + job.chunk - 1) / job.chunk);
+    if (result != FMD_SUCCESS) {
+        return run_classifier_serial(engine, classifier, frame, faces, count, statuses, confidences, margins);
+    }
+    return FMD_SUCCESS;
+}
+
+// Stop the face pool and free its engines
+void release_face_workers(detection_engine_t* engine) {
+    if (!engine) return;
+    
+    if (engine->face_pool) {
+        cleanup_thread_pool(engine->face_pool);
+        delete engine->face_pool;
+        engine->face_pool = NULL;
+    }
+    
+    for (int i = 0; i < MAX_POOL_THREADS; i++) {
+        if (engine->face_engines[i]) {
+            cleanup_detection_engine(engine->face_engines[i]);
+            delete engine->face_engines[i];
+            engine->face_engines[i] = NULL;
+        }
+    }
+}
+
+// Classify the faces of a frame on thread_count threads (0 = one per core,
+// 1 = on the calling thread). Each thread gets its own engine, with its
+// own scratch buffers and network, loaded and warmed up here rather than
+// on the first crowded frame.
+int set_face_threads(detection_engine_t* engine, int thread_count) {
+    if (!engine || thread_count < 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (thread_count == 0) {
+        thread_count = get_default_thread_count(MAX_POOL_THREADS);
+    }
+    thread_count = std::min(thread_count, MAX_POOL_THREADS);
+    if (thread_count == engine->face_threads) {
+        return FMD_SUCCESS;
+    }
+    
+    release_face_workers(engine);
+    engine->face_threads = thread_count;
+    if (thread_count < 2) {
+        return FMD_SUCCESS;
+    }
+    
+    for (int i = 0; i < thread_count; i++) {
+        detection_engine_t* clone = new detection_engine_t();
+        int result = clone_detection_engine(clone, engine);
+        if (result != FMD_SUCCESS) {
+            log_error("Failed to load models for face worker %d", i);
+            cleanup_detection_engine(clone);
+            delete clone;
+            release_face_workers(engine);
+            engine->face_threads = 1;
+            return result;
+        }
+        engine->face_engines[i] = clone;
+    }
+    
+    engine->face_pool = new thread_pool_t();
+    int result = init_thread_pool(engine->face_pool, thread_count);
+    if (result != FMD_SUCCESS) {
+        delete engine->face_pool;
+        engine->face_pool = NULL;
+        release_face_workers(engine);
+        engine->face_threads = 1;
+        return result;
+    }
+    
+    log_info("Classifying faces on %d threads", thread_count);
+    return FMD_SUCCESS;
+}
+
+// Build the frame's feature plane over the mouth regions of the faces when
+// they are numerous and close enough together for one conversion of their
+// bounding box to beat converting each region on its own
+static void prepare_feature_plane(detection_engine_t* engine, const cv::Mat& frame,
+                                  const face_detection_t* faces, int count) {
+    feature_plane_t* plane = &engine->scratch.plane;
+    plane->valid = false;
+    if (count < FEATURE_PLANE_MIN_FACES) return;
+    
+    const cv::Rect frame_rect(0, 0, frame.cols, frame.rows);
+    cv::Rect bounds;
+    double region_pixels = 0.0;
+    for (int i = 0; i < count; i++) {
+        cv::Rect face_rect(faces[i].x, faces[i].y, faces[i].width, faces[i].height);
+        cv::Rect region = get_mouth_region(face_rect & frame_rect);
+        if (region.empty()) continue;
+        
+        bounds = bounds.empty() ? region : (bounds | region);
+        region_pixels += region.area();
+    }
+    
+    if (bounds.empty() || bounds.area() > FEATURE_PLANE_MAX_OVERHEAD * region_pixels) return;
+    build_feature_plane(frame, bounds, plane);
+}
+
+// Classify faces of one frame under the engine's policy: the primary
+// classifier decides all of them, then the faces whose margin is below
+// escalation_margin are classified again by the fallback, in one batch
+int classify_faces(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* faces, int count,
+                   mask_status_t* statuses, float* confidences) {
+    if (!engine || frame.empty() || (!faces && count > 0) || !statuses || !confidences) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    const mask_classifier_t* primary = engine->primary_classifier;
+    const mask_classifier_t* fallback = engine->fallback_classifier;
+    if (!primary) {
+        return FMD_ERROR_MODEL_LOAD;
+    }
+    
+    count = std::min(count, MAX_FACES);
+    if (count == 0) {
+        return FMD_SUCCESS;
+    }
+    
+    // The heuristics share one conversion of the frame; it describes this
+    // call's frame only. Face workers have their own scratch, so a plane is
+    // only built when faces are classified on this thread.
+    if (!primary->needs_network && !engine->face_pool) {
+        prepare_feature_plane(engine, frame, faces, count);
+    }
+    
+    // Margins only matter when there is a fallback to escalate to; without
+    // one the classifiers can skip the work that only refines the margin
+    float margins[MAX_FACES];
+    run_classifier(engine, primary, frame, faces, count, statuses, confidences, fallback ? margins : NULL);
+    engine->scratch.plane.valid = false;
+    engine->metrics.classified_faces += count;
+    
+    if (!fallback) {
+        return FMD_SUCCESS;
+    }
+    
+    face_detection_t escalated[MAX_FACES];
+    int slots[MAX_FACES];
+    int escalated_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (margins[i] < engine->escalation_margin) {
+            escalated[escalated_count] = faces[i];
+            slots[escalated_count++] = i;
+        }
+    }
+    
+    if (escalated_count == 0) {
+        return FMD_SUCCESS;
+    }
+    engine->metrics.escalated_faces += escalated_count;
+    
+    mask_status_t fallback_statuses[MAX_FACES];
+    float fallback_confidences[MAX_FACES];
+    run_classifier(engine, fallback, frame, escalated, escalated_count,
+                   fallback_statuses, fallback_confidences, NULL);
+    
+    // Keep the primary's answer where the fallback has none
+    for (int e = 0; e < escalated_count; e++) {
+        if (fallback_statuses[e] == MASK_STATUS_UNKNOWN) continue;
+        statuses[slots[e]] = fallback_statuses[e];
+        confidences[slots[e]] = fallback_confidences[e];
+    }
+    return FMD_SUCCESS;
+}
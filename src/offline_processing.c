@@ -0,0 +1,582 @@
+#include "offline_processing.h"
+#include "face_mask_detector.h"
+#include "detection_engine.h"
+#include "thread_pool.h"
+#include "image_processing.h"
+#include "frame_source.h"
+#include "result_stream.h"
+#include <sys/stat.h>
+#include <strings.h>
+
+// State shared by the segment tasks of one batch run
+typedef struct {
+    app_state_t* app;
+    const char* input_path;
+    double fps;
+    video_segment_t* segments;
+    // Detection state of each pool thread; index 0 is the application's
+    app_state_t* worker_states[MAX_POOL_THREADS];
+} offline_job_t;
+
+// Result of one still image, kept until the manifest is written in input order
+typedef struct {
+    bool processed;
+    int result;
+    int width;
+    int height;
+    std::vector<face_detection_t> faces;
+} image_result_t;
+
+// State shared by the image tasks of one directory run
+typedef struct {
+    app_state_t* app;
+    const std::vector<cv::String>* paths;
+    image_result_t* results;
+    // Annotated copies are saved here when set
+    const char* annotated_dir;
+    // Time each pool thread spent decoding and detecting
+    double decode_time[MAX_POOL_THREADS];
+    double detect_time[MAX_POOL_THREADS];
+    app_state_t* worker_states[MAX_POOL_THREADS];
+} image_job_t;
+
+// Split frame_count frames into contiguous segments, about SEGMENTS_PER_WORKER
+// per worker but none shorter than MIN_SEGMENT_FRAMES. The last segment reads
+// to the end of the file, since reported lengths can be short or long.
+// Returns the segment count.
+int plan_video_segments(int64_t frame_count, int worker_count, video_segment_t* segments, int max_segments) {
+    if (!segments || worker_count <= 0 || max_segments <= 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    int count = 1;
+    if (frame_count > 0) {
+        int64_t wanted = (int64_t)worker_count * SEGMENTS_PER_WORKER;
+        int64_t longest = std::max((int64_t)1, frame_count / MIN_SEGMENT_FRAMES);
+        count = (int)std::min(std::min(wanted, longest), (int64_t)max_segments);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        video_segment_t* segment = &segments[i];
+        segment->index = i;
+        if (frame_count > 0) {
+            segment->start_frame = frame_count * i / count;
+            segment->end_frame = i + 1 < count ? frame_count * (i + 1) / count : INT64_MAX;
+        } else {
+            // Unknown length (some containers do not report it): read it all
+            segment->start_frame = 0;
+            segment->end_frame = INT64_MAX;
+        }
+        segment->part_path[0] = '\0';
+        segment->frames_processed = 0;
+        segment->faces_detected = 0;
+        segment->busy_time = 0.0;
+        segment->result = FMD_SUCCESS;
+    }
+    
+    return count;
+}
+
+// Columns shared by the video and image results: faces,with_mask,without_mask,detections
+// where detections is a quoted list of "x y width height status confidence"
+// entries separated by ';'
+static void write_face_columns(FILE* file, const face_detection_t* faces, int count) {
+    int with_mask = 0;
+    int without_mask = 0;
+    for (int i = 0; i < count; i++) {
+        if (faces[i].mask_status == MASK_STATUS_WITH_MASK) with_mask++;
+        else if (faces[i].mask_status == MASK_STATUS_WITHOUT_MASK) without_mask++;
+    }
+    
+    fprintf(file, "%d,%d,%d,\"", count, with_mask, without_mask);
+    for (int i = 0; i < count; i++) {
+        const face_detection_t* face = &faces[i];
+        fprintf(file, "%s%d %d %d %d %s %.3f", i > 0 ? ";" : "",
+                face->x, face->y, face->width, face->height,
+                mask_status_code(face->mask_status), face->mask_confidence);
+    }
+    fprintf(file, "\"\n");
+}
+
+// One video results row: frame,timestamp_ms followed by the face columns
+int write_detection_row(FILE* file, int64_t frame, double timestamp_ms, const face_detection_t* faces, int count) {
+    if (!file || count < 0 || (count > 0 && !faces)) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    fprintf(file, "%lld,%.1f,", (long long)frame, timestamp_ms);
+    write_face_columns(file, faces, count);
+    return ferror(file) ? FMD_ERROR_PROCESSING : FMD_SUCCESS;
+}
+
+// Detection state for each pool thread: the application's for worker 0 and
+// freshly loaded models for the others, because cascades and networks cannot
+// be shared between threads. Returns how many workers could be set up.
+static int load_worker_states(app_state_t* app, app_state_t** states, int count) {
+    states[0] = app;
+    int loaded = 1;
+    for (int i = 1; i < count; i++) {
+        app_state_t* state = new app_state_t();
+        memcpy(&state->config, &app->config, sizeof(app_config_t));
+        state->running = true;
+        if (load_detection_models(state, &app->config) != FMD_SUCCESS) {
+            log_warning("Failed to load models for offline worker %d; using %d worker(s)", i, loaded);
+            delete state;
+            break;
+        }
+        states[i] = state;
+        loaded++;
+    }
+    return loaded;
+}
+
+// Print the extra workers' statistics and release them
+static void release_worker_states(app_state_t** states, int count) {
+    for (int i = 1; i < count; i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "offline worker %d", i);
+        print_detection_engine_stats(states[i]->engine, label);
+        unload_detection_models(states[i]);
+        delete states[i];
+        states[i] = NULL;
+    }
+}
+
+// Worker count for the offline modes: segment_workers, or one per core
+static int offline_worker_count(const app_config_t* config) {
+    return config->segment_workers > 0 ? std::min(config->segment_workers, MAX_POOL_THREADS)
+                                       : get_default_thread_count(MAX_POOL_THREADS);
+}
+
+// Run one segment on its own capture, writing its rows to the part file
+static int process_segment(const offline_job_t* job, app_state_t* state, video_segment_t* segment) {
+    FILE* part = fopen(segment->part_path, "w");
+    if (!part) {
+        log_error("Could not create %s", segment->part_path);
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    
+    // Mapped raw/Y4M inputs are cheap to reopen: the pages are shared
+    frame_source_t source;
+    init_frame_source(&source);
+    if (open_frame_source(&source, job->input_path, job->app->config.raw_format) != FMD_SUCCESS) {
+        log_error("Segment %d: could not open %s", segment->index, job->input_path);
+        fclose(part);
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    try {
+        if (segment->start_frame > 0 && seek_frame_source(&source, segment->start_frame) != FMD_SUCCESS) {
+            log_error("Segment %d: could not seek to frame %lld", segment->index, (long long)segment->start_frame);
+            close_frame_source(&source);
+            fclose(part);
+            return FMD_ERROR_PROCESSING;
+        }
+        // Some containers seek to the nearest keyframe instead; rows numbered
+        // from start_frame would then be off, so the segment fails instead
+        int64_t position = frame_source_position(&source);
+        if (position != segment->start_frame) {
+            log_error("Segment %d: seek to frame %lld landed on frame %lld", segment->index,
+                      (long long)segment->start_frame, (long long)position);
+            close_frame_source(&source);
+            fclose(part);
+            return FMD_ERROR_PROCESSING;
+        }
+    } catch (const cv::Exception& e) {
+        log_error("Segment %d: %s", segment->index, e.what());
+        close_frame_source(&source);
+        fclose(part);
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    // Tracks and motion history of the previous segment do not apply here
+    reset_stream_state(state->engine);
+    
+    int result = FMD_SUCCESS;
+    cv::Mat frame;
+    face_detection_t faces[MAX_FACES];
+    for (int64_t index = segment->start_frame; index < segment->end_frame && job->app->running; index++) {
+        double start = get_current_time();
+        try {
+            // The last segment ends wherever the file does
+            if (!read_frame_source(&source, frame) || frame.empty()) break;
+        } catch (const cv::Exception& e) {
+            log_error("Segment %d: read failed at frame %lld: %s", segment->index, (long long)index, e.what());
+            result = FMD_ERROR_PROCESSING;
+            break;
+        }
+        
+        int count = detect_faces(state, frame, faces, MAX_FACES);
+        result = write_detection_row(part, index, index * 1000.0 / job->fps, faces, count);
+        if (result != FMD_SUCCESS) {
+            log_error("Segment %d: could not write %s", segment->index, segment->part_path);
+            break;
+        }
+        
+        segment->frames_processed++;
+        segment->faces_detected += count;
+        segment->busy_time += get_current_time() - start;
+    }
+    
+    // Mapped frames are views: drop the last one before unmapping
+    frame.release();
+    close_frame_source(&source);
+    if (fclose(part) != 0 && result == FMD_SUCCESS) {
+        result = FMD_ERROR_PROCESSING;
+    }
+    return result;
+}
+
+// Thread pool task: one segment on the calling pool thread's detection state
+static void segment_task(void* context, int task_index, int worker_index) {
+    offline_job_t* job = (offline_job_t*)context;
+    video_segment_t* segment = &job->segments[task_index];
+    segment->result = process_segment(job, job->worker_states[worker_index], segment);
+}
+
+// Append the part files to the results in segment order and remove them
+static int merge_segment_results(const char* results_path, video_segment_t* segments, int count) {
+    FILE* output = fopen(results_path, "w");
+    if (!output) {
+        log_error("Could not create %s", results_path);
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    
+    fprintf(output, "%s\n", DETECTION_RESULTS_HEADER);
+    
+    int result = FMD_SUCCESS;
+    char buffer[65536];
+    for (int i = 0; i < count; i++) {
+        FILE* part = fopen(segments[i].part_path, "r");
+        if (!part) continue;
+        
+        size_t bytes;
+        while ((bytes = fread(buffer, 1, sizeof(buffer), part)) > 0) {
+            if (fwrite(buffer, 1, bytes, output) != bytes) {
+                result = FMD_ERROR_PROCESSING;
+                break;
+            }
+        }
+        fclose(part);
+        remove(segments[i].part_path);
+    }
+    
+    if (fclose(output) != 0) {
+        result = FMD_ERROR_PROCESSING;
+    }
+    return result;
+}
+
+// Headless batch mode: process the input video in parallel segments, each
+// worker with its own capture and detection engine, and write the per-frame
+// results in frame order
+int run_offline_processing(app_state_t* app) {
+    if (!app || !app->engine) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    const app_config_t* config = &app->config;
+    if (strlen(config->input_path) == 0) {
+        log_error("Batch mode needs an input video file");
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    if (config->save_output) {
+        log_warning("Batch mode writes detection results only; output video is not recorded");
+    }
+    
+    char results_path[MAX_PATH_LENGTH];
+    if (strlen(config->results_path) > 0) {
+        strncpy(results_path, config->results_path, MAX_PATH_LENGTH - 1);
+        results_path[MAX_PATH_LENGTH - 1] = '\0';
+    } else {
+        snprintf(results_path, sizeof(results_path), "%s.csv", config->input_path);
+    }
+    
+    int64_t frame_count = 0;
+    double fps = 0.0;
+    try {
+        frame_count = frame_source_frame_count(app->source);
+        fps = frame_source_fps(app->source);
+    } catch (const cv::Exception& e) {
+        log_warning("Could not query the input length: %s", e.what());
+    }
+    if (fps <= 0.0) {
+        fps = 30.0;
+    }
+    
+    int worker_count = offline_worker_count(config);
+    std::vector<video_segment_t> segments(MAX_VIDEO_SEGMENTS);
+    int segment_count = plan_video_segments(frame_count, worker_count, &segments[0], MAX_VIDEO_SEGMENTS);
+    if (segment_count <= 0) {
+        return FMD_ERROR_PROCESSING;
+    }
+    worker_count = std::min(worker_count, segment_count);
+    for (int i = 0; i < segment_count; i++) {
+        snprintf(segments[i].part_path, MAX_PATH_LENGTH, "%s.part%03d", results_path, i);
+    }
+    
+    offline_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.app = app;
+    job.input_path = config->input_path;
+    job.fps = fps;
+    job.segments = &segments[0];
+    
+    int loaded = load_worker_states(app, job.worker_states, worker_count);
+    log_info("Batch processing %s: %lld frames in %d segment(s) on %d worker(s)",
+             config->input_path, (long long)frame_count, segment_count, loaded);
+    
+    thread_pool_t pool;
+    double start = get_current_time();
+    int result = init_thread_pool(&pool, loaded);
+    if (result == FMD_SUCCESS) {
+        result = thread_pool_run(&pool, segment_task, &job, segment_count);
+        cleanup_thread_pool(&pool);
+    }
+    double elapsed = get_current_time() - start;
+    
+    release_worker_states(job.worker_states, loaded);
+    
+    uint64_t frames = 0;
+    uint64_t faces = 0;
+    double busy_time = 0.0;
+    for (int i = 0; i < segment_count; i++) {
+        const video_segment_t* segment = &segments[i];
+        frames += segment->frames_processed;
+        faces += segment->faces_detected;
+        busy_time += segment->busy_time;
+        if (segment->result != FMD_SUCCESS) {
+            log_error("Segment %d (frames %lld-%lld) failed after %llu frames", segment->index,
+                      (long long)segment->start_frame, (long long)segment->end_frame,
+                      (unsigned long long)segment->frames_processed);
+            if (result == FMD_SUCCESS) result = segment->result;
+        }
+    }
+    
+    int merge_result = merge_segment_results(results_path, &segments[0], segment_count);
+    if (result == FMD_SUCCESS) {
+        result = merge_result;
+    }
+    
+    if (!app->running) {
+        log_warning("Batch processing interrupted; %s holds the frames processed so far", results_path);
+    }
+    
+    double video_seconds = frames / fps;
+    log_info("Batch processing: %llu frames, %llu faces in %.1f s (%.1f fps, %.1fx real time, %.0f%% worker utilization)",
+             (unsigned long long)frames, (unsigned long long)faces, elapsed,
+             elapsed > 0.0 ? frames / elapsed : 0.0,
+             elapsed > 0.0 ? video_seconds / elapsed : 0.0,
+             elapsed > 0.0 && loaded > 0 ? 100.0 * busy_time / (elapsed * loaded) : 0.0);
+    log_info("Results written to %s", results_path);
+    return result;
+}
+
+// JPEG and PNG files only; other files in the directory are skipped
+static bool has_image_extension(const char* path) {
+    const char* extension = strrchr(path, '.');
+    if (!extension) return false;
+    
+    return strcasecmp(extension, ".jpg") == 0 || strcasecmp(extension, ".jpeg") == 0 ||
+           strcasecmp(extension, ".png") == 0;
+}
+
+// Whether the input names still images: a directory, a glob pattern or a
+// single JPEG/PNG file
+bool is_image_input(const char* path) {
+    if (!path || strlen(path) == 0) return false;
+    
+    if (strpbrk(path, "*?[") || has_image_extension(path)) return true;
+    
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// Image files of a directory or glob pattern, sorted by path
+int collect_image_paths(const char* input, std::vector<cv::String>& paths) {
+    if (!input || strlen(input) == 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    paths.clear();
+    cv::String pattern(input);
+    if (!strpbrk(input, "*?[")) {
+        struct stat info;
+        if (stat(input, &info) != 0) {
+            return FMD_ERROR_FILE_NOT_FOUND;
+        }
+        if (!S_ISDIR(info.st_mode)) {
+            paths.push_back(pattern);
+            return FMD_SUCCESS;
+        }
+        pattern += "/*";
+    }
+    
+    std::vector<cv::String> matches;
+    try {
+        cv::glob(pattern, matches, false);
+    } catch (const cv::Exception& e) {
+        log_error("Could not list %s: %s", input, e.what());
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    
+    for (size_t i = 0; i < matches.size(); i++) {
+        if (has_image_extension(matches[i].c_str())) {
+            paths.push_back(matches[i]);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths.empty() ? FMD_ERROR_FILE_NOT_FOUND : FMD_SUCCESS;
+}
+
+// Thread pool task: decode one image and detect on the pool thread's state.
+// Each thread decodes its next image while the others run detection, so
+// decoding overlaps detection without a separate stage.
+static void image_task(void* context, int task_index, int worker_index) {
+    image_job_t* job = (image_job_t*)context;
+    image_result_t* image_result = &job->results[task_index];
+    if (!job->app->running) return;
+    
+    const char* path = (*job->paths)[task_index].c_str();
+    double start = get_current_time();
+    cv::Mat image;
+    image_result->processed = true;
+    image_result->result = load_image(path, image);
+    double decoded = get_current_time();
+    job->decode_time[worker_index] += decoded - start;
+    if (image_result->result != FMD_SUCCESS) return;
+    
+    // Stills are unrelated, so nothing carries over from the previous image
+    app_state_t* state = job->worker_states[worker_index];
+    reset_stream_state(state->engine);
+    
+    face_detection_t faces[MAX_FACES];
+    int count = detect_faces(state, image, faces, MAX_FACES);
+    job->detect_time[worker_index] += get_current_time() - decoded;
+    
+    image_result->width = image.cols;
+    image_result->height = image.rows;
+    image_result->faces.assign(faces, faces + count);
+    
+    if (job->annotated_dir) {
+        const char* name = strrchr(path, '/');
+        char output_path[MAX_PATH_LENGTH];
+        snprintf(output_path, sizeof(output_path), "%s/%s", job->annotated_dir, name ? name + 1 : path);
+        draw_detections(image, faces, count);
+        save_image(output_path, image);
+    }
+}
+
+// Manifest of the image run, one row per input in path order
+static int write_image_manifest(const char* results_path, const std::vector<cv::String>& paths,
+                                const image_result_t* results) {
+    FILE* file = fopen(results_path, "w");
+    if (!file) {
+        log_error("Could not create %s", results_path);
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    
+    fprintf(file, "%s\n", IMAGE_RESULTS_HEADER);
+    for (size_t i = 0; i < paths.size(); i++) {
+        const image_result_t* image_result = &results[i];
+        const char* status = !image_result->processed ? "skipped" :
+                             image_result->result != FMD_SUCCESS ? "unreadable" : "ok";
+        
+        fputc('"', file);
+        for (const char* c = paths[i].c_str(); *c; c++) {
+            if (*c == '"') fputc('"', file);
+            fputc(*c, file);
+        }
+        fprintf(file, "\",%s,%d,%d,", status, image_result->width, image_result->height);
+        write_face_columns(file, image_result->faces.empty() ? NULL : &image_result->faces[0],
+                           (int)image_result->faces.size());
+    }
+    
+    int result = ferror(file) ? FMD_ERROR_PROCESSING : FMD_SUCCESS;
+    if (fclose(file) != 0) {
+        result = FMD_ERROR_PROCESSING;
+    }
+    return result;
+}
+
+// Still-image mode: detect faces and masks in every JPEG/PNG of a directory
+// or glob pattern across worker threads and write a results manifest
+int run_image_processing(app_state_t* app) {
+    if (!app || !app->engine) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    const app_config_t* config = &app->config;
+    std::vector<cv::String> paths;
+    if (collect_image_paths(config->input_path, paths) != FMD_SUCCESS) {
+        log_error("No JPEG or PNG images found in %s", config->input_path);
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    
+    const char* results_path = strlen(config->results_path) > 0 ? config->results_path : DEFAULT_IMAGE_RESULTS_FILE;
+    
+    std::vector<image_result_t> results(paths.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        results[i].processed = false;
+        results[i].result = FMD_SUCCESS;
+        results[i].width = 0;
+        results[i].height = 0;
+    }
+    
+    image_job_t job;
+    job.app = app;
+    job.paths = &paths;
+    job.results = &results[0];
+    job.annotated_dir = config->save_output && strlen(config->output_path) > 0 ? config->output_path : NULL;
+    memset(job.decode_time, 0, sizeof(job.decode_time));
+    memset(job.detect_time, 0, sizeof(job.detect_time));
+    memset(job.worker_states, 0, sizeof(job.worker_states));
+    
+    int worker_count = std::min(offline_worker_count(config), (int)paths.size());
+    int loaded = load_worker_states(app, job.worker_states, worker_count);
+    log_info("Processing %zu image(s) from %s on %d worker(s)", paths.size(), config->input_path, loaded);
+    
+    thread_pool_t pool;
+    double start = get_current_time();
+    int result = init_thread_pool(&pool, loaded);
+    if (result == FMD_SUCCESS) {
+        result = thread_pool_run(&pool, image_task, &job, (int)paths.size());
+        cleanup_thread_pool(&pool);
+    }
+    double elapsed = get_current_time() - start;
+    
+    release_worker_states(job.worker_states, loaded);
+    
+    int written = write_image_manifest(results_path, paths, &results[0]);
+    if (result == FMD_SUCCESS) {
+        result = written;
+    }
+    
+    int processed = 0;
+    int unreadable = 0;
+    uint64_t faces = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!results[i].processed) continue;
+        
+        processed++;
+        if (results[i].result != FMD_SUCCESS) unreadable++;
+        faces += results[i].faces.size();
+    }
+    double decode_time = 0.0;
+    double detect_time = 0.0;
+    for (int i = 0; i < loaded; i++) {
+        decode_time += job.decode_time[i];
+        detect_time += job.detect_time[i];
+    }
+    
+    if (!app->running) {
+        log_warning("Image processing interrupted after %d of %zu images", processed, paths.size());
+    }
+    log_info("Image processing: %d images (%d unreadable), %llu faces in %.2f s (%.1f images/s; "
+             "decode %.1f ms, detect %.1f ms per image)",
+             processed, unreadable, (unsigned long long)faces, elapsed,
+             elapsed > 0.0 ? processed / elapsed : 0.0,
+             processed > 0 ? 1000.0 * decode_time / processed : 0.0,
+             processed > 0 ? 1000.0 * detect_time / processed : 0.0);
+    log_info("Results written to %s", results_path);
+    return result;
+}
@@ -0,0 +1,710 @@
+#include "pipeline.h"
+#include "face_mask_detector.h"
+#include "detection_engine.h"
+#include "frame_source.h"
+
+// Initialize a bounded frame queue
+int init_frame_queue(frame_queue_t* queue, int capacity) {
+    if (!queue || capacity <= 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    queue->slots = new frame_packet_t[capacity];
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = false;
+    queue->max_depth = 0;
+    queue->policy = DROP_POLICY_BLOCK;
+    queue->dropped = 0;
+    queue->tickets = 0;
+    queue->pushes = 0;
+    queue->depth_sum = 0;
+    
+    if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
+        delete[] queue->slots;
+        queue->slots = NULL;
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    if (pthread_cond_init(&queue->not_empty, NULL) != 0) {
+        pthread_mutex_destroy(&queue->mutex);
+        delete[] queue->slots;
+        queue->slots = NULL;
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    if (pthread_cond_init(&queue->not_full, NULL) != 0) {
+        pthread_cond_destroy(&queue->not_empty);
+        pthread_mutex_destroy(&queue->mutex);
+        delete[] queue->slots;
+        queue->slots = NULL;
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    return FMD_SUCCESS;
+}
+
+// Release queue storage
+void cleanup_frame_queue(frame_queue_t* queue) {
+    if (!queue || !queue->slots) return;
+    
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->mutex);
+    
+    delete[] queue->slots;
+    queue->slots = NULL;
+    queue->capacity = 0;
+    queue->count = 0;
+}
+
+// Push a packet. When the queue is full the drop policy decides: block until
+// there is space, evict the oldest packet, or discard this one.
+// The queue takes over the packet's frame buffer.
+int frame_queue_push(frame_queue_t* queue, frame_packet_t* packet) {
+    if (!queue || !packet) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    pthread_mutex_lock(&queue->mutex);
+    
+    if (queue->count == queue->capacity && !queue->closed) {
+        if (queue->policy == DROP_POLICY_OLDEST) {
+            queue->slots[queue->head].frame.release();
+            queue->head = (queue->head + 1) % queue->capacity;
+            queue->count--;
+            queue->dropped++;
+        } else if (queue->policy == DROP_POLICY_NEWEST) {
+            queue->dropped++;
+            pthread_mutex_unlock(&queue->mutex);
+            packet->frame.release();
+            return FMD_SUCCESS;
+        }
+    }
+    
+    while (queue->count == queue->capacity && !queue->closed) {
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+    }
+    
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->mutex);
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    int tail = (queue->head + queue->count) % queue->capacity;
+    queue->slots[tail] = *packet;
+    queue->count++;
+    if (queue->count > queue->max_depth) {
+        queue->max_depth = queue->count;
+    }
+    queue->pushes++;
+    queue->depth_sum += queue->count;
+    
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+    
+    // Drop the producer's reference so the next capture cannot overwrite this frame
+    packet->frame.release();
+    return FMD_SUCCESS;
+}
+
+// Pop a packet, blocking while the queue is empty.
+// Fails once the queue is closed and drained.
+int frame_queue_pop(frame_queue_t* queue, frame_packet_t* packet) {
+    if (!queue || !packet) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    pthread_mutex_lock(&queue->mutex);
+    
+    while (queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    
+    if (queue->count == 0) {
+        pthread_mutex_unlock(&queue->mutex);
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    frame_packet_t* slot = &queue->slots[queue->head];
+    *packet = *slot;
+    packet->ticket = queue->tickets++;
+    slot->frame.release();
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+    return FMD_SUCCESS;
+}
+
+// Close the queue: producers fail immediately, consumers drain what is left
+void frame_queue_close(frame_queue_t* queue) {
+    if (!queue || !queue->slots) return;
+    
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+int frame_queue_size(frame_queue_t* queue) {
+    if (!queue || !queue->slots) return 0;
+    
+    pthread_mutex_lock(&queue->mutex);
+    int count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+// Capture stage: read frames and feed the detection workers
+static void* capture_thread_main(void* arg) {
+    detection_pipeline_t* pipeline = (detection_pipeline_t*)arg;
+    app_state_t* state = pipeline->app;
+    frame_packet_t packet;
+    uint64_t sequence = 0;
+    
+    // Files are paced to their own frame rate in real-time mode, recordings
+    // to their capture timestamps; cameras pace themselves because read()
+    // waits for the next frame
+    double frame_interval = 0.0;
+    if (pipeline->pace_to_source) {
+        double fps = frame_source_fps(state->source);
+        frame_interval = 1.0 / (fps > 0.0 ? fps : 30.0);
+    }
+    double time_origin = std::max(0.0, frame_source_next_time(state->source));
+    pipeline->stream_start = get_current_time();
+    uint64_t source_frame = 0;
+    
+    while (state->running && !pipeline->stop_requested) {
+        double recorded_time = frame_source_next_time(state->source);
+        if (frame_interval > 0.0) {
+            double offset = recorded_time >= 0.0 ? recorded_time - time_origin : source_frame * frame_interval;
+            double due_time = pipeline->stream_start + offset;
+            double now = get_current_time();
+            
+            // More than a frame behind: skip without decoding to catch up
+            if (now > due_time + frame_interval && pipeline->capture_queue.policy != DROP_POLICY_BLOCK) {
+                if (!grab_frame_source(state->source)) {
+                    log_info("Reached end of video file");
+                    break;
+                }
+                source_frame++;
+                pipeline->frames_skipped++;
+                continue;
+            }
+            if (now < due_time) {
+                usleep((useconds_t)((due_time - now) * 1000000));
+            }
+            source_frame++;
+        }
+        
+        double start_time = get_current_time();
+        
+        if (!read_frame_source(state->source, packet.frame)) {
+            if (strlen(state->config.input_path) > 0) {
+                // End of video file
+                log_info("Reached end of video file");
+                break;
+            } else {
+                log_error("Failed to capture frame from camera");
+                continue;
+            }
+        }
+        
+        if (packet.frame.empty()) {
+            continue;
+        }
+        
+        packet.sequence = sequence++;
+        packet.capture_time = get_current_time();
+        packet.source_time = recorded_time >= 0.0 ? recorded_time : packet.capture_time - pipeline->stream_start;
+        packet.detection_count = 0;
+        
+        // Recorded before the capture queue can shed it, so a replay sees
+        // every frame the camera delivered
+        if (pipeline->recording) {
+            record_frame(&pipeline->recorder, packet.frame, packet.source_time);
+        }
+        
+        pipeline->capture_time += get_current_time() - start_time;
+        pipeline->frames_captured++;
+        
+        if (frame_queue_push(&pipeline->capture_queue, &packet) != FMD_SUCCESS) {
+            break;
+        }
+    }
+    
+    frame_queue_close(&pipeline->capture_queue);
+    return NULL;
+}
+
+// Writer stage: encode rendered frames so the render stage never waits on
+// the encoder. Frames still queued when the queue closes are written too.
+static void* writer_thread_main(void* arg) {
+    detection_pipeline_t* pipeline = (detection_pipeline_t*)arg;
+    app_state_t* state = pipeline->app;
+    frame_packet_t packet;
+    
+    while (frame_queue_pop(&pipeline->writer_queue, &packet) == FMD_SUCCESS) {
+        double start_time = get_current_time();
+        state->writer.write(packet.frame);
+        packet.frame.release();
+        pipeline->write_time += get_current_time() - start_time;
+        pipeline->frames_written++;
+    }
+    
+    return NULL;
+}
+
+// Detection stage: detect and classify faces, then pass results on in order
+static void* detection_worker_main(void* arg) {
+    detection_worker_t* worker = (detection_worker_t*)arg;
+    detection_pipeline_t* pipeline = worker->pipeline;
+    frame_packet_t packet;
+    
+    while (frame_queue_pop(&pipeline->capture_queue, &packet) == FMD_SUCCESS) {
+        double start_time = get_current_time();
+        
+        // A frame already past its latency budget is not worth detecting
+        bool stale = pipeline->latency_budget > 0.0 &&
+                     start_time - packet.capture_time > pipeline->latency_budget;
+        if (stale) {
+            packet.frame.release();
+        } else {
+            packet.detection_count = detect_faces(worker->state, packet.frame, packet.detections, MAX_FACES);
+            worker->busy_time += get_current_time() - start_time;
+            worker->frames_processed++;
+        }
+        
+        // Wait until every earlier frame has been handed to the render stage
+        pthread_mutex_lock(&pipeline->order_mutex);
+        while (pipeline->next_render_sequence != packet.ticket) {
+            pthread_cond_wait(&pipeline->order_cond, &pipeline->order_mutex);
+        }
+        if (stale) {
+            pipeline->frames_stale++;
+        }
+        pthread_mutex_unlock(&pipeline->order_mutex);
+        
+        int result = stale ? FMD_SUCCESS : frame_queue_push(&pipeline->render_queue, &packet);
+        
+        pthread_mutex_lock(&pipeline->order_mutex);
+        pipeline->next_render_sequence++;
+        pthread_cond_broadcast(&pipeline->order_cond);
+        pthread_mutex_unlock(&pipeline->order_mutex);
+        
+        if (result != FMD_SUCCESS) {
+            break;
+        }
+    }
+    
+    // The last worker out closes the render queue
+    pthread_mutex_lock(&pipeline->order_mutex);
+    pipeline->active_workers--;
+    bool last_worker = (pipeline->active_workers == 0);
+    pthread_mutex_unlock(&pipeline->order_mutex);
+    
+    if (last_worker) {
+        frame_queue_close(&pipeline->render_queue);
+    }
+    
+    return NULL;
+}
+
+// Tracks, keyframe cadence, search windows and the mask cache live in each
+// worker's engine and only hold up when one engine sees every frame. Workers
+// take frames in arrival order, so these options need a single worker.
+int validate_pipeline_workers(const app_config_t* config) {
+    if (!config) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    if (config->detection_workers <= 1) {
+        return FMD_SUCCESS;
+    }
+    
+    if (config->detection_interval > 1 || config->roi_search || config->mask_cache_age > 0) {
+        log_error("--detect-interval above 1, --roi-search and --cache-age follow faces from frame to frame "
+                  "and need a single detection worker (got %d workers)", config->detection_workers);
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    return FMD_SUCCESS;
+}
+
+// Initialize pipeline queues and per-worker models
+int init_detection_pipeline(detection_pipeline_t* pipeline, app_state_t* app) {
+    if (!pipeline || !app) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (validate_pipeline_workers(&app->config) != FMD_SUCCESS) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    pipeline->app = app;
+    pipeline->worker_count = std::max(1, std::min(app->config.detection_workers, MAX_DETECTION_WORKERS));
+    pipeline->active_workers = 0;
+    pipeline->capture_started = false;
+    pipeline->stop_requested = false;
+    pipeline->next_render_sequence = 0;
+    pipeline->frames_captured = 0;
+    pipeline->frames_skipped = 0;
+    pipeline->frames_stale = 0;
+    pipeline->frames_rendered = 0;
+    pipeline->capture_time = 0.0;
+    pipeline->render_time = 0.0;
+    pipeline->latency_sum = 0.0;
+    pipeline->latency_max = 0.0;
+    pipeline->writer_started = false;
+    pipeline->frames_written = 0;
+    pipeline->write_time = 0.0;
+    pipeline->results_open = false;
+    pipeline->stream_start = get_current_time();
+    pipeline->recording = false;
+    
+    // Offline runs process every frame; only real-time runs shed load
+    bool real_time = app->config.real_time;
+    pipeline->latency_budget = real_time ? std::max(0, app->config.latency_budget_ms) / 1000.0 : 0.0;
+    pipeline->pace_to_source = real_time && strlen(app->config.input_path) > 0;
+    
+    // A full-speed replay must give the same detections on every run, but
+    // tracks live in each worker's engine and workers take frames as they
+    // free up, so the replay runs on one worker
+    if (!real_time && pipeline->worker_count > 1 && frame_source_next_time(app->source) >= 0.0) {
+        log_info("Replaying the recording with one detection worker so every run gives the same detections");
+        pipeline->worker_count = 1;
+    }
+    
+    int queue_depth = std::max(1, app->config.queue_depth);
+    
+    if (init_frame_queue(&pipeline->capture_queue, queue_depth) != FMD_SUCCESS) {
+        log_error("Failed to initialize capture queue");
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    pipeline->capture_queue.policy = real_time ? app->config.drop_policy : DROP_POLICY_BLOCK;
+    
+    if (init_frame_queue(&pipeline->render_queue, queue_depth) != FMD_SUCCESS) {
+        log_error("Failed to initialize render queue");
+        cleanup_frame_queue(&pipeline->capture_queue);
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    if (init_frame_queue(&pipeline->writer_queue, std::max(1, app->config.writer_queue_depth)) != FMD_SUCCESS) {
+        log_error("Failed to initialize writer queue");
+        cleanup_frame_queue(&pipeline->render_queue);
+        cleanup_frame_queue(&pipeline->capture_queue);
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    pipeline->writer_queue.policy = app->config.writer_policy;
+    
+    const char* results_path = app->config.result_stream_path;
+    if (strlen(results_path) > 0 && app->config.result_format != RESULT_FORMAT_NONE) {
+        if (open_result_stream(&pipeline->results, results_path, app->config.result_format, 0) == FMD_SUCCESS) {
+            pipeline->results_open = true;
+            log_info("Streaming detections to %s (%s)", results_path,
+                     result_format_to_string(app->config.result_format));
+        } else {
+            log_warning("Detections will not be streamed to %s", results_path);
+        }
+    }
+    
+    const char* record_path = app->config.record_path;
+    if (strlen(record_path) > 0) {
+        if (open_frame_recorder(&pipeline->recorder, record_path, frame_source_fps(app->source)) == FMD_SUCCESS) {
+            pipeline->recording = true;
+            log_info("Recording captured frames to %s", record_path);
+        } else {
+            log_warning("Captured frames will not be recorded to %s", record_path);
+        }
+    }
+    
+    pthread_mutex_init(&pipeline->order_mutex, NULL);
+    pthread_cond_init(&pipeline->order_cond, NULL);
+    
+    // The first worker reuses the application's models, the rest load their own
+    // because cascades and networks cannot be shared between threads
+    for (int i = 0; i < pipeline->worker_count; i++) {
+        detection_worker_t* worker = &pipeline->workers[i];
+        worker->index = i;
+        worker->pipeline = pipeline;
+        worker->started = false;
+        worker->frames_processed = 0;
+        worker->busy_time = 0.0;
+        
+        if (i == 0) {
+            worker->state = app;
+            worker->owns_state = false;
+            continue;
+        }
+        
+        worker->state = new app_state_t();
+        worker->owns_state = true;
+        memcpy(&worker->state->config, &app->config, sizeof(app_config_t));
+        worker->state->running = true;
+        
+        int result = load_detection_models(worker->state, &app->config);
+        if (result != FMD_SUCCESS) {
+            log_error("Failed to load models for detection worker %d", i);
+            pipeline->worker_count = i + 1;
+            cleanup_detection_pipeline(pipeline);
+            return result;
+        }
+    }
+    
+    log_info("Initialized detection pipeline: %d worker(s), queue depth %d, drop policy %s, latency budget %.0f ms",
+             pipeline->worker_count, queue_depth, drop_policy_to_string(pipeline->capture_queue.policy),
+             pipeline->latency_budget * 1000.0);
+    return FMD_SUCCESS;
+}
+
+// Stop all stages and wait for their threads
+static void stop_detection_pipeline(detection_pipeline_t* pipeline) {
+    pipeline->stop_requested = true;
+    frame_queue_close(&pipeline->capture_queue);
+    frame_queue_close(&pipeline->render_queue);
+    
+    if (pipeline->capture_started) {
+        pthread_join(pipeline->capture_thread, NULL);
+        pipeline->capture_started = false;
+    }
+    
+    for (int i = 0; i < pipeline->worker_count; i++) {
+        if (pipeline->workers[i].started) {
+            pthread_join(pipeline->workers[i].thread, NULL);
+            pipeline->workers[i].started = false;
+        }
+    }
+    
+    // Rendering has stopped; let the writer drain its queue before joining
+    if (pipeline->writer_started) {
+        int pending = frame_queue_size(&pipeline->writer_queue);
+        frame_queue_close(&pipeline->writer_queue);
+        if (pending > 0) {
+            log_info("Flushing %d queued frame(s) to the output video", pending);
+        }
+        pthread_join(pipeline->writer_thread, NULL);
+        pipeline->writer_started = false;
+    }
+}
+
+// Run the pipeline; the render stage runs on the calling thread
+// because HighGUI must be driven from the main thread
+int run_detection_pipeline(detection_pipeline_t* pipeline) {
+    if (!pipeline || !pipeline->app) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    app_state_t* state = pipeline->app;
+    
+    for (int i = 0; i < pipeline->worker_count; i++) {
+        detection_worker_t* worker = &pipeline->workers[i];
+        pipeline->active_workers++;
+        if (pthread_create(&worker->thread, NULL, detection_worker_main, worker) != 0) {
+            log_error("Failed to start detection worker %d", i);
+            pipeline->active_workers--;
+            stop_detection_pipeline(pipeline);
+            return FMD_ERROR_PROCESSING;
+        }
+        worker->started = true;
+    }
+    
+    if (pthread_create(&pipeline->capture_thread, NULL, capture_thread_main, pipeline) != 0) {
+        log_error("Failed to start capture thread");
+        stop_detection_pipeline(pipeline);
+        return FMD_ERROR_PROCESSING;
+    }
+    pipeline->capture_started = true;
+    
+    if (state->writer.isOpened()) {
+        if (pthread_create(&pipeline->writer_thread, NULL, writer_thread_main, pipeline) != 0) {
+            log_error("Failed to start writer thread");
+            stop_detection_pipeline(pipeline);
+            return FMD_ERROR_PROCESSING;
+        }
+        pipeline->writer_started = true;
+    }
+    
+    frame_packet_t packet;
+    double fps_timer = get_current_time();
+    int frame_count = 0;
+    
+    while (frame_queue_pop(&pipeline->render_queue, &packet) == FMD_SUCCESS) {
+        double start_time = get_current_time();
+        
+        // Frames that went stale waiting for the render stage are shed too
+        if (pipeline->latency_budget > 0.0 && start_time - packet.capture_time > pipeline->latency_budget) {
+            pthread_mutex_lock(&pipeline->order_mutex);
+            pipeline->frames_stale++;
+            pthread_mutex_unlock(&pipeline->order_mutex);
+            continue;
+        }
+        
+        // Draw detections on frame. Frames of a mapped file are views into
+        // the mapping, where every page drawn on would stay resident as a
+        // private copy until the file is closed, so those are drawn on a copy.
+        if (packet.detection_count > 0) {
+            if (frame_source_shares_frames(state->source)) {
+                packet.frame = packet.frame.clone();
+            }
+            draw_detections(packet.frame, packet.detections, packet.detection_count);
+        }
+        
+        // Publish the latest result for other readers of the application state
+        pthread_mutex_lock(&state->frame_mutex);
+        state->current_frame = packet.frame;
+        memcpy(state->detections, packet.detections, sizeof(face_detection_t) * packet.detection_count);
+        state->detection_count = packet.detection_count;
+        state->frame_count++;
+        pthread_cond_broadcast(&state->frame_cond);
+        pthread_mutex_unlock(&state->frame_mutex);
+        
+        if (pipeline->results_open) {
+            write_result_record(&pipeline->results, packet.sequence, packet.source_time * 1000.0,
+                                packet.detections, packet.detection_count);
+        }
+        
+        // Display frame
+        bool quit = false;
+        if (state->config.show_preview) {
+            cv::imshow("Face Mask Detection", packet.frame);
+            
+            int key = cv::waitKey(1) & 0xFF;
+            if (key == 27 || key == 'q') { // ESC or 'q' to quit
+                log_info("User requested quit");
+                quit = true;
+            } else {
+                // Handle other key inputs
+                handle_key_input(state, key);
+            }
+        }
+        
+        // Hand the frame to the writer; with the block policy this waits
+        // for space when encoding falls behind
+        if (!quit && pipeline->writer_started) {
+            frame_queue_push(&pipeline->writer_queue, &packet);
+        }
+        
+        // Calculate FPS
+        double end_time = get_current_time();
+        double latency = end_time - packet.capture_time;
+        pipeline->render_time += end_time - start_time;
+        pipeline->latency_sum += latency;
+        pipeline->latency_max = std::max(pipeline->latency_max, latency);
+        pipeline->frames_rendered++;
+        frame_count++;
+        
+        if (end_time - fps_timer >= 1.0) {
+            state->fps = frame_count / (end_time - fps_timer);
+            if (state->config.verbose) {
+                log_info("FPS: %.2f, Faces detected: %d, Latency: %.1f ms",
+                         state->fps, packet.detection_count, latency * 1000.0);
+            }
+            frame_count = 0;
+            fps_timer = end_time;
+        }
+        
+        if (quit) {
+            break;
+        }
+    }
+    
+    stop_detection_pipeline(pipeline);
+    return FMD_SUCCESS;
+}
+
+// Release pipeline resources
+void cleanup_detection_pipeline(detection_pipeline_t* pipeline) {
+    if (!pipeline) return;
+    
+    stop_detection_pipeline(pipeline);
+    
+    for (int i = 0; i < pipeline->worker_count; i++) {
+        detection_worker_t* worker = &pipeline->workers[i];
+        if (worker->owns_state && worker->state) {
+            char label[32];
+            snprintf(label, sizeof(label), "worker %d", i);
+            if (worker->state->engine) {
+                print_detection_engine_stats(worker->state->engine, label);
+            }
+            unload_detection_models(worker->state);
+            delete worker->state;
+        }
+        worker->state = NULL;
+        worker->owns_state = false;
+    }
+    
+    if (pipeline->results_open) {
+        close_result_stream(&pipeline->results);
+        pipeline->results_open = false;
+    }
+    
+    if (pipeline->recording) {
+        close_frame_recorder(&pipeline->recorder);
+        log_info("Recorded %llu frames (%.1f MB) to %s", (unsigned long long)pipeline->recorder.frames,
+                 pipeline->recorder.bytes / (1024.0 * 1024.0), pipeline->app->config.record_path);
+        pipeline->recording = false;
+    }
+    
+    pthread_cond_destroy(&pipeline->order_cond);
+    pthread_mutex_destroy(&pipeline->order_mutex);
+    cleanup_frame_queue(&pipeline->writer_queue);
+    cleanup_frame_queue(&pipeline->render_queue);
+    cleanup_frame_queue(&pipeline->capture_queue);
+}
+
+// Print per-stage timing so the slowest stage is easy to spot
+void print_pipeline_stats(const detection_pipeline_t* pipeline) {
+    if (!pipeline) return;
+    
+    log_info("=== Pipeline Statistics ===");
+    log_info("Capture: %llu frames, %.2f ms/frame, max queue depth %d/%d",
+             (unsigned long long)pipeline->frames_captured,
+             pipeline->frames_captured > 0 ? pipeline->capture_time * 1000.0 / pipeline->frames_captured : 0.0,
+             pipeline->capture_queue.max_depth, pipeline->capture_queue.capacity);
+    
+    for (int i = 0; i < pipeline->worker_count; i++) {
+        const detection_worker_t* worker = &pipeline->workers[i];
+        log_info("Detect[%d]: %llu frames, %.2f ms/frame", i,
+                 (unsigned long long)worker->frames_processed,
+                 worker->frames_processed > 0 ? worker->busy_time * 1000.0 / worker->frames_processed : 0.0);
+    }
+    
+    log_info("Render: %llu frames, %.2f ms/frame, max queue depth %d/%d",
+             (unsigned long long)pipeline->frames_rendered,
+             pipeline->frames_rendered > 0 ? pipeline->render_time * 1000.0 / pipeline->frames_rendered : 0.0,
+             pipeline->render_queue.max_depth, pipeline->render_queue.capacity);
+    if (pipeline->writer_queue.pushes > 0) {
+        log_info("Writer: %llu frames, %.2f ms/frame, queue depth %.1f average, %d/%d max, %llu dropped (%s)",
+                 (unsigned long long)pipeline->frames_written,
+                 pipeline->frames_written > 0 ? pipeline->write_time * 1000.0 / pipeline->frames_written : 0.0,
+                 (double)pipeline->writer_queue.depth_sum / pipeline->writer_queue.pushes,
+                 pipeline->writer_queue.max_depth, pipeline->writer_queue.capacity,
+                 (unsigned long long)pipeline->writer_queue.dropped,
+                 drop_policy_to_string(pipeline->writer_queue.policy));
+    }
+    if (pipeline->results_open && pipeline->results.records > 0) {
+        double record_time = pipeline->results.write_time / pipeline->results.records;
+        log_info("Results: %llu records, %.1f us/frame (%.3f%% of a 60 FPS frame), %llu bytes in %llu writes",
+                 (unsigned long long)pipeline->results.records,
+                 record_time * 1000000.0, record_time * 60.0 * 100.0,
+                 (unsigned long long)(pipeline->results.bytes + pipeline->results.used),
+                 (unsigned long long)pipeline->results.flushes);
+    }
+    if (pipeline->recording && pipeline->recorder.frames > 0) {
+        log_info("Recorder: %llu frames, %.2f ms/frame, %llu rejected",
+                 (unsigned long long)pipeline->recorder.frames,
+                 pipeline->recorder.write_time * 1000.0 / pipeline->recorder.frames,
+                 (unsigned long long)pipeline->recorder.rejected);
+    }
+    log_info("Dropped: %llu at capture (%s), %llu skipped in source, %llu over the latency budget",
+             (unsigned long long)pipeline->capture_queue.dropped,
+             drop_policy_to_string(pipeline->capture_queue.policy),
+             (unsigned long long)pipeline->frames_skipped,
+             (unsigned long long)pipeline->frames_stale);
+    log_info("Latency: %.1f ms average, %.1f ms max",
+             pipeline->frames_rendered > 0 ? pipeline->latency_sum * 1000.0 / pipeline->frames_rendered : 0.0,
+             pipeline->latency_max * 1000.0);
+    log_info("===========================");
+}
@@ -0,0 +1,214 @@
+#include "result_stream.h"
+#include "face_mask_detector.h"
+
+// Longest JSONL record: the fixed fields plus MAX_FACES face objects
+#define RESULT_JSONL_FACE_BYTES 192
+#define RESULT_JSONL_MAX_BYTES (128 + MAX_FACES * RESULT_JSONL_FACE_BYTES)
+#define RESULT_BINARY_MAX_BYTES (4 + RESULT_RECORD_FIXED_BYTES + MAX_FACES * RESULT_FACE_BYTES)
+
+// Short status names shared by the result files
+const char* mask_status_code(mask_status_t status) {
+    switch (status) {
+        case MASK_STATUS_WITH_MASK: return "mask";
+        case MASK_STATUS_WITHOUT_MASK: return "no_mask";
+        case MASK_STATUS_INCORRECT_MASK: return "incorrect";
+        default: return "unknown";
+    }
+}
+
+static uint8_t* put_bytes(uint8_t* out, const void* value, size_t size) {
+    memcpy(out, value, size);
+    return out + size;
+}
+
+static const uint8_t* get_bytes(const uint8_t* in, void* value, size_t size) {
+    memcpy(value, in, size);
+    return in + size;
+}
+
+// Hand the buffered records to the file in one write
+int flush_result_stream(result_stream_t* stream) {
+    if (!stream || !stream->file) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (stream->used > 0 && !stream->failed) {
+        if (fwrite(stream->buffer, 1, stream->used, stream->file) != stream->used || fflush(stream->file) != 0) {
+            log_error("Failed to write the result stream; further records are discarded");
+            stream->failed = true;
+        }
+        stream->bytes += stream->used;
+        stream->flushes++;
+    }
+    stream->used = 0;
+    stream->last_flush = get_current_time();
+    return stream->failed ? FMD_ERROR_PROCESSING : FMD_SUCCESS;
+}
+
+// Open a stream; buffer_size 0 uses RESULT_STREAM_BUFFER_SIZE
+int open_result_stream(result_stream_t* stream, const char* path, result_format_t format, size_t buffer_size) {
+    if (!stream || !path || strlen(path) == 0 || format == RESULT_FORMAT_NONE) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    memset(stream, 0, sizeof(*stream));
+    stream->format = format;
+    stream->capacity = std::max(buffer_size > 0 ? buffer_size : (size_t)RESULT_STREAM_BUFFER_SIZE,
+                                (size_t)RESULT_JSONL_MAX_BYTES);
+    stream->buffer = (uint8_t*)malloc(stream->capacity);
+    if (!stream->buffer) {
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    stream->file = fopen(path, format == RESULT_FORMAT_BINARY ? "wb" : "w");
+    if (!stream->file) {
+        log_error("Could not create result stream %s", path);
+        free(stream->buffer);
+        stream->buffer = NULL;
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    // The stream does its own buffering
+    setvbuf(stream->file, NULL, _IONBF, 0);
+    
+    if (format == RESULT_FORMAT_BINARY) {
+        uint32_t version = RESULT_STREAM_VERSION;
+        uint8_t* out = put_bytes(stream->buffer, RESULT_STREAM_MAGIC, 4);
+        out = put_bytes(out, &version, sizeof(version));
+        stream->used = out - stream->buffer;
+    }
+    stream->last_flush = get_current_time();
+    return FMD_SUCCESS;
+}
+
+static size_t encode_binary_record(uint8_t* out, uint64_t frame, double timestamp_ms,
+                                   const face_detection_t* faces, int count) {
+    uint32_t length = RESULT_RECORD_FIXED_BYTES + count * RESULT_FACE_BYTES;
+    uint32_t face_count = count;
+    uint8_t* start = out;
+    out = put_bytes(out, &length, sizeof(length));
+    out = put_bytes(out, &frame, sizeof(frame));
+    out = put_bytes(out, &timestamp_ms, sizeof(timestamp_ms));
+    out = put_bytes(out, &face_count, sizeof(face_count));
+    
+    for (int i = 0; i < count; i++) {
+        const face_detection_t* face = &faces[i];
+        int32_t box[5] = {face->x, face->y, face->width, face->height, face->track_id};
+        uint8_t status = (uint8_t)face->mask_status;
+        out = put_bytes(out, box, sizeof(box));
+        out = put_bytes(out, &face->confidence, sizeof(float));
+        out = put_bytes(out, &face->mask_confidence, sizeof(float));
+        out = put_bytes(out, &status, sizeof(status));
+    }
+    return out - start;
+}
+
+static size_t encode_jsonl_record(char* out, size_t size, uint64_t frame, double timestamp_ms,
+                                  const face_detection_t* faces, int count) {
+    size_t used = snprintf(out, size, "{\"frame\":%llu,\"timestamp_ms\":%.3f,\"faces\":[",
+                           (unsigned long long)frame, timestamp_ms);
+    for (int i = 0; i < count && used < size; i++) {
+        const face_detection_t* face = &faces[i];
+        used += snprintf(out + used, size - used,
+                         "%s{\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,\"track_id\":%d,"
+                         "\"confidence\":%.4f,\"status\":\"%s\",\"mask_confidence\":%.4f}",
+                         i > 0 ? "," : "", face->x, face->y, face->width, face->height, face->track_id,
+                         face->confidence, mask_status_code(face->mask_status), face->mask_confidence);
+    }
+    if (used < size) {
+        used += snprintf(out + used, size - used, "]}\n");
+    }
+    return std::min(used, size);
+}
+
+// Append one frame's detections. Records are buffered and reach the file
+// when the buffer fills or RESULT_STREAM_FLUSH_INTERVAL has passed.
+int write_result_record(result_stream_t* stream, uint64_t frame, double timestamp_ms,
+                        const face_detection_t* faces, int count) {
+    if (!stream || !stream->buffer || count < 0 || (count > 0 && !faces)) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    if (stream->failed) {
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    double start = get_current_time();
+    count = std::min(count, MAX_FACES);
+    size_t needed = stream->format == RESULT_FORMAT_BINARY ? RESULT_BINARY_MAX_BYTES : RESULT_JSONL_MAX_BYTES;
+    if (stream->capacity - stream->used < needed) {
+        flush_result_stream(stream);
+    }
+    
+    uint8_t* out = stream->buffer + stream->used;
+    if (stream->format == RESULT_FORMAT_BINARY) {
+        stream->used += encode_binary_record(out, frame, timestamp_ms, faces, count);
+    } else {
+        stream->used += encode_jsonl_record((char*)out, stream->capacity - stream->used, frame, timestamp_ms,
+                                            faces, count);
+    }
+    stream->records++;
+    
+    int result = FMD_SUCCESS;
+    if (start - stream->last_flush >= RESULT_STREAM_FLUSH_INTERVAL) {
+        result = flush_result_stream(stream);
+    }
+    stream->write_time += get_current_time() - start;
+    return result;
+}
+
+// Flush what is left and close the file
+void close_result_stream(result_stream_t* stream) {
+    if (!stream) return;
+    
+    if (stream->file) {
+        flush_result_stream(stream);
+        fclose(stream->file);
+        stream->file = NULL;
+    }
+    free(stream->buffer);
+    stream->buffer = NULL;
+    stream->capacity = 0;
+    stream->used = 0;
+}
+
+// Decode one binary record from data. Returns the bytes it occupies, 0 when
+// data holds only part of it, or an error for a malformed record. Faces
+// beyond max_faces are skipped; count reports how many were stored.
+int decode_result_record(const uint8_t* data, size_t size, uint64_t* frame, double* timestamp_ms,
+                         face_detection_t* faces, int max_faces, int* count) {
+    if (!data || !frame || !timestamp_ms || !count || (max_faces > 0 && !faces)) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    uint32_t length = 0;
+    if (size < sizeof(length)) return 0;
+    
+    const uint8_t* in = get_bytes(data, &length, sizeof(length));
+    if (length < RESULT_RECORD_FIXED_BYTES) return FMD_ERROR_PROCESSING;
+    if (size < sizeof(length) + length) return 0;
+    
+    uint32_t face_count = 0;
+    in = get_bytes(in, frame, sizeof(*frame));
+    in = get_bytes(in, timestamp_ms, sizeof(*timestamp_ms));
+    in = get_bytes(in, &face_count, sizeof(face_count));
+    if (length != RESULT_RECORD_FIXED_BYTES + (uint64_t)face_count * RESULT_FACE_BYTES) {
+        return FMD_ERROR_PROCESSING;
+    }
+    
+    *count = std::min((int)face_count, std::max(0, max_faces));
+    for (int i = 0; i < *count; i++) {
+        face_detection_t* face = &faces[i];
+        int32_t box[5];
+        uint8_t status;
+        in = get_bytes(in, box, sizeof(box));
+        in = get_bytes(in, &face->confidence, sizeof(float));
+        in = get_bytes(in, &face->mask_confidence, sizeof(float));
+        in = get_bytes(in, &status, sizeof(status));
+        face->x = box[0];
+        face->y = box[1];
+        face->width = box[2];
+        face->height = box[3];
+        face->track_id = box[4];
+        face->mask_status = (mask_status_t)status;
+    }
+    return (int)(sizeof(length) + length);
+}
@@ -0,0 +1,400 @@
+#include "image_processing.h"
+#include "face_mask_detector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ROI_FEATURES_X86 1
+#endif
+
+// Fixed-point constants of OpenCV's 8-bit BGR2GRAY and BGR2HSV conversions,
+// so the fused kernel produces exactly the pixels cvtColor would
+#define GRAY_SHIFT 14
+#define GRAY_B 1868
+#define GRAY_G 9617
+#define GRAY_R 4899
+#define HSV_SHIFT 12
+#define HSV_HUE_RANGE 180
+
+// Sums accumulated over the ROI
+enum { SUM_HUE = 0, SUM_SAT, SUM_VAL, SUM_GRAY, SUM_GRAY_SQ, SUM_COUNT };
+
+// Division tables of OpenCV's BGR2HSV_8U
+typedef struct {
+    int sdiv[256];
+    int hdiv[256];
+} hsv_tables_t;
+
+// pshufb masks that split 16 interleaved BGR pixels into B, G and R planes:
+// masks[channel][block] picks that channel's bytes out of the block-th
+// 16-byte load
+typedef struct {
+    int8_t masks[3][3][16];
+} bgr_shuffle_t;
+
+static hsv_tables_t build_hsv_tables() {
+    hsv_tables_t tables;
+    tables.sdiv[0] = 0;
+    tables.hdiv[0] = 0;
+    for (int i = 1; i < 256; i++) {
+        tables.sdiv[i] = cvRound((255 << HSV_SHIFT) / (1.0 * i));
+        tables.hdiv[i] = cvRound((HSV_HUE_RANGE << HSV_SHIFT) / (6.0 * i));
+    }
+    return tables;
+}
+
+static const hsv_tables_t& get_hsv_tables() {
+    static const hsv_tables_t tables = build_hsv_tables();
+    return tables;
+}
+
+static bgr_shuffle_t build_bgr_shuffle() {
+    bgr_shuffle_t shuffle;
+    for (int channel = 0; channel < 3; channel++) {
+        for (int block = 0; block < 3; block++) {
+            for (int pixel = 0; pixel < 16; pixel++) {
+                int source = pixel * 3 + channel - block * 16;
+                shuffle.masks[channel][block][pixel] = (source >= 0 && source < 16) ? (int8_t)source : (int8_t)-128;
+            }
+        }
+    }
+    return shuffle;
+}
+
+static const bgr_shuffle_t& get_bgr_shuffle() {
+    static const bgr_shuffle_t shuffle = build_bgr_shuffle();
+    return shuffle;
+}
+
+// One pixel, exactly as cvtColor computes it
+static inline void accumulate_pixel(int b, int g, int r, const hsv_tables_t& tables, uint8_t* gray, uint64_t* sums) {
+    int y = (b * GRAY_B + g * GRAY_G + r * GRAY_R + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT;
+    
+    int v = std::max(b, std::max(g, r));
+    int vmin = std::min(b, std::min(g, r));
+    int diff = v - vmin;
+    int s = (diff * tables.sdiv[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    int h;
+    if (v == r) {
+        h = g - b;
+    } else if (v == g) {
+        h = b - r + 2 * diff;
+    } else {
+        h = r - g + 4 * diff;
+    }
+    h = (h * tables.hdiv[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+    if (h < 0) h += HSV_HUE_RANGE;
+    
+    *gray = (uint8_t)y;
+    sums[SUM_HUE] += h;
+    sums[SUM_SAT] += s;
+    sums[SUM_VAL] += v;
+    sums[SUM_GRAY] += y;
+    sums[SUM_GRAY_SQ] += y * y;
+}
+
+static void roi_row_scalar(const uint8_t* src, int width, uint8_t* gray, uint64_t* sums) {
+    const hsv_tables_t& tables = get_hsv_tables();
+    for (int x = 0; x < width; x++) {
+        accumulate_pixel(src[3 * x], src[3 * x + 1], src[3 * x + 2], tables, &gray[x], sums);
+    }
+}
+
+#ifdef ROI_FEATURES_X86
+
+// Eight pixels in 32-bit lanes
+__attribute__((target("avx2")))
+static inline __m256i roi_pixels_avx2(__m256i b, __m256i g, __m256i r, const hsv_tables_t& tables,
+                                      __m256i* acc_h, __m256i* acc_s, __m256i* acc_v,
+                                      __m256i* acc_y, __m256i* acc_y2) {
+    const __m256i round_gray = _mm256_set1_epi32(1 << (GRAY_SHIFT - 1));
+    const __m256i round_hsv = _mm256_set1_epi32(1 << (HSV_SHIFT - 1));
+    
+    __m256i y = _mm256_add_epi32(_mm256_mullo_epi32(b, _mm256_set1_epi32(GRAY_B)),
+                                 _mm256_mullo_epi32(g, _mm256_set1_epi32(GRAY_G)));
+    y = _mm256_add_epi32(y, _mm256_mullo_epi32(r, _mm256_set1_epi32(GRAY_R)));
+    y = _mm256_srli_epi32(_mm256_add_epi32(y, round_gray), GRAY_SHIFT);
+    
+    __m256i v = _mm256_max_epi32(b, _mm256_max_epi32(g, r));
+    __m256i vmin = _mm256_min_epi32(b, _mm256_min_epi32(g, r));
+    __m256i diff = _mm256_sub_epi32(v, vmin);
+    
+    __m256i sdiv = _mm256_i32gather_epi32(tables.sdiv, v, 4);
+    __m256i s = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(diff, sdiv), round_hsv), HSV_SHIFT);
+    
+    __m256i vr = _mm256_cmpeq_epi32(v, r);
+    __m256i vg = _mm256_cmpeq_epi32(v, g);
+    __m256i diff2 = _mm256_add_epi32(diff, diff);
+    __m256i from_r = _mm256_sub_epi32(g, b);
+    __m256i from_g = _mm256_add_epi32(_mm256_sub_epi32(b, r), diff2);
+    __m256i from_b = _mm256_add_epi32(_mm256_sub_epi32(r, g), _mm256_add_epi32(diff2, diff2));
+    __m256i h = _mm256_or_si256(_mm256_and_si256(vg, from_g), _mm256_andnot_si256(vg, from_b));
+    h = _mm256_or_si256(_mm256_and_si256(vr, from_r), _mm256_andnot_si256(vr, h));
+    
+    __m256i hdiv = _mm256_i32gather_epi32(tables.hdiv, diff, 4);
+    h = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(h, hdiv), round_hsv), HSV_SHIFT);
+    h = _mm256_add_epi32(h, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), h),
+                                             _mm256_set1_epi32(HSV_HUE_RANGE)));
+    
+    *acc_h = _mm256_add_epi32(*acc_h, h);
+    *acc_s = _mm256_add_epi32(*acc_s, s);
+    *acc_v = _mm256_add_epi32(*acc_v, v);
+    *acc_y = _mm256_add_epi32(*acc_y, y);
+    *acc_y2 = _mm256_add_epi32(*acc_y2, _mm256_mullo_epi32(y, y));
+    return y;
+}
+
+__attribute__((target("avx2")))
+static uint64_t horizontal_sum_avx2(__m256i acc) {
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    
+    uint64_t total = 0;
+    for (int i = 0; i < 8; i++) {
+        total += (uint32_t)lanes[i];
+    }
+    return total;
+}
+
+__attribute__((target("avx2")))
+static void roi_row_avx2(const uint8_t* src, int width, uint8_t* gray, uint64_t* sums) {
+    const hsv_tables_t& tables = get_hsv_tables();
+    const bgr_shuffle_t& shuffle = get_bgr_shuffle();
+    __m128i masks[3][3];
+    for (int channel = 0; channel < 3; channel++) {
+        for (int block = 0; block < 3; block++) {
+            masks[channel][block] = _mm_loadu_si128((const __m128i*)shuffle.masks[channel][block]);
+        }
+    }
+    
+    __m256i acc_h = _mm256_setzero_si256();
+    __m256i acc_s = _mm256_setzero_si256();
+    __m256i acc_v = _mm256_setzero_si256();
+    __m256i acc_y = _mm256_setzero_si256();
+    __m256i acc_y2 = _mm256_setzero_si256();
+    
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8_t* p = src + 3 * x;
+        __m128i a0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(p + 16));
+        __m128i a2 = _mm_loadu_si128((const __m128i*)(p + 32));
+        __m128i planes[3];
+        for (int channel = 0; channel < 3; channel++) {
+            planes[channel] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, masks[channel][0]),
+                                                        _mm_shuffle_epi8(a1, masks[channel][1])),
+                                           _mm_shuffle_epi8(a2, masks[channel][2]));
+        }
+        
+        for (int half = 0; half < 2; half++) {
+            __m256i y = roi_pixels_avx2(_mm256_cvtepu8_epi32(planes[0]), _mm256_cvtepu8_epi32(planes[1]),
+                                        _mm256_cvtepu8_epi32(planes[2]), tables,
+                                        &acc_h, &acc_s, &acc_v, &acc_y, &acc_y2);
+            __m128i y16 = _mm_packus_epi32(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+            _mm_storel_epi64((__m128i*)(gray + x + half * 8), _mm_packus_epi16(y16, y16));
+            
+            for (int channel = 0; channel < 3; channel++) {
+                planes[channel] = _mm_srli_si128(planes[channel], 8);
+            }
+        }
+    }
+    
+    sums[SUM_HUE] += horizontal_sum_avx2(acc_h);
+    sums[SUM_SAT] += horizontal_sum_avx2(acc_s);
+    sums[SUM_VAL] += horizontal_sum_avx2(acc_v);
+    sums[SUM_GRAY] += horizontal_sum_avx2(acc_y);
+    sums[SUM_GRAY_SQ] += horizontal_sum_avx2(acc_y2);
+    
+    for (; x < width; x++) {
+        accumulate_pixel(src[3 * x], src[3 * x + 1], src[3 * x + 2], tables, &gray[x], sums);
+    }
+}
+
+// Four pixels in 32-bit lanes; SSE has no gather, so table lookups are scalar
+__attribute__((target("sse4.1")))
+static inline __m128i roi_pixels_sse41(__m128i b, __m128i g, __m128i r, const hsv_tables_t& tables,
+                                       __m128i* acc_h, __m128i* acc_s, __m128i* acc_v,
+                                       __m128i* acc_y, __m128i* acc_y2) {
+    const __m128i round_gray = _mm_set1_epi32(1 << (GRAY_SHIFT - 1));
+    const __m128i round_hsv = _mm_set1_epi32(1 << (HSV_SHIFT - 1));
+    
+    __m128i y = _mm_add_epi32(_mm_mullo_epi32(b, _mm_set1_epi32(GRAY_B)),
+                              _mm_mullo_epi32(g, _mm_set1_epi32(GRAY_G)));
+    y = _mm_add_epi32(y, _mm_mullo_epi32(r, _mm_set1_epi32(GRAY_R)));
+    y = _mm_srli_epi32(_mm_add_epi32(y, round_gray), GRAY_SHIFT);
+    
+    __m128i v = _mm_max_epi32(b, _mm_max_epi32(g, r));
+    __m128i vmin = _mm_min_epi32(b, _mm_min_epi32(g, r));
+    __m128i diff = _mm_sub_epi32(v, vmin);
+    
+    __m128i sdiv = _mm_setr_epi32(tables.sdiv[_mm_extract_epi32(v, 0)], tables.sdiv[_mm_extract_epi32(v, 1)],
+                                  tables.sdiv[_mm_extract_epi32(v, 2)], tables.sdiv[_mm_extract_epi32(v, 3)]);
+    __m128i s = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(diff, sdiv), round_hsv), HSV_SHIFT);
+    
+    __m128i vr = _mm_cmpeq_epi32(v, r);
+    __m128i vg = _mm_cmpeq_epi32(v, g);
+    __m128i diff2 = _mm_add_epi32(diff, diff);
+    __m128i from_r = _mm_sub_epi32(g, b);
+    __m128i from_g = _mm_add_epi32(_mm_sub_epi32(b, r), diff2);
+    __m128i from_b = _mm_add_epi32(_mm_sub_epi32(r, g), _mm_add_epi32(diff2, diff2));
+    __m128i h = _mm_or_si128(_mm_and_si128(vg, from_g), _mm_andnot_si128(vg, from_b));
+    h = _mm_or_si128(_mm_and_si128(vr, from_r), _mm_andnot_si128(vr, h));
+    
+    __m128i hdiv = _mm_setr_epi32(tables.hdiv[_mm_extract_epi32(diff, 0)], tables.hdiv[_mm_extract_epi32(diff, 1)],
+                                  tables.hdiv[_mm_extract_epi32(diff, 2)], tables.hdiv[_mm_extract_epi32(diff, 3)]);
+    h = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(h, hdiv), round_hsv), HSV_SHIFT);
+    h = _mm_add_epi32(h, _mm_and_si128(_mm_cmplt_epi32(h, _mm_setzero_si128()), _mm_set1_epi32(HSV_HUE_RANGE)));
+    
+    *acc_h = _mm_add_epi32(*acc_h, h);
+    *acc_s = _mm_add_epi32(*acc_s, s);
+    *acc_v = _mm_add_epi32(*acc_v, v);
+    *acc_y = _mm_add_epi32(*acc_y, y);
+    *acc_y2 = _mm_add_epi32(*acc_y2, _mm_mullo_epi32(y, y));
+    return y;
+}
+
+__attribute__((target("sse4.1")))
+static uint64_t horizontal_sum_sse41(__m128i acc) {
+    return (uint64_t)(uint32_t)_mm_extract_epi32(acc, 0) + (uint32_t)_mm_extract_epi32(acc, 1) +
+           (uint32_t)_mm_extract_epi32(acc, 2) + (uint32_t)_mm_extract_epi32(acc, 3);
+}
+
+__attribute__((target("sse4.1")))
+static void roi_row_sse41(const uint8_t* src, int width, uint8_t* gray, uint64_t* sums) {
+    const hsv_tables_t& tables = get_hsv_tables();
+    const bgr_shuffle_t& shuffle = get_bgr_shuffle();
+    __m128i masks[3][3];
+    for (int channel = 0; channel < 3; channel++) {
+        for (int block = 0; block < 3; block++) {
+            masks[channel][block] = _mm_loadu_si128((const __m128i*)shuffle.masks[channel][block]);
+        }
+    }
+    
+    __m128i acc_h = _mm_setzero_si128();
+    __m128i acc_s = _mm_setzero_si128();
+    __m128i acc_v = _mm_setzero_si128();
+    __m128i acc_y = _mm_setzero_si128();
+    __m128i acc_y2 = _mm_setzero_si128();
+    
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8_t* p = src + 3 * x;
+        __m128i a0 = _mm_loadu_si128((const __m128i*)p);
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(p + 16));
+        __m128i a2 = _mm_loadu_si128((const __m128i*)(p + 32));
+        __m128i planes[3];
+        for (int channel = 0; channel < 3; channel++) {
+            planes[channel] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, masks[channel][0]),
+                                                        _mm_shuffle_epi8(a1, masks[channel][1])),
+                                           _mm_shuffle_epi8(a2, masks[channel][2]));
+        }
+        
+        for (int quarter = 0; quarter < 4; quarter++) {
+            __m128i y = roi_pixels_sse41(_mm_cvtepu8_epi32(planes[0]), _mm_cvtepu8_epi32(planes[1]),
+                                         _mm_cvtepu8_epi32(planes[2]), tables,
+                                         &acc_h, &acc_s, &acc_v, &acc_y, &acc_y2);
+            __m128i y16 = _mm_packus_epi32(y, y);
+            int packed = _mm_cvtsi128_si32(_mm_packus_epi16(y16, y16));
+            memcpy(gray + x + quarter * 4, &packed, 4);
+            
+            for (int channel = 0; channel < 3; channel++) {
+                planes[channel] = _mm_srli_si128(planes[channel], 4);
+            }
+        }
+    }
+    
+    sums[SUM_HUE] += horizontal_sum_sse41(acc_h);
+    sums[SUM_SAT] += horizontal_sum_sse41(acc_s);
+    sums[SUM_VAL] += horizontal_sum_sse41(acc_v);
+    sums[SUM_GRAY] += horizontal_sum_sse41(acc_y);
+    sums[SUM_GRAY_SQ] += horizontal_sum_sse41(acc_y2);
+    
+    for (; x < width; x++) {
+        accumulate_pixel(src[3 * x], src[3 * x + 1], src[3 * x + 2], tables, &gray[x], sums);
+    }
+}
+
+#endif // ROI_FEATURES_X86
+
+typedef void (*roi_row_kernel_t)(const uint8_t* src, int width, uint8_t* gray, uint64_t* sums);
+
+// Pick the kernel for a request; ROI_KERNEL_AUTO takes the best one the CPU runs
+static roi_row_kernel_t select_roi_kernel(roi_kernel_t kernel) {
+#ifdef ROI_FEATURES_X86
+    __builtin_cpu_init();
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    bool has_sse41 = __builtin_cpu_supports("sse4.1");
+    
+    switch (kernel) {
+        case ROI_KERNEL_AUTO:
+            if (has_avx2) return roi_row_avx2;
+            if (has_sse41) return roi_row_sse41;
+            return roi_row_scalar;
+        case ROI_KERNEL_AVX2: return has_avx2 ? roi_row_avx2 : NULL;
+        case ROI_KERNEL_SSE41: return has_sse41 ? roi_row_sse41 : NULL;
+        case ROI_KERNEL_SCALAR: return roi_row_scalar;
+        default: return NULL;
+    }
+#else
+    return (kernel == ROI_KERNEL_AUTO || kernel == ROI_KERNEL_SCALAR) ? roi_row_scalar : NULL;
+#endif
+}
+
+static roi_row_kernel_t get_auto_kernel() {
+    static const roi_row_kernel_t kernel = select_roi_kernel(ROI_KERNEL_AUTO);
+    return kernel;
+}
+
+const char* roi_kernel_name(void) {
+    roi_row_kernel_t kernel = get_auto_kernel();
+#ifdef ROI_FEATURES_X86
+    if (kernel == roi_row_avx2) return "avx2";
+    if (kernel == roi_row_sse41) return "sse4.1";
+#endif
+    return kernel == roi_row_scalar ? "scalar" : "none";
+}
+
+// Mean hue, saturation and value of the BGR2HSV image, and mean and standard
+// deviation of the BGR2GRAY image, in one pass over a packed BGR buffer.
+// The gray pixels are written out so callers can run further filters on them.
+int compute_bgr_roi_features(const uint8_t* bgr, size_t bgr_step, int width, int height,
+                             uint8_t* gray, size_t gray_step, roi_features_t* features, roi_kernel_t kernel) {
+    if (!bgr || !gray || !features || width <= 0 || height <= 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    roi_row_kernel_t row_kernel = kernel == ROI_KERNEL_AUTO ? get_auto_kernel() : select_roi_kernel(kernel);
+    if (!row_kernel) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    // Row sums stay within 32-bit lanes for any realistic ROI width; they
+    // are folded into 64-bit totals after every row
+    uint64_t sums[SUM_COUNT] = {0};
+    for (int y = 0; y < height; y++) {
+        row_kernel(bgr + y * bgr_step, width, gray + y * gray_step, sums);
+    }
+    
+    double count = (double)width * height;
+    features->hue_mean = sums[SUM_HUE] / count;
+    features->saturation_mean = sums[SUM_SAT] / count;
+    features->value_mean = sums[SUM_VAL] / count;
+    features->gray_mean = sums[SUM_GRAY] / count;
+    double variance = sums[SUM_GRAY_SQ] / count - features->gray_mean * features->gray_mean;
+    features->gray_std = sqrt(std::max(variance, 0.0));
+    features->skin_ratio = -1.0;
+    return FMD_SUCCESS;
+}
+
+// cv::Mat front end; gray is (re)allocated to the ROI size if needed
+int compute_roi_features(const cv::Mat& bgr, cv::Mat& gray, roi_features_t* features) {
+    if (bgr.empty() || bgr.type() != CV_8UC3 || !features) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (gray.rows != bgr.rows || gray.cols != bgr.cols || gray.type() != CV_8UC1) {
+        gray.create(bgr.rows, bgr.cols, CV_8UC1);
+    }
+    
+    return compute_bgr_roi_features(bgr.data, bgr.step[0], bgr.cols, bgr.rows,
+                                    gray.data, gray.step[0], features, ROI_KERNEL_AUTO);
+}
@@ -0,0 +1,100 @@
+#include "detection_engine.h"
+#include "face_mask_detector.h"
+
+// Grow a box by a margin on every side and clip it to the frame
+static cv::Rect pad_region(const cv::Rect& box, int margin_x, int margin_y, const cv::Rect& frame_rect) {
+    cv::Rect padded(box.x - margin_x, box.y - margin_y, box.width + 2 * margin_x, box.height + 2 * margin_y);
+    return padded & frame_rect;
+}
+
+// Union overlapping regions until none overlap
+void merge_search_regions(std::vector<cv::Rect>& regions) {
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < regions.size() && !merged; i++) {
+            for (size_t j = i + 1; j < regions.size(); j++) {
+                if ((regions[i] & regions[j]).area() > 0) {
+                    regions[i] |= regions[j];
+                    regions.erase(regions.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Collect the parts of the frame worth scanning: padded boxes around tracked
+// faces and around blocks that changed since the previous scan. Track boxes
+// and face sizes are in frame coordinates and scaled by track_scale into
+// those of gray.
+// Returns false when a full sweep should run instead (sweep due, no history,
+// too much change). The motion reference is updated on every call.
+bool build_search_regions(detection_engine_t* engine, const cv::Mat& gray, double track_scale,
+                          std::vector<cv::Rect>& regions) {
+    regions.clear();
+    if (!engine || gray.empty()) return false;
+    
+    detection_scratch_t* scratch = &engine->scratch;
+    cv::Size small_size(std::max(1, gray.cols / MOTION_DOWNSCALE), std::max(1, gray.rows / MOTION_DOWNSCALE));
+    cv::resize(gray, scratch->motion_small, small_size, 0, 0, cv::INTER_AREA);
+    
+    bool have_previous = scratch->motion_previous.cols == small_size.width &&
+                         scratch->motion_previous.rows == small_size.height;
+    bool sweep_due = engine->full_sweep_interval <= 1 ||
+                     engine->cascade_scans % (uint64_t)engine->full_sweep_interval == 0;
+    
+    if (have_previous && !sweep_due) {
+        cv::absdiff(scratch->motion_small, scratch->motion_previous, scratch->motion_diff);
+        cv::threshold(scratch->motion_diff, scratch->motion_diff, MOTION_THRESHOLD, 255, cv::THRESH_BINARY);
+        cv::dilate(scratch->motion_diff, scratch->motion_diff, cv::Mat());
+        cv::findContours(scratch->motion_diff, scratch->motion_contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    }
+    std::swap(scratch->motion_small, scratch->motion_previous);
+    
+    if (!have_previous || sweep_due) {
+        return false;
+    }
+    
+    const cv::Rect frame_rect(0, 0, gray.cols, gray.rows);
+    const detection_params_t* params = &engine->face_detection_params;
+    int min_face = std::max(1, cvRound(std::max(params->min_size_width, params->min_size_height) * track_scale));
+    
+    // Changed blocks, padded so a face at the edge of the motion still fits
+    for (size_t i = 0; i < scratch->motion_contours.size(); i++) {
+        cv::Rect block = cv::boundingRect(scratch->motion_contours[i]);
+        cv::Rect region(block.x * MOTION_DOWNSCALE, block.y * MOTION_DOWNSCALE,
+                        block.width * MOTION_DOWNSCALE, block.height * MOTION_DOWNSCALE);
+        regions.push_back(pad_region(region, min_face, min_face, frame_rect));
+    }
+    
+    // Known faces, padded by half their size to allow for movement
+    for (int t = 0; t < MAX_FACE_TRACKS; t++) {
+        const face_track_t* track = &engine->tracks[t];
+        if (!track->active) continue;
+        
+        const face_detection_t* last = &track->last_detection;
+        cv::Rect box(cvRound(last->x * track_scale), cvRound(last->y * track_scale),
+                     cvRound(last->width * track_scale), cvRound(last->height * track_scale));
+        regions.push_back(pad_region(box, std::max(box.width / 2, min_face / 2),
+                                     std::max(box.height / 2, min_face / 2), frame_rect));
+    }
+    
+    merge_search_regions(regions);
+    
+    double covered = 0.0;
+    for (size_t i = 0; i < regions.size(); i++) {
+        covered += regions[i].area();
+    }
+    double fraction = covered / frame_rect.area();
+    
+    // Scanning most of the frame in pieces costs more than one full sweep
+    if (fraction > MAX_SEARCH_COVERAGE) {
+        regions.clear();
+        return false;
+    }
+    
+    engine->scanned_fraction_sum += fraction;
+    return true;
+}
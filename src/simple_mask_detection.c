@@ -1,9 +1,58 @@
 #include "face_mask_detector.h"
 #include "image_processing.h"
+#include "detection_engine.h"
+
+// Mask-friendly decision logic
+static mask_status_t decide_mask_status(int mask_indicators, int skin_indicators) {
+    if (mask_indicators >= 3) {
+        return MASK_STATUS_WITH_MASK;
+    } else if (skin_indicators >= 5) {
+        return MASK_STATUS_WITHOUT_MASK;
+    } else if (mask_indicators >= skin_indicators) {
+        return MASK_STATUS_WITH_MASK;
+    } else {
+        return MASK_STATUS_WITHOUT_MASK;
+    }
+}
+
+// How sure a decision is: the indicator points that must move against it
+// before it flips, with one point (on the boundary) giving 0 and
+// HEURISTIC_MARGIN_POINTS + 1 or more giving 1
+static float decision_margin(int mask_indicators, int skin_indicators) {
+    mask_status_t decision = decide_mask_status(mask_indicators, skin_indicators);
+    for (int points = 1; points <= HEURISTIC_MARGIN_POINTS; points++) {
+        bool flips;
+        if (decision == MASK_STATUS_WITH_MASK) {
+            flips = decide_mask_status(mask_indicators - points, skin_indicators) != decision ||
+                    decide_mask_status(mask_indicators, skin_indicators + points) != decision;
+        } else {
+            flips = decide_mask_status(mask_indicators + points, skin_indicators) != decision ||
+                    decide_mask_status(mask_indicators, skin_indicators - points) != decision;
+        }
+        if (flips) {
+            return (float)(points - 1) / HEURISTIC_MARGIN_POINTS;
+        }
+    }
+    return 1.0f;
+}
 
 // Classify whether a face is wearing a mask using simple reliable method
 mask_status_t classify_mask_simple_reliable(const cv::Mat& frame, const face_detection_t* face) {
-    if (frame.empty() || !face) {
+    detection_scratch_t scratch;
+    scratch.reallocations = 0;
+    scratch.plane.valid = false;
+    return classify_mask_simple_reliable_scratch(frame, face, &scratch, NULL);
+}
+
+// Same classification, with all temporaries taken from caller-owned scratch
+// buffers. The decision's margin is stored in margin if given (0 when the
+// face cannot be classified).
+mask_status_t classify_mask_simple_reliable_scratch(const cv::Mat& frame, const face_detection_t* face,
+                                                    detection_scratch_t* scratch, float* margin) {
+    if (margin) {
+        *margin = 0.0f;
+    }
+    if (frame.empty() || !face || !scratch) {
         return MASK_STATUS_UNKNOWN;
     }
     
@@ -17,34 +66,30 @@ mask_status_t classify_mask_simple_reliable(const cv::Mat& frame, const face_det
             return MASK_STATUS_UNKNOWN;
         }
         
-        cv::Mat face_img = frame(face_region);
-        
         // Focus on lower face where masks are visible
-        int lower_y = face_img.rows * 0.65;
-        int lower_height = face_img.rows * 0.25;
-        cv::Rect lower_face(face_img.cols * 0.2, lower_y, face_img.cols * 0.6, lower_height);
-        lower_face &= cv::Rect(0, 0, face_img.cols, face_img.rows);
+        cv::Rect lower_face = get_mouth_region(face_region);
         
         if (lower_face.width < 10 || lower_face.height < 10) {
             return MASK_STATUS_UNKNOWN;
         }
         
-        cv::Mat mouth_area = face_img(lower_face);
-        
-        // Convert to different color spaces for analysis
-        cv::Mat hsv_img, gray_img;
-        cv::cvtColor(mouth_area, hsv_img, cv::COLOR_BGR2HSV);
-        cv::cvtColor(mouth_area, gray_img, cv::COLOR_BGR2GRAY);
+        // Colour and texture statistics: O(1) lookups when the frame's
+        // feature plane covers the region, otherwise one pass over the pixels
+        cv::Mat gray_img = scratch_view(scratch->roi_gray, lower_face.height, lower_face.width, CV_8UC1, &scratch->reallocations);
+        roi_features_t features;
+        bool from_plane = feature_plane_stats(&scratch->plane, lower_face, &features) == FMD_SUCCESS;
+        if (!from_plane && compute_roi_features(frame(lower_face), gray_img, &features) != FMD_SUCCESS) {
+            return MASK_STATUS_UNKNOWN;
+        }
         
         // Score different indicators
         int mask_indicators = 0;
         int skin_indicators = 0;
         
         // 1. Check color saturation - masks usually have lower saturation
-        cv::Scalar color_mean = cv::mean(hsv_img);
-        double saturation = color_mean[1];
-        double hue = color_mean[0];
-        double value = color_mean[2];
+        double saturation = features.saturation_mean;
+        double hue = features.hue_mean;
+        double value = features.value_mean;
         
         if (saturation < 70) {
             mask_indicators += 4;  // Low saturation suggests mask material
@@ -59,9 +104,7 @@ mask_status_t classify_mask_simple_reliable(const cv::Mat& frame, const face_det
         }
         
         // 3. Texture uniformity
-        cv::Scalar mean_gray, std_gray;
-        cv::meanStdDev(gray_img, mean_gray, std_gray);
-        double texture_std = std_gray[0];
+        double texture_std = features.gray_std;
         
         if (texture_std < 25) {
             mask_indicators += 3;  // Very uniform = mask (more generous)
@@ -70,25 +113,42 @@ mask_status_t classify_mask_simple_reliable(const cv::Mat& frame, const face_det
         }
         
         // 4. Overall brightness uniformity
-        double brightness = mean_gray[0];
+        double brightness = features.gray_mean;
         if (brightness > 150 || brightness < 100) {
             // Very bright or dark suggests mask
             mask_indicators += 1;
         }
         
-        // 5. Edge analysis for mask boundaries
-        cv::Mat edges;
-        cv::Canny(gray_img, edges, 50, 150);
-        int edge_pixels = cv::countNonZero(edges);
-        double edge_ratio = (double)edge_pixels / (lower_face.width * lower_face.height);
-        
-        if (edge_ratio > 0.1 && edge_ratio < 0.3) {
-            mask_indicators += 1;  // Moderate edges suggest mask boundary
+        // Face-pool threads share the counter, so it is updated atomically
+        static int debug_counter = 0;
+        bool debug_frame = (__sync_add_and_fetch(&debug_counter, 1) % 15 == 0);
+        
+        // 5. Edge analysis for mask boundaries. Edges only ever add one mask
+        // indicator, so Canny is skipped when that cannot change the outcome
+        // and no margin is wanted; the margin always counts them. Debug
+        // output never decides whether they are measured.
+        double edge_ratio = -1.0;
+        bool edges_matter = decide_mask_status(mask_indicators + 1, skin_indicators) !=
+                            decide_mask_status(mask_indicators, skin_indicators);
+        if (edges_matter || margin) {
+            // The plane's edge map is a lookup; without a plane Canny runs on
+            // the region alone, in a scratch buffer
+            if (from_plane) {
+                edge_ratio = feature_plane_edge_density(&scratch->plane, lower_face, PLANE_EDGES_STRONG);
+            } else {
+                cv::Mat edges = scratch_view(scratch->roi_edges, gray_img.rows, gray_img.cols, CV_8UC1,
+                                             &scratch->reallocations);
+                cv::Canny(gray_img, edges, 50, 150);
+                edge_ratio = (double)cv::countNonZero(edges) / (lower_face.width * lower_face.height);
+            }
+            
+            if (edge_ratio > 0.1 && edge_ratio < 0.3) {
+                mask_indicators += 1;  // Moderate edges suggest mask boundary
+            }
         }
         
         // Debug output
-        static int debug_counter = 0;
-        if (++debug_counter % 15 == 0) {
+        if (debug_frame) {
             log_info("=== SIMPLE RELIABLE DETECTION ===");
             log_info("H=%.1f S=%.1f V=%.1f B=%.1f T=%.1f", hue, saturation, value, brightness, texture_std);
             log_info("MaskIndicators=%d SkinIndicators=%d", mask_indicators, skin_indicators);
@@ -106,16 +166,10 @@ mask_status_t classify_mask_simple_reliable(const cv::Mat& frame, const face_det
             log_info("================================");
         }
         
-        // Mask-friendly decision logic
-        if (mask_indicators >= 3) {
-            return MASK_STATUS_WITH_MASK;
-        } else if (skin_indicators >= 5) {
-            return MASK_STATUS_WITHOUT_MASK;
-        } else if (mask_indicators >= skin_indicators) {
-            return MASK_STATUS_WITH_MASK;
-        } else {
-            return MASK_STATUS_WITHOUT_MASK;
+        if (margin) {
+            *margin = decision_margin(mask_indicators, skin_indicators);
         }
+        return decide_mask_status(mask_indicators, skin_indicators);
         
     } catch (const cv::Exception& e) {
         log_error("OpenCV exception in simple mask classification: %s", e.what());
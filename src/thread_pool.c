@@ -0,0 +1,140 @@
+#include "thread_pool.h"
+#include "face_mask_detector.h"
+
+// Pool thread: take task indices until the current job is exhausted
+static void* thread_pool_worker_main(void* arg) {
+    thread_pool_worker_t* worker = (thread_pool_worker_t*)arg;
+    thread_pool_t* pool = worker->pool;
+    
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        while (!pool->shutdown && pool->next_task >= pool->task_count) {
+            pthread_cond_wait(&pool->work_ready, &pool->mutex);
+        }
+        if (pool->shutdown) break;
+        
+        int task_index = pool->next_task++;
+        thread_pool_task_t task = pool->task;
+        void* context = pool->context;
+        pthread_mutex_unlock(&pool->mutex);
+        
+        task(context, task_index, worker->index);
+        
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->pending_tasks == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    
+    return NULL;
+}
+
+// Start thread_count worker threads
+int init_thread_pool(thread_pool_t* pool, int thread_count) {
+    if (!pool || thread_count <= 0 || thread_count > MAX_POOL_THREADS) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    pool->thread_count = 0;
+    pool->task = NULL;
+    pool->context = NULL;
+    pool->task_count = 0;
+    pool->next_task = 0;
+    pool->pending_tasks = 0;
+    pool->shutdown = false;
+    
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    if (pthread_cond_init(&pool->work_ready, NULL) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    if (pthread_cond_init(&pool->work_done, NULL) != 0) {
+        pthread_cond_destroy(&pool->work_ready);
+        pthread_mutex_destroy(&pool->mutex);
+        return FMD_ERROR_MEMORY_ALLOCATION;
+    }
+    
+    for (int i = 0; i < thread_count; i++) {
+        thread_pool_worker_t* worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        worker->started = false;
+        
+        if (pthread_create(&worker->thread, NULL, thread_pool_worker_main, worker) != 0) {
+            log_error("Failed to start pool thread %d", i);
+            cleanup_thread_pool(pool);
+            return FMD_ERROR_PROCESSING;
+        }
+        worker->started = true;
+        pool->thread_count++;
+    }
+    
+    return FMD_SUCCESS;
+}
+
+// Run task for every index in [0, task_count) and wait for all of them.
+// One job runs at a time; the pool is not reentrant.
+int thread_pool_run(thread_pool_t* pool, thread_pool_task_t task, void* context, int task_count) {
+    if (!pool || !task || task_count < 0) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (task_count == 0) {
+        return FMD_SUCCESS;
+    }
+    
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->context = context;
+    pool->next_task = 0;
+    pool->pending_tasks = task_count;
+    pool->task_count = task_count;
+    pthread_cond_broadcast(&pool->work_ready);
+    
+    while (pool->pending_tasks > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    }
+    
+    pool->task_count = 0;
+    pool->next_task = 0;
+    pool->task = NULL;
+    pool->context = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+    
+    return FMD_SUCCESS;
+}
+
+// Stop and join all pool threads
+void cleanup_thread_pool(thread_pool_t* pool) {
+    if (!pool) return;
+    
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->mutex);
+    
+    for (int i = 0; i < pool->thread_count; i++) {
+        if (pool->workers[i].started) {
+            pthread_join(pool->workers[i].thread, NULL);
+            pool->workers[i].started = false;
+        }
+    }
+    pool->thread_count = 0;
+    
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+// One thread per online core, capped at max_threads
+int get_default_thread_count(int max_threads) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    
+    return (int)std::min<long>(cores, std::max(1, max_threads));
+}
@@ -17,6 +17,7 @@ void set_default_config(app_config_t* config) {
     // Set default paths
     strncpy(config->cascade_path, DEFAULT_CASCADE_FILE, MAX_PATH_LENGTH - 1);
     strncpy(config->model_path, DEFAULT_MASK_MODEL_FILE, MAX_PATH_LENGTH - 1);
+    strncpy(config->int8_model_path, DEFAULT_INT8_MASK_MODEL_FILE, MAX_PATH_LENGTH - 1);
     strncpy(config->config_path, DEFAULT_CONFIG_FILE, MAX_PATH_LENGTH - 1);
     
     // Set default values
@@ -32,6 +33,39 @@ void set_default_config(app_config_t* config) {
     config->show_preview = true;
     config->verbose = false;
     config->real_time = true;
+    
+    // Set default pipeline settings
+    config->detection_workers = DEFAULT_DETECTION_WORKERS;
+    config->face_threads = 1;
+    config->queue_depth = DEFAULT_QUEUE_DEPTH;
+    config->writer_queue_depth = DEFAULT_WRITER_QUEUE_DEPTH;
+    config->writer_policy = DROP_POLICY_BLOCK;
+    config->batch_mode = false;
+    config->segment_workers = 0;
+    config->results_path[0] = '\0';
+    config->raw_format[0] = '\0';
+    config->result_stream_path[0] = '\0';
+    config->result_format = RESULT_FORMAT_BINARY;
+    config->record_path[0] = '\0';
+    config->detection_interval = DEFAULT_DETECTION_INTERVAL;
+    config->mask_batch_size = DEFAULT_MASK_BATCH_SIZE;
+    config->roi_search = false;
+    config->full_sweep_interval = DEFAULT_FULL_SWEEP_INTERVAL;
+    config->adaptive_scale = false;
+    config->detection_size = 0;
+    config->verify_detections = false;
+    config->drop_policy = DROP_POLICY_OLDEST;
+    config->latency_budget_ms = DEFAULT_LATENCY_BUDGET_MS;
+    config->mask_cache_age = 0;
+    config->mask_policy = MASK_POLICY_AUTO;
+    config->escalation_margin = DEFAULT_ESCALATION_MARGIN;
+    config->model_precision = MODEL_PRECISION_FP32;
+    
+    // Set default cascade chain
+    strncpy(config->cascade_params, DEFAULT_CASCADE_PARAMS, MAX_STRING_LENGTH - 1);
+    strncpy(config->fallback_cascades[0], DEFAULT_FALLBACK_CASCADE_1, MAX_PATH_LENGTH - 1);
+    strncpy(config->fallback_cascades[1], DEFAULT_FALLBACK_CASCADE_2, MAX_PATH_LENGTH - 1);
+    config->fallback_cascade_count = 2;
 }
 
 // Load configuration from file
@@ -49,6 +83,7 @@ int load_config(app_config_t* config, const char* config_file) {
     char line[256];
     char key[64], value[128];
     int line_number = 0;
+    bool fallbacks_configured = false;
     
     while (fgets(line, sizeof(line), file)) {
         line_number++;
@@ -94,6 +129,83 @@ int load_config(app_config_t* config, const char* config_file) {
                 config->show_preview = (strcmp(value_trimmed, "true") == 0 || strcmp(value_trimmed, "1") == 0);
             } else if (strcmp(key_trimmed, "verbose") == 0) {
                 config->verbose = (strcmp(value_trimmed, "true") == 0 || strcmp(value_trimmed, "1") == 0);
+            } else if (strcmp(key_trimmed, "detection_workers") == 0) {
+                config->detection_workers = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "face_threads") == 0) {
+                config->face_threads = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "queue_depth") == 0) {
+                config->queue_depth = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "writer_queue_depth") == 0) {
+                config->writer_queue_depth = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "writer_policy") == 0) {
+                if (parse_drop_policy(value_trimmed, &config->writer_policy) != FMD_SUCCESS) {
+                    log_warning("Unknown writer policy: %s", value_trimmed);
+                }
+            } else if (strcmp(key_trimmed, "batch_mode") == 0) {
+                config->batch_mode = (strcmp(value_trimmed, "true") == 0 || strcmp(value_trimmed, "1") == 0);
+            } else if (strcmp(key_trimmed, "segment_workers") == 0) {
+                config->segment_workers = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "results_path") == 0) {
+                strncpy(config->results_path, value_trimmed, MAX_PATH_LENGTH - 1);
+            } else if (strcmp(key_trimmed, "raw_format") == 0) {
+                strncpy(config->raw_format, value_trimmed, MAX_STRING_LENGTH - 1);
+            } else if (strcmp(key_trimmed, "result_stream") == 0) {
+                strncpy(config->result_stream_path, value_trimmed, MAX_PATH_LENGTH - 1);
+            } else if (strcmp(key_trimmed, "result_format") == 0) {
+                if (parse_result_format(value_trimmed, &config->result_format) != FMD_SUCCESS) {
+                    log_warning("Unknown result format: %s", value_trimmed);
+                }
+            } else if (strcmp(key_trimmed, "record") == 0) {
+                strncpy(config->record_path, value_trimmed, MAX_PATH_LENGTH - 1);
+            } else if (strcmp(key_trimmed, "detection_interval") == 0) {
+                config->detection_interval = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "mask_batch_size") == 0) {
+                config->mask_batch_size = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "roi_search") == 0) {
+                config->roi_search = (strcmp(value_trimmed, "true") == 0 || strcmp(value_trimmed, "1") == 0);
+            } else if (strcmp(key_trimmed, "full_sweep_interval") == 0) {
+                config->full_sweep_interval = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "adaptive_scale") == 0) {
+                config->adaptive_scale = (strcmp(value_trimmed, "true") == 0 || strcmp(value_trimmed, "1") == 0);
+            } else if (strcmp(key_trimmed, "detection_size") == 0) {
+                config->detection_size = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "verify_detections") == 0) {
+                config->verify_detections = (strcmp(value_trimmed, "true") == 0 || strcmp(value_trimmed, "1") == 0);
+            } else if (strcmp(key_trimmed, "drop_policy") == 0) {
+                if (parse_drop_policy(value_trimmed, &config->drop_policy) != FMD_SUCCESS) {
+                    log_warning("Unknown drop policy: %s", value_trimmed);
+                }
+            } else if (strcmp(key_trimmed, "latency_budget_ms") == 0) {
+                config->latency_budget_ms = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "mask_cache_age") == 0) {
+                config->mask_cache_age = atoi(value_trimmed);
+            } else if (strcmp(key_trimmed, "mask_policy") == 0) {
+                if (parse_mask_policy(value_trimmed, &config->mask_policy) != FMD_SUCCESS) {
+                    log_warning("Unknown mask policy: %s", value_trimmed);
+                }
+            } else if (strcmp(key_trimmed, "escalation_margin") == 0) {
+                config->escalation_margin = atof(value_trimmed);
+            } else if (strcmp(key_trimmed, "model_precision") == 0) {
+                if (parse_model_precision(value_trimmed, &config->model_precision) != FMD_SUCCESS) {
+                    log_warning("Unknown model precision: %s", value_trimmed);
+                }
+            } else if (strcmp(key_trimmed, "int8_model_path") == 0) {
+                strncpy(config->int8_model_path, value_trimmed, MAX_PATH_LENGTH - 1);
+            } else if (strcmp(key_trimmed, "cascade_params") == 0) {
+                strncpy(config->cascade_params, value_trimmed, MAX_STRING_LENGTH - 1);
+            } else if (strcmp(key_trimmed, "fallback_cascade") == 0) {
+                // The first entry in the file replaces the built-in chain
+                if (!fallbacks_configured) {
+                    config->fallback_cascade_count = 0;
+                    fallbacks_configured = true;
+                }
+                if (strcmp(value_trimmed, "none") == 0) {
+                    config->fallback_cascade_count = 0;
+                } else if (config->fallback_cascade_count < MAX_FALLBACK_CASCADES) {
+                    strncpy(config->fallback_cascades[config->fallback_cascade_count++], value_trimmed, MAX_PATH_LENGTH - 1);
+                } else {
+                    log_warning("Too many fallback cascades at line %d (max %d)", line_number, MAX_FALLBACK_CASCADES);
+                }
             } else {
                 log_warning("Unknown configuration key '%s' at line %d", key_trimmed, line_number);
             }
@@ -124,6 +236,36 @@ void print_config(const app_config_t* config) {
     printf("Show Preview:          %s\n", config->show_preview ? "Yes" : "No");
     printf("Verbose:               %s\n", config->verbose ? "Yes" : "No");
     printf("Real-time Mode:        %s\n", config->real_time ? "Yes" : "No");
+    printf("Detection Workers:     %d\n", config->detection_workers);
+    printf("Face Threads:          %d\n", config->face_threads);
+    printf("Queue Depth:           %d\n", config->queue_depth);
+    printf("Writer Queue Depth:    %d\n", config->writer_queue_depth);
+    printf("Writer Policy:         %s\n", drop_policy_to_string(config->writer_policy));
+    printf("Batch Mode:            %s\n", config->batch_mode ? "Yes" : "No");
+    printf("Segment Workers:       %d\n", config->segment_workers);
+    printf("Results Path:          %s\n", config->results_path);
+    printf("Raw Frame Format:      %s\n", config->raw_format);
+    printf("Result Stream:         %s (%s)\n", config->result_stream_path,
+           result_format_to_string(config->result_format));
+    printf("Record Path:           %s\n", config->record_path);
+    printf("Detection Interval:    %d\n", config->detection_interval);
+    printf("Mask Batch Size:       %d\n", config->mask_batch_size);
+    printf("ROI Search:            %s\n", config->roi_search ? "Yes" : "No");
+    printf("Full Sweep Interval:   %d\n", config->full_sweep_interval);
+    printf("Adaptive Scale:        %s\n", config->adaptive_scale ? "Yes" : "No");
+    printf("Detection Size:        %d\n", config->detection_size);
+    printf("Verify Detections:     %s\n", config->verify_detections ? "Yes" : "No");
+    printf("Drop Policy:           %s\n", drop_policy_to_string(config->drop_policy));
+    printf("Latency Budget:        %d ms\n", config->latency_budget_ms);
+    printf("Mask Cache Age:        %d\n", config->mask_cache_age);
+    printf("Mask Policy:           %s\n", mask_policy_to_string(config->mask_policy));
+    printf("Escalation Margin:     %.2f\n", config->escalation_margin);
+    printf("Model Precision:       %s\n", model_precision_to_string(config->model_precision));
+    printf("INT8 Model Path:       %s\n", config->int8_model_path);
+    printf("Cascade Params:        %s\n", config->cascade_params);
+    for (int i = 0; i < config->fallback_cascade_count; i++) {
+        printf("Fallback Cascade %d:    %s\n", i + 1, config->fallback_cascades[i]);
+    }
     printf("==========================================\n\n");
 }
 
@@ -149,6 +291,109 @@ const char* error_to_string(fmd_error_t error) {
     }
 }
 
+const char* drop_policy_to_string(drop_policy_t policy) {
+    switch (policy) {
+        case DROP_POLICY_BLOCK: return "block";
+        case DROP_POLICY_OLDEST: return "oldest";
+        case DROP_POLICY_NEWEST: return "newest";
+        default: return "unknown";
+    }
+}
+
+// Parse "block", "oldest" or "newest"
+int parse_drop_policy(const char* text, drop_policy_t* policy) {
+    if (!text || !policy) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (strcmp(text, "block") == 0) {
+        *policy = DROP_POLICY_BLOCK;
+    } else if (strcmp(text, "oldest") == 0) {
+        *policy = DROP_POLICY_OLDEST;
+    } else if (strcmp(text, "newest") == 0) {
+        *policy = DROP_POLICY_NEWEST;
+    } else {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    return FMD_SUCCESS;
+}
+
+const char* mask_policy_to_string(mask_policy_t policy) {
+    switch (policy) {
+        case MASK_POLICY_AUTO: return "auto";
+        case MASK_POLICY_HEURISTIC: return "heuristic";
+        case MASK_POLICY_NETWORK: return "network";
+        case MASK_POLICY_CASCADE: return "cascade";
+        default: return "unknown";
+    }
+}
+
+int parse_mask_policy(const char* text, mask_policy_t* policy) {
+    if (!text || !policy) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (strcmp(text, "auto") == 0) {
+        *policy = MASK_POLICY_AUTO;
+    } else if (strcmp(text, "heuristic") == 0) {
+        *policy = MASK_POLICY_HEURISTIC;
+    } else if (strcmp(text, "network") == 0) {
+        *policy = MASK_POLICY_NETWORK;
+    } else if (strcmp(text, "cascade") == 0) {
+        *policy = MASK_POLICY_CASCADE;
+    } else {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    return FMD_SUCCESS;
+}
+
+const char* model_precision_to_string(model_precision_t precision) {
+    switch (precision) {
+        case MODEL_PRECISION_FP32: return "fp32";
+        case MODEL_PRECISION_INT8: return "int8";
+        default: return "unknown";
+    }
+}
+
+int parse_model_precision(const char* text, model_precision_t* precision) {
+    if (!text || !precision) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (strcmp(text, "fp32") == 0) {
+        *precision = MODEL_PRECISION_FP32;
+    } else if (strcmp(text, "int8") == 0) {
+        *precision = MODEL_PRECISION_INT8;
+    } else {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    return FMD_SUCCESS;
+}
+
+const char* result_format_to_string(result_format_t format) {
+    switch (format) {
+        case RESULT_FORMAT_BINARY: return "binary";
+        case RESULT_FORMAT_JSONL: return "jsonl";
+        case RESULT_FORMAT_NONE: return "none";
+        default: return "unknown";
+    }
+}
+
+int parse_result_format(const char* text, result_format_t* format) {
+    if (!text || !format) {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    
+    if (strcmp(text, "binary") == 0) {
+        *format = RESULT_FORMAT_BINARY;
+    } else if (strcmp(text, "jsonl") == 0) {
+        *format = RESULT_FORMAT_JSONL;
+    } else {
+        return FMD_ERROR_INVALID_ARGS;
+    }
+    return FMD_SUCCESS;
+}
+
 // Initialize logging system
 int init_logging_system(const logging_config_t* config) {
     if (!config) {
@@ -6,6 +6,12 @@
 #include "face_mask_detector.h"
 #include "image_processing.h"
 #include "config.h"
+#include "pipeline.h"
+#include "detection_engine.h"
+#include "thread_pool.h"
+#include "offline_processing.h"
+#include "frame_source.h"
+#include "result_stream.h"
 
 // Simple test framework
 #define TEST_ASSERT(condition, message) do { \
@@ -71,9 +77,693 @@ int test_mask_status_string() {
                 "Mask status to string conversion should work");
 }
 
+int test_scratch_view_reuse() {
+    cv::Mat backing;
+    uint64_t reallocations = 0;
+    
+    cv::Mat large = scratch_view(backing, 40, 40, CV_8UC3, &reallocations);
+    cv::Mat small = scratch_view(backing, 20, 30, CV_8UC3, &reallocations);
+    
+    TEST_ASSERT(reallocations == 1 && small.data == large.data && small.rows == 20 && small.cols == 30,
+                "Smaller scratch views should reuse the backing buffer");
+}
+
+int test_roi_features_kernels() {
+    uint8_t bgr[9 * 37 * 3];
+    for (size_t i = 0; i < sizeof(bgr); i++) {
+        bgr[i] = (uint8_t)((i * 131 + 17) % 256);
+    }
+    
+    uint8_t gray_auto[9 * 37];
+    uint8_t gray_scalar[9 * 37];
+    roi_features_t fast, exact;
+    compute_bgr_roi_features(bgr, 37 * 3, 37, 9, gray_auto, 37, &fast, ROI_KERNEL_AUTO);
+    compute_bgr_roi_features(bgr, 37 * 3, 37, 9, gray_scalar, 37, &exact, ROI_KERNEL_SCALAR);
+    
+    TEST_ASSERT(memcmp(gray_auto, gray_scalar, sizeof(gray_auto)) == 0 &&
+                fast.hue_mean == exact.hue_mean && fast.saturation_mean == exact.saturation_mean &&
+                fast.value_mean == exact.value_mean && fast.gray_std == exact.gray_std,
+                "SIMD ROI features should match the scalar kernel exactly");
+}
+
+int test_feature_plane_stats() {
+    cv::Mat frame(48, 64, CV_8UC3);
+    for (int y = 0; y < frame.rows; y++) {
+        for (int x = 0; x < frame.cols * 3; x++) {
+            frame.ptr<uchar>(y)[x] = (uchar)((x * 37 + y * 11) % 256);
+        }
+    }
+    
+    feature_plane_t plane;
+    plane.valid = false;
+    plane.builds = 0;
+    cv::Rect rect(10, 8, 20, 16);
+    cv::Mat gray;
+    roi_features_t direct, lookup;
+    
+    int built = build_feature_plane(frame, cv::Rect(4, 4, 40, 30), &plane);
+    compute_roi_features(frame(rect), gray, &direct);
+    int looked_up = feature_plane_stats(&plane, rect, &lookup);
+    
+    TEST_ASSERT(built == FMD_SUCCESS && looked_up == FMD_SUCCESS && !feature_plane_covers(&plane, cv::Rect(0, 0, 10, 10)) &&
+                lookup.hue_mean == direct.hue_mean && lookup.saturation_mean == direct.saturation_mean &&
+                fabs(lookup.gray_std - direct.gray_std) < 1e-6 && lookup.skin_ratio >= 0.0 && lookup.skin_ratio <= 1.0,
+                "Feature plane lookups should match a direct pass over the region");
+}
+
+// Test cascade chain parsing
+int test_cascade_spec_parsing() {
+    detection_params_t params;
+    char path[MAX_PATH_LENGTH];
+    set_default_detection_params(&params);
+    
+    int result = parse_cascade_spec("models/lbp.xml 1.2 4 20 0", path, sizeof(path), &params);
+    TEST_ASSERT(result == FMD_SUCCESS && strcmp(path, "models/lbp.xml") == 0 &&
+                params.min_neighbors == 4 && params.min_size_width == 20 && params.max_size_width == 0,
+                "Cascade spec should yield path and per-cascade parameters");
+}
+
+// Test pipeline frame queue
+int test_frame_queue_order() {
+    frame_queue_t queue;
+    frame_packet_t packet;
+    init_frame_queue(&queue, 2);
+    
+    packet.sequence = 1;
+    frame_queue_push(&queue, &packet);
+    packet.sequence = 2;
+    frame_queue_push(&queue, &packet);
+    frame_queue_close(&queue);
+    
+    bool ordered = true;
+    uint64_t expected = 1;
+    while (frame_queue_pop(&queue, &packet) == FMD_SUCCESS) {
+        ordered = ordered && packet.sequence == expected++;
+    }
+    cleanup_frame_queue(&queue);
+    
+    TEST_ASSERT(ordered && expected == 3, 
+                "Frame queue should drain in FIFO order after close");
+}
+
+// Test that drop-oldest keeps the freshest frames
+int test_frame_queue_drop_oldest() {
+    frame_queue_t queue;
+    frame_packet_t packet;
+    init_frame_queue(&queue, 2);
+    queue.policy = DROP_POLICY_OLDEST;
+    
+    for (uint64_t sequence = 1; sequence <= 3; sequence++) {
+        packet.sequence = sequence;
+        frame_queue_push(&queue, &packet);
+    }
+    frame_queue_close(&queue);
+    
+    frame_queue_pop(&queue, &packet);
+    uint64_t first = packet.sequence;
+    uint64_t dropped = queue.dropped;
+    cleanup_frame_queue(&queue);
+    
+    TEST_ASSERT(first == 2 && dropped == 1, 
+                "A full drop-oldest queue should evict its oldest frame");
+}
+
+// Test that queue depth is sampled on every push
+int test_frame_queue_depth_metrics() {
+    frame_queue_t queue;
+    frame_packet_t packet;
+    init_frame_queue(&queue, 4);
+    
+    for (uint64_t sequence = 1; sequence <= 3; sequence++) {
+        packet.sequence = sequence;
+        frame_queue_push(&queue, &packet);
+    }
+    frame_queue_pop(&queue, &packet);
+    frame_queue_push(&queue, &packet);
+    uint64_t pushes = queue.pushes;
+    uint64_t depth_sum = queue.depth_sum;
+    int max_depth = queue.max_depth;
+    cleanup_frame_queue(&queue);
+    
+    TEST_ASSERT(pushes == 4 && depth_sum == 9 && max_depth == 3,
+                "Frame queue should record its depth after each push");
+}
+
+// Test that per-stream options are refused with several detection workers
+int test_pipeline_worker_validation() {
+    app_config_t config;
+    set_default_config(&config);
+    config.detection_workers = 2;
+    int parallel = validate_pipeline_workers(&config);
+    config.detection_interval = 3;
+    int tracked = validate_pipeline_workers(&config);
+    config.detection_workers = 1;
+    int single = validate_pipeline_workers(&config);
+    
+    TEST_ASSERT(parallel == FMD_SUCCESS && tracked == FMD_ERROR_INVALID_ARGS && single == FMD_SUCCESS,
+                "Detection intervals above 1 should need a single pipeline worker");
+}
+
+// Test that batch segments cover the video contiguously and respect the minimum length
+int test_plan_video_segments() {
+    static video_segment_t segments[MAX_VIDEO_SEGMENTS];
+    int64_t frame_count = 10007;
+    int count = plan_video_segments(frame_count, 4, segments, MAX_VIDEO_SEGMENTS);
+    
+    bool contiguous = count == 4 * SEGMENTS_PER_WORKER && segments[0].start_frame == 0 &&
+                      segments[count - 1].end_frame == INT64_MAX;
+    for (int i = 1; i < count && contiguous; i++) {
+        contiguous = segments[i].start_frame == segments[i - 1].end_frame &&
+                     segments[i].end_frame - segments[i].start_frame >= MIN_SEGMENT_FRAMES;
+    }
+    int short_count = plan_video_segments(MIN_SEGMENT_FRAMES + 10, 8, segments, MAX_VIDEO_SEGMENTS);
+    
+    TEST_ASSERT(contiguous && short_count == 1,
+                "Segments should tile the video without gaps, never be shorter than the minimum and read to the end");
+}
+
+// Test that directories, globs and stills select the image mode, videos do not
+int test_image_input_detection() {
+    bool images = is_image_input(".") && is_image_input("kiosk/*.jpg") && is_image_input("entry.PNG");
+    bool videos = is_image_input("recording.mp4") || is_image_input("");
+    
+    TEST_ASSERT(images && !videos, "Image inputs should be told apart from videos");
+}
+
+// Test raw frame geometry parsing
+int test_raw_frame_format_parsing() {
+    raw_frame_format_t format;
+    bool parsed = parse_raw_frame_format("1280x720:bgr@25", &format) == FMD_SUCCESS &&
+                  format.width == 1280 && format.height == 720 &&
+                  format.pixels == FRAME_PIXELS_BGR && format.fps == 25.0;
+    bool rejected = parse_raw_frame_format("1280x720:rgba", &format) != FMD_SUCCESS &&
+                    parse_raw_frame_format("1280:bgr", &format) != FMD_SUCCESS;
+    
+    TEST_ASSERT(parsed && rejected, "Raw formats should parse and unknown layouts should be rejected");
+}
+
+// Test that a Y4M file is indexed frame by frame, a truncated frame is dropped
+// and a high bit depth colorspace is rejected
+int test_y4m_frame_index() {
+    const char* path = "/tmp/fmd_test_frames.y4m";
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        TEST_ASSERT(false, "Could not create the test Y4M file");
+    }
+    uint8_t plane[4 * 2 * 3 / 2];
+    memset(plane, 128, sizeof(plane));
+    fprintf(file, "YUV4MPEG2 W4 H2 F25:1 Ip A1:1 C420jpeg\n");
+    fprintf(file, "FRAME\n");
+    fwrite(plane, 1, sizeof(plane), file);
+    fprintf(file, "FRAME Ixyz\n");
+    fwrite(plane, 1, sizeof(plane), file);
+    fprintf(file, "FRAME\n");
+    fwrite(plane, 1, 5, file);
+    fclose(file);
+    
+    frame_source_t source;
+    init_frame_source(&source);
+    int result = open_mapped_frame_source(&source, path, NULL);
+    int64_t frames = frame_source_frame_count(&source);
+    cv::Size size = frame_source_size(&source);
+    double fps = frame_source_fps(&source);
+    close_frame_source(&source);
+    
+    file = fopen(path, "wb");
+    if (!file) {
+        remove(path);
+        TEST_ASSERT(false, "Could not create the test Y4M file");
+    }
+    fprintf(file, "YUV4MPEG2 W4 H2 F25:1 C420p10\n");
+    fprintf(file, "FRAME\n");
+    fwrite(plane, 1, sizeof(plane), file);
+    fclose(file);
+    
+    int deep_result = open_mapped_frame_source(&source, path, NULL);
+    close_frame_source(&source);
+    remove(path);
+    
+    TEST_ASSERT(result == FMD_SUCCESS && frames == 2 && size.width == 4 && size.height == 2 && fps == 25.0 &&
+                deep_result != FMD_SUCCESS,
+                "Y4M frames should be indexed with their geometry and rate, and 10-bit input rejected");
+}
+
+// Test that binary result records read back as written
+int test_result_stream_round_trip() {
+    const char* path = "/tmp/fmd_test_results.fmdr";
+    face_detection_t faces[2];
+    memset(faces, 0, sizeof(faces));
+    faces[0].x = 10;
+    faces[0].width = 40;
+    faces[0].height = 48;
+    faces[0].track_id = 3;
+    faces[0].mask_status = MASK_STATUS_WITH_MASK;
+    faces[0].mask_confidence = 0.875f;
+    faces[1].y = 200;
+    faces[1].track_id = -1;
+    faces[1].mask_status = MASK_STATUS_WITHOUT_MASK;
+    
+    result_stream_t stream;
+    if (open_result_stream(&stream, path, RESULT_FORMAT_BINARY, 0) != FMD_SUCCESS) {
+        TEST_ASSERT(false, "Could not create the test result stream");
+    }
+    write_result_record(&stream, 7, 116.5, faces, 2);
+    write_result_record(&stream, 8, 133.2, NULL, 0);
+    close_result_stream(&stream);
+    
+    uint8_t data[256];
+    FILE* file = fopen(path, "rb");
+    size_t size = file ? fread(data, 1, sizeof(data), file) : 0;
+    if (file) fclose(file);
+    remove(path);
+    
+    uint64_t frame = 0;
+    double timestamp = 0.0;
+    face_detection_t decoded[MAX_FACES];
+    int count = 0;
+    size_t offset = RESULT_STREAM_HEADER_BYTES;
+    int first = decode_result_record(data + offset, size - offset, &frame, &timestamp, decoded, MAX_FACES, &count);
+    bool first_ok = first > 0 && frame == 7 && timestamp == 116.5 && count == 2 &&
+                    decoded[0].width == 40 && decoded[0].track_id == 3 &&
+                    decoded[0].mask_status == MASK_STATUS_WITH_MASK && decoded[0].mask_confidence == 0.875f &&
+                    decoded[1].y == 200 && decoded[1].mask_status == MASK_STATUS_WITHOUT_MASK;
+    offset += first > 0 ? first : 0;
+    int second = decode_result_record(data + offset, size - offset, &frame, &timestamp, decoded, MAX_FACES, &count);
+    
+    TEST_ASSERT(memcmp(data, RESULT_STREAM_MAGIC, 4) == 0 && first_ok && second > 0 && frame == 8 && count == 0 &&
+                offset + second == size, "Binary result records should decode to what was written");
+}
+
+// Test that a recording replays the recorded frames with their timestamps
+int test_recording_replay() {
+    const char* path = "/tmp/fmd_test_recording.fmdv";
+    frame_recorder_t recorder;
+    if (open_frame_recorder(&recorder, path, 25.0) != FMD_SUCCESS) {
+        TEST_ASSERT(false, "Could not create the test recording");
+    }
+    for (int i = 0; i < 3; i++) {
+        cv::Mat frame(2, 4, CV_8UC3, cv::Scalar(10 * i, 20 * i, 30 * i));
+        record_frame(&recorder, frame, 0.04 * i);
+    }
+    cv::Mat wrong_size(4, 4, CV_8UC3, cv::Scalar(0, 0, 0));
+    int rejected = record_frame(&recorder, wrong_size, 0.2);
+    close_frame_recorder(&recorder);
+    
+    frame_source_t source;
+    init_frame_source(&source);
+    int result = open_mapped_frame_source(&source, path, NULL);
+    int64_t frames = frame_source_frame_count(&source);
+    seek_frame_source(&source, 2);
+    double time = frame_source_next_time(&source);
+    cv::Mat frame;
+    bool read = read_frame_source(&source, frame);
+    bool pixels = read && frame.cols == 4 && frame.rows == 2 && frame.ptr<uchar>(1)[5] == 60;
+    close_frame_source(&source);
+    remove(path);
+    
+    TEST_ASSERT(result == FMD_SUCCESS && rejected != FMD_SUCCESS && frames == 3 && time == 0.08 && pixels,
+                "A replayed recording should return the recorded frames and capture times");
+}
+
+// Run a recording through detect_faces with a fresh engine, as a new process would
+static int replay_detections(const char* path, const app_config_t* config, face_detection_t* faces, int* counts,
+                             int max_frames) {
+    app_state_t* state = new app_state_t();
+    frame_source_t source;
+    init_frame_source(&source);
+    if (load_detection_models(state, config) != FMD_SUCCESS ||
+        open_mapped_frame_source(&source, path, NULL) != FMD_SUCCESS) {
+        unload_detection_models(state);
+        delete state;
+        return -1;
+    }
+    
+    int frames = 0;
+    cv::Mat frame;
+    while (frames < max_frames && read_frame_source(&source, frame)) {
+        counts[frames] = detect_faces(state, frame, &faces[frames * MAX_FACES], MAX_FACES);
+        frames++;
+    }
+    frame.release();
+    close_frame_source(&source);
+    unload_detection_models(state);
+    delete state;
+    return frames;
+}
+
+// Test that replaying a recording twice gives the same detections. Track ids
+// are unique per process, so only boxes and results are compared.
+int test_replay_determinism() {
+    const char* path = "/tmp/fmd_test_replay.fmdv";
+    const int frame_count = 8;
+    frame_recorder_t recorder;
+    if (open_frame_recorder(&recorder, path, 25.0) != FMD_SUCCESS) {
+        TEST_ASSERT(false, "Could not create the test recording");
+    }
+    for (int i = 0; i < frame_count; i++) {
+        // A crude face drifting to the right: skin oval, eyes and a mask
+        cv::Mat frame(240, 320, CV_8UC3, cv::Scalar(90, 90, 90));
+        cv::Rect face(100 + 3 * i, 50, 110, 140);
+        frame(face).setTo(cv::Scalar(120, 150, 200));
+        frame(cv::Rect(face.x + 25, face.y + 40, 20, 10)).setTo(cv::Scalar(30, 30, 30));
+        frame(cv::Rect(face.x + 65, face.y + 40, 20, 10)).setTo(cv::Scalar(30, 30, 30));
+        frame(cv::Rect(face.x + 15, face.y + 80, 80, 50)).setTo(cv::Scalar(200, 200, 190));
+        record_frame(&recorder, frame, 0.04 * i);
+    }
+    close_frame_recorder(&recorder);
+    
+    app_config_t config;
+    set_default_config(&config);
+    config.face_threads = 2;
+    config.detection_interval = 2;
+    config.mask_cache_age = 2;
+    
+    static face_detection_t first[frame_count * MAX_FACES];
+    static face_detection_t second[frame_count * MAX_FACES];
+    int first_counts[frame_count];
+    int second_counts[frame_count];
+    int first_frames = replay_detections(path, &config, first, first_counts, frame_count);
+    int second_frames = replay_detections(path, &config, second, second_counts, frame_count);
+    remove(path);
+    
+    bool same = first_frames == frame_count && second_frames == frame_count;
+    for (int f = 0; same && f < frame_count; f++) {
+        same = first_counts[f] == second_counts[f];
+        for (int i = 0; same && i < first_counts[f]; i++) {
+            const face_detection_t* a = &first[f * MAX_FACES + i];
+            const face_detection_t* b = &second[f * MAX_FACES + i];
+            same = a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height &&
+                   a->confidence == b->confidence && a->mask_status == b->mask_status &&
+                   a->mask_confidence == b->mask_confidence;
+        }
+    }
+    
+    TEST_ASSERT(same, "Two replays of a recording should give the same detections");
+}
+
+// Test that a face keeps its track id while it moves
+int test_face_track_persistence() {
+    static face_track_t tracks[4];
+    init_face_tracking(tracks, 4);
+    
+    face_detection_t face;
+    memset(&face, 0, sizeof(face));
+    face.x = 100;
+    face.y = 100;
+    face.width = 80;
+    face.height = 80;
+    update_face_tracks(tracks, 4, &face, 1, 0.0);
+    int first_id = face.track_id;
+    
+    face.x += 10;
+    face.y += 5;
+    int active = update_face_tracks(tracks, 4, &face, 1, 0.1);
+    
+    TEST_ASSERT(first_id >= 0 && face.track_id == first_id && active == 1, 
+                "A moving face should keep its track id");
+}
+
+// Test that faces interleaved in one frame keep their own smoothing locks
+int test_smoothing_per_face() {
+    mask_smoothing_t masked, unmasked;
+    reset_mask_smoothing(&masked);
+    reset_mask_smoothing(&unmasked);
+    
+    // Interleaved like two faces in one frame; each must lock to its own status
+    mask_status_t masked_result = MASK_STATUS_UNKNOWN;
+    mask_status_t unmasked_result = MASK_STATUS_UNKNOWN;
+    for (int i = 0; i < 6; i++) {
+        masked_result = apply_temporal_smoothing(&masked, MASK_STATUS_WITH_MASK);
+        unmasked_result = apply_temporal_smoothing(&unmasked, MASK_STATUS_WITHOUT_MASK);
+    }
+    
+    TEST_ASSERT(masked_result == MASK_STATUS_WITH_MASK && unmasked_result == MASK_STATUS_WITHOUT_MASK &&
+                masked.locked_status == MASK_STATUS_WITH_MASK && unmasked.locked_status == MASK_STATUS_WITHOUT_MASK,
+                "Faces should keep independent smoothing locks");
+}
+
+// Test that a cached mask result expires with age and appearance change
+int test_mask_cache_reuse() {
+    face_track_t track;
+    init_face_tracking(&track, 1);
+    
+    uint8_t signature[MASK_SIGNATURE_PIXELS];
+    memset(signature, 100, sizeof(signature));
+    store_mask_cache(&track, signature, MASK_STATUS_WITH_MASK, 0.9f);
+    
+    mask_status_t status = MASK_STATUS_UNKNOWN;
+    float confidence = 0.0f;
+    bool hit = lookup_mask_cache(&track, signature, 2, &status, &confidence);
+    bool second_hit = lookup_mask_cache(&track, signature, 2, &status, &confidence);
+    bool expired = !lookup_mask_cache(&track, signature, 2, &status, &confidence);
+    
+    store_mask_cache(&track, signature, MASK_STATUS_WITH_MASK, 0.9f);
+    memset(signature, 100 + 2 * MASK_SIGNATURE_TOLERANCE, sizeof(signature));
+    bool changed = !lookup_mask_cache(&track, signature, 2, &status, &confidence);
+    
+    TEST_ASSERT(hit && second_hit && expired && changed && status == MASK_STATUS_WITH_MASK && confidence == 0.9f,
+                "Cached mask results should expire with age and appearance change");
+}
+
+int test_model_precision_parsing() {
+    model_precision_t precision = MODEL_PRECISION_FP32;
+    int result = parse_model_precision("int8", &precision);
+    
+    TEST_ASSERT(result == FMD_SUCCESS && precision == MODEL_PRECISION_INT8 &&
+                parse_model_precision("int4", &precision) != FMD_SUCCESS &&
+                strcmp(model_precision_to_string(precision), "int8") == 0,
+                "Model precision should parse fp32/int8 and reject anything else");
+}
+
+int test_write_tensor_slot() {
+    cv::Mat image(2, 2, CV_8UC3, cv::Scalar(10, 20, 30));
+    int shape[] = {2, 3, 2, 2};
+    cv::Mat tensor(4, shape, CV_32F, cv::Scalar(0));
+    const uchar* tensor_data = tensor.data;
+    int result = write_tensor_slot(image, tensor, 1, 0.5, cv::Scalar(1, 2, 3), true);
+    
+    const float* slot0 = tensor.ptr<float>(0);
+    const float* slot1 = tensor.ptr<float>(1);
+    TEST_ASSERT(result == FMD_SUCCESS && tensor.data == tensor_data && slot0[0] == 0.0f &&
+                slot1[0] == 14.5f && slot1[4] == 9.0f && slot1[11] == 3.5f,
+                "Tensor slot should hold swapped, mean-subtracted and scaled channels in place");
+}
+
+int test_crop_face_into_tensor() {
+    // A crop of the tensor's own size is copied pixel for pixel
+    cv::Mat frame(6, 6, CV_8UC3, cv::Scalar(0, 0, 0));
+    for (int y = 0; y < frame.rows; y++) {
+        for (int x = 0; x < frame.cols; x++) {
+            frame.ptr<uchar>(y)[x * 3 + 2] = (uchar)(x * 10 + y);
+        }
+    }
+    face_detection_t face;
+    memset(&face, 0, sizeof(face));
+    face.x = 1;
+    face.y = 1;
+    face.width = 4;
+    face.height = 4;
+    int shape[] = {1, 3, 4, 4};
+    cv::Mat tensor(4, shape, CV_32F, cv::Scalar(0));
+    int result = crop_face_into_tensor(frame, &face, 0, tensor, 0, 1.0, cv::Scalar(0, 0, 0), true);
+    
+    // Red lands in the first channel after the swap
+    const float* red = tensor.ptr<float>(0);
+    TEST_ASSERT(result == FMD_SUCCESS && red[0] == 11.0f && red[1] == 21.0f && red[4] == 12.0f && red[15] == 44.0f,
+                "Face crop should be resized and normalized straight into the tensor slot");
+}
+
+// Test classifiers: the primary is unsure of faces left of x = 50 and
+// counts the calls that asked for a margin
+static int g_margin_requests = 0;
+
+static int test_primary_classify(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* face,
+                                 mask_status_t* status, float* confidence, float* margin) {
+    (void)engine;
+    (void)frame;
+    *status = MASK_STATUS_WITH_MASK;
+    *confidence = 0.8f;
+    if (margin) {
+        __sync_add_and_fetch(&g_margin_requests, 1);
+        *margin = face->x < 50 ? 0.1f : 0.9f;
+    }
+    return FMD_SUCCESS;
+}
+
+static int test_fallback_classify(detection_engine_t* engine, const cv::Mat& frame, const face_detection_t* face,
+                                  mask_status_t* status, float* confidence, float* margin) {
+    (void)engine;
+    (void)frame;
+    (void)face;
+    *status = MASK_STATUS_WITHOUT_MASK;
+    *confidence = 0.95f;
+    if (margin) {
+        *margin = 0.9f;
+    }
+    return FMD_SUCCESS;
+}
+
+int test_classifier_escalation() {
+    static detection_engine_t engine;
+    const mask_classifier_t primary = {"test-primary", false, test_primary_classify, NULL};
+    const mask_classifier_t fallback = {"test-fallback", false, test_fallback_classify, NULL};
+    int result = set_mask_classifiers(&engine, &primary, &fallback, 0.5f);
+    
+    cv::Mat frame(100, 100, CV_8UC3, cv::Scalar(0, 0, 0));
+    face_detection_t faces[2];
+    memset(faces, 0, sizeof(faces));
+    faces[0].x = 10;
+    faces[1].x = 60;
+    mask_status_t statuses[2];
+    float confidences[2];
+    classify_faces(&engine, frame, faces, 2, statuses, confidences);
+    
+    TEST_ASSERT(result == FMD_SUCCESS && statuses[0] == MASK_STATUS_WITHOUT_MASK && statuses[1] == MASK_STATUS_WITH_MASK &&
+                engine.metrics.classified_faces == 2 && engine.metrics.escalated_faces == 1,
+                "Only low-margin faces should be escalated to the fallback classifier");
+}
+
+// Test that an engine without a fallback never asks for margins
+int test_primary_only_skips_margins() {
+    static detection_engine_t engine;
+    const mask_classifier_t primary = {"test-primary", false, test_primary_classify, NULL};
+    set_mask_classifiers(&engine, &primary, NULL, 0.5f);
+    
+    cv::Mat frame(100, 100, CV_8UC3, cv::Scalar(0, 0, 0));
+    face_detection_t faces[2];
+    memset(faces, 0, sizeof(faces));
+    faces[1].x = 60;
+    mask_status_t statuses[2];
+    float confidences[2];
+    g_margin_requests = 0;
+    int result = classify_faces(&engine, frame, faces, 2, statuses, confidences);
+    
+    TEST_ASSERT(result == FMD_SUCCESS && g_margin_requests == 0 && statuses[0] == MASK_STATUS_WITH_MASK,
+                "Without a fallback classifier no margin should be requested");
+}
+
+// Test that heuristic margins do not depend on how often the classifier ran
+int test_heuristic_margin_repeatable() {
+    cv::Mat frame(120, 120, CV_8UC3);
+    for (int y = 0; y < frame.rows; y++) {
+        uchar* row = frame.ptr<uchar>(y);
+        for (int x = 0; x < frame.cols; x++) {
+            row[x * 3] = (uchar)(x * 7);
+            row[x * 3 + 1] = (uchar)(y * 5);
+            row[x * 3 + 2] = (uchar)((x + y) * 3);
+        }
+    }
+    face_detection_t face;
+    memset(&face, 0, sizeof(face));
+    face.width = 100;
+    face.height = 100;
+    
+    static detection_scratch_t scratch;
+    scratch.plane.valid = false;
+    float first_margin = -1.0f;
+    mask_status_t first_status = classify_mask_simple_reliable_scratch(frame, &face, &scratch, &first_margin);
+    bool repeatable = true;
+    for (int i = 0; i < 30; i++) {
+        float margin = -1.0f;
+        mask_status_t status = classify_mask_simple_reliable_scratch(frame, &face, &scratch, &margin);
+        repeatable = repeatable && status == first_status && margin == first_margin;
+    }
+    
+    TEST_ASSERT(first_status != MASK_STATUS_UNKNOWN && repeatable,
+                "The same face should always get the same status and margin");
+}
+
+int test_parallel_face_classification() {
+    static detection_engine_t engine;
+    static detection_engine_t workers[2];
+    const mask_classifier_t primary = {"test-primary", false, test_primary_classify, NULL};
+    set_mask_classifiers(&engine, &primary, NULL, 0.5f);
+    thread_pool_t pool;
+    init_thread_pool(&pool, 2);
+    engine.face_pool = &pool;
+    engine.face_engines[0] = &workers[0];
+    engine.face_engines[1] = &workers[1];
+    
+    cv::Mat frame(100, 100, CV_8UC3, cv::Scalar(0, 0, 0));
+    face_detection_t faces[5];
+    memset(faces, 0, sizeof(faces));
+    mask_status_t statuses[5];
+    float confidences[5];
+    for (int i = 0; i < 5; i++) {
+        statuses[i] = MASK_STATUS_UNKNOWN;
+    }
+    int result = classify_faces(&engine, frame, faces, 5, statuses, confidences);
+    cleanup_thread_pool(&pool);
+    engine.face_pool = NULL;
+    
+    bool complete = true;
+    for (int i = 0; i < 5; i++) {
+        complete = complete && statuses[i] == MASK_STATUS_WITH_MASK && confidences[i] == 0.8f;
+    }
+    TEST_ASSERT(result == FMD_SUCCESS && complete,
+                "Every face should be classified when faces are spread over the face pool");
+}
+
+static void record_task(void* context, int task_index, int worker_index) {
+    int* slots = (int*)context;
+    (void)worker_index;
+    slots[task_index] = task_index + 1;
+}
+
+// Test that every pool task runs exactly once
+int test_thread_pool_run() {
+    thread_pool_t pool;
+    int slots[64] = {0};
+    init_thread_pool(&pool, 4);
+    thread_pool_run(&pool, record_task, slots, 64);
+    cleanup_thread_pool(&pool);
+    
+    bool complete = true;
+    for (int i = 0; i < 64; i++) {
+        complete = complete && slots[i] == i + 1;
+    }
+    TEST_ASSERT(complete, 
+                "Thread pool should run every task index once");
+}
+
+// Test that overlapping search regions are merged
+int test_merge_search_regions() {
+    std::vector<cv::Rect> regions;
+    regions.push_back(cv::Rect(0, 0, 50, 50));
+    regions.push_back(cv::Rect(40, 40, 50, 50));
+    regions.push_back(cv::Rect(200, 200, 20, 20));
+    merge_search_regions(regions);
+    
+    TEST_ASSERT(regions.size() == 2 && regions[0] == cv::Rect(0, 0, 90, 90), 
+                "Overlapping regions should merge into their union");
+}
+
+// Test that face size percentiles follow the recorded widths
+int test_face_size_percentile() {
+    face_size_stats_t stats;
+    reset_face_size_stats(&stats);
+    for (int i = 0; i < 100; i++) {
+        record_face_size(&stats, i < 50 ? 60 : 120);
+    }
+    
+    int low = face_size_percentile(&stats, 0.02);
+    int high = face_size_percentile(&stats, 0.98);
+    TEST_ASSERT(low <= 60 && low > 50 && high <= 120 && high > 105, 
+                "Percentiles should land in the bins of the recorded widths");
+}
+
+// Test the detection resolution choice
+int test_optimal_input_size() {
+    TEST_ASSERT(get_optimal_input_size(1920, 1080, 640) == 640 &&
+                get_optimal_input_size(320, 240, 640) == 320 &&
+                get_optimal_input_size(1920, 1080, 0) == 1920, 
+                "Detection size should cap the long side only when smaller");
+}
+
 // Test logging system
 int test_logging_initialization() {
-    logging_config_t log_config = {0};
+    logging_config_t log_config;
+    memset(&log_config, 0, sizeof(log_config));
     log_config.level = LOG_LEVEL_INFO;
     log_config.console_output = true;
     log_config.file_output = false;
@@ -115,6 +805,95 @@ int main(int argc, char* argv[]) {
     tests_run++;
     if (test_mask_status_string() == 0) tests_passed++;
     
+    tests_run++;
+    if (test_scratch_view_reuse() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_roi_features_kernels() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_feature_plane_stats() == 0) tests_passed++;
+    
+    // Run detection tests
+    tests_run++;
+    if (test_cascade_spec_parsing() == 0) tests_passed++;
+    
+    // Run pipeline tests
+    tests_run++;
+    if (test_frame_queue_order() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_frame_queue_drop_oldest() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_frame_queue_depth_metrics() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_pipeline_worker_validation() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_plan_video_segments() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_image_input_detection() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_raw_frame_format_parsing() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_y4m_frame_index() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_result_stream_round_trip() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_recording_replay() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_replay_determinism() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_face_track_persistence() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_smoothing_per_face() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_mask_cache_reuse() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_model_precision_parsing() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_write_tensor_slot() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_crop_face_into_tensor() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_classifier_escalation() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_primary_only_skips_margins() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_heuristic_margin_repeatable() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_thread_pool_run() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_parallel_face_classification() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_merge_search_regions() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_face_size_percentile() == 0) tests_passed++;
+    
+    tests_run++;
+    if (test_optimal_input_size() == 0) tests_passed++;
+    
     // Run logging tests
     tests_run++;
     if (test_logging_initialization() == 0) tests_passed++;
@@ -0,0 +1,149 @@
+#include "face_mask_detector.h"
+#include "detection_engine.h"
+#include "config.h"
+
+// Compare a float mask model with its quantized copy on a folder of face
+// crops: per-face latency of each, and how often the two agree.
+//
+//   bin/mask_model_benchmark FP32_MODEL INT8_MODEL CROP_DIR [RUNS]
+
+typedef struct {
+    const char* label;
+    std::vector<double> latencies_ms;
+    std::vector<mask_status_t> statuses;
+    std::vector<float> confidences;
+} benchmark_result_t;
+
+static int load_crops(const char* directory, std::vector<cv::Mat>& crops) {
+    std::vector<cv::String> paths;
+    try {
+        cv::glob(cv::String(directory) + "/*", paths, false);
+    } catch (const cv::Exception& e) {
+        log_error("Could not list %s: %s", directory, e.what());
+        return FMD_ERROR_FILE_NOT_FOUND;
+    }
+    
+    for (size_t i = 0; i < paths.size(); i++) {
+        cv::Mat crop = cv::imread(paths[i], cv::IMREAD_COLOR);
+        if (!crop.empty()) {
+            crops.push_back(crop);
+        }
+    }
+    return crops.empty() ? FMD_ERROR_FILE_NOT_FOUND : FMD_SUCCESS;
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) return 0.0;
+    
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, (size_t)(fraction * (values.size() - 1) + 0.5));
+    return values[index];
+}
+
+// Classify every crop RUNS times with one model; statuses are kept from the
+// first run, latencies from all of them
+static int run_benchmark(const char* model_path, model_precision_t precision, const std::vector<cv::Mat>& crops,
+                         int runs, benchmark_result_t* result) {
+    model_config_t face_config;
+    set_default_model_config(&face_config, MODEL_TYPE_HAAR_CASCADE);
+    strncpy(face_config.model_path, DEFAULT_CASCADE_FILE, MAX_PATH_LENGTH - 1);
+    
+    model_config_t mask_config;
+    set_default_model_config(&mask_config, MODEL_TYPE_DNN_ONNX);
+    strncpy(mask_config.model_path, model_path, MAX_PATH_LENGTH - 1);
+    mask_config.precision = precision;
+    
+    detection_engine_t* engine = new detection_engine_t();
+    int status = init_detection_engine(engine, &face_config, &mask_config);
+    if (status == FMD_SUCCESS && engine->mask_network.empty()) {
+        status = FMD_ERROR_MODEL_LOAD;
+    }
+    if (status == FMD_SUCCESS) {
+        status = warm_up_mask_network(engine);
+    }
+    
+    for (int run = 0; run < runs && status == FMD_SUCCESS; run++) {
+        for (size_t i = 0; i < crops.size(); i++) {
+            mask_status_t mask_status;
+            float confidence;
+            double start = get_current_time();
+            status = run_mask_classification_dnn(engine, crops[i], &mask_status, &confidence);
+            result->latencies_ms.push_back((get_current_time() - start) * 1000.0);
+            if (status != FMD_SUCCESS) break;
+            
+            if (run == 0) {
+                result->statuses.push_back(mask_status);
+                result->confidences.push_back(confidence);
+            }
+        }
+    }
+    
+    cleanup_detection_engine(engine);
+    delete engine;
+    return status;
+}
+
+static void print_latency(const benchmark_result_t* result) {
+    double total = 0.0;
+    for (size_t i = 0; i < result->latencies_ms.size(); i++) {
+        total += result->latencies_ms[i];
+    }
+    printf("%-5s mean %7.3f ms  p50 %7.3f ms  p95 %7.3f ms  (%zu faces)\n",
+           result->label,
+           total / std::max((size_t)1, result->latencies_ms.size()),
+           percentile(result->latencies_ms, 0.50),
+           percentile(result->latencies_ms, 0.95),
+           result->latencies_ms.size());
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s FP32_MODEL INT8_MODEL CROP_DIR [RUNS]\n", argv[0]);
+        return 1;
+    }
+    
+    int runs = argc > 4 ? atoi(argv[4]) : 5;
+    if (runs < 1) {
+        printf("RUNS must be at least 1\n");
+        return 1;
+    }
+    
+    logging_config_t logging;
+    memset(&logging, 0, sizeof(logging));
+    logging.level = LOG_LEVEL_WARNING;
+    logging.console_output = true;
+    init_logging_system(&logging);
+    
+    std::vector<cv::Mat> crops;
+    if (load_crops(argv[3], crops) != FMD_SUCCESS) {
+        printf("No readable images in %s\n", argv[3]);
+        return 1;
+    }
+    
+    benchmark_result_t fp32;
+    benchmark_result_t int8;
+    fp32.label = "fp32";
+    int8.label = "int8";
+    if (run_benchmark(argv[1], MODEL_PRECISION_FP32, crops, runs, &fp32) != FMD_SUCCESS ||
+        run_benchmark(argv[2], MODEL_PRECISION_INT8, crops, runs, &int8) != FMD_SUCCESS) {
+        printf("Benchmark failed\n");
+        return 1;
+    }
+    
+    size_t agree = 0;
+    double confidence_gap = 0.0;
+    for (size_t i = 0; i < crops.size(); i++) {
+        if (fp32.statuses[i] == int8.statuses[i]) agree++;
+        confidence_gap += fabs(fp32.confidences[i] - int8.confidences[i]);
+    }
+    
+    printf("%zu crops, %d runs each, batch size 1\n", crops.size(), runs);
+    print_latency(&fp32);
+    print_latency(&int8);
+    printf("speedup %.2fx (p50)\n", percentile(fp32.latencies_ms, 0.50) / std::max(1e-9, percentile(int8.latencies_ms, 0.50)));
+    printf("agreement %.2f%% (%zu of %zu), mean confidence difference %.4f\n",
+           100.0 * agree / crops.size(), agree, crops.size(), confidence_gap / crops.size());
+    
+    cleanup_logging_system();
+    return 0;
+}
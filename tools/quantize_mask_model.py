@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Build an INT8 copy of the mask classifier with static quantization.
+
+Activations are calibrated on a folder of face crops, preprocessed exactly
+like the detector does (set_default_model_config in src/detection_engine.c):
+resize to the model input, BGR to RGB, subtract the mean in pixel units,
+then scale by 1/255.
+
+    python3 tools/quantize_mask_model.py models/mask_detector.onnx \\
+        models/mask_detector_int8.onnx path/to/face_crops
+
+Needs numpy, opencv-python and onnxruntime. Compare the result with the
+float model using bin/mask_model_benchmark (make benchmark).
+"""
+
+import argparse
+import os
+import sys
+
+import cv2
+import numpy as np
+import onnx
+from onnxruntime.quantization import (CalibrationDataReader, CalibrationMethod, QuantFormat, QuantType,
+                                      quantize_static)
+from onnxruntime.quantization.shape_inference import quant_pre_process
+
+# Must match the mask model configuration in src/detection_engine.c
+INPUT_SIZE = (224, 224)
+SCALE = 1.0 / 255.0
+MEAN = (0.485, 0.456, 0.406)
+IMAGE_EXTENSIONS = (".jpg", ".jpeg", ".png", ".bmp")
+
+
+def preprocess(image):
+    """One NCHW float32 sample, as cv::dnn::blobFromImage(swap_rb=true) builds it."""
+    resized = cv2.resize(image, INPUT_SIZE)
+    rgb = cv2.cvtColor(resized, cv2.COLOR_BGR2RGB).astype(np.float32)
+    normalized = (rgb - np.array(MEAN, dtype=np.float32)) * SCALE
+    return normalized.transpose(2, 0, 1)[np.newaxis, ...]
+
+
+class FaceCropReader(CalibrationDataReader):
+    def __init__(self, crop_dir, input_name, limit):
+        paths = sorted(os.path.join(crop_dir, name) for name in os.listdir(crop_dir)
+                       if name.lower().endswith(IMAGE_EXTENSIONS))
+        self.samples = []
+        for path in paths[:limit]:
+            image = cv2.imread(path, cv2.IMREAD_COLOR)
+            if image is not None:
+                self.samples.append({input_name: preprocess(image)})
+        self.position = 0
+
+    def get_next(self):
+        if self.position >= len(self.samples):
+            return None
+        sample = self.samples[self.position]
+        self.position += 1
+        return sample
+
+    def rewind(self):
+        self.position = 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("fp32_model", help="float ONNX mask classifier")
+    parser.add_argument("int8_model", help="where to write the quantized model")
+    parser.add_argument("crop_dir", help="folder of face crops for calibration")
+    parser.add_argument("--limit", type=int, default=500, help="most crops used for calibration (default 500)")
+    parser.add_argument("--method", choices=("minmax", "entropy", "percentile"), default="minmax",
+                        help="activation range calibration (default minmax)")
+    parser.add_argument("--per-tensor", action="store_true",
+                        help="one weight scale per tensor instead of per output channel")
+    args = parser.parse_args()
+
+    input_name = onnx.load(args.fp32_model).graph.input[0].name
+    reader = FaceCropReader(args.crop_dir, input_name, args.limit)
+    if not reader.samples:
+        print("No readable face crops in %s" % args.crop_dir, file=sys.stderr)
+        return 1
+
+    # Shape inference and graph cleanup make more of the graph quantizable
+    prepared = args.int8_model + ".prep.onnx"
+    quant_pre_process(args.fp32_model, prepared)
+
+    methods = {
+        "minmax": CalibrationMethod.MinMax,
+        "entropy": CalibrationMethod.Entropy,
+        "percentile": CalibrationMethod.Percentile,
+    }
+    try:
+        # QDQ with signed 8-bit weights and unsigned activations is the form
+        # OpenCV's dnn module imports as an INT8 graph
+        quantize_static(prepared, args.int8_model, reader,
+                        quant_format=QuantFormat.QDQ,
+                        activation_type=QuantType.QUInt8,
+                        weight_type=QuantType.QInt8,
+                        per_channel=not args.per_tensor,
+                        calibrate_method=methods[args.method])
+    finally:
+        os.remove(prepared)
+
+    print("Calibrated on %d crops, wrote %s" % (len(reader.samples), args.int8_model))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())